@@ -26,6 +26,8 @@ configuration files.
 #include <TChain.h>
 #include <TStopwatch.h>
 #include <TFriendElement.h>
+#include <TList.h>
+#include <TROOT.h>
 
 /// @cond SHOW
 /// \code
@@ -42,6 +44,7 @@ configuration files.
 #include "../interface/RooSmearer.hh"
 
 #include "../interface/nllProfile.hh"
+#include "../interface/SmearerGradFunction.hh"
 #include "../interface/auxFunctions.hh"
 
 #include "../../EOverPCalibration/interface/FastCalibratorEB.h"
@@ -99,6 +102,14 @@ typedef std::map< TString, pTChain_t > chain_map_t;
  */
 typedef std::map< TString, chain_map_t > tag_chain_map_t;
 
+//------------------------------------------------------------
+/// type to hold the pointers of the new friend trees kept in memory (--memFriends)
+typedef std::shared_ptr<TTree> pTTree_t;
+/// map that associates the name of the tree and the pointer to the tree in memory
+typedef std::map< TString, pTTree_t > tree_map_t;
+/// map that associates the name of the tag to the tree_map_t, in parallel to the tag_chain_map_t
+typedef std::map< TString, tree_map_t > tag_tree_map_t;
+
 //------------------------------------------------------------
 /** Function parsing the region files
  * \retval vector of strings, each string is the name of one region
@@ -136,9 +147,9 @@ std::vector<TString> ReadRegionsFromFile(TString fileName)
  * This function reassociates the chains as friends of the "selected" tree.
  *
  * This function should be run when new chains or files are added to the tagChainMap.
- *
+ * The trees in memory of the tagTreeMap are added as friends as well.
  */
-void UpdateFriends(tag_chain_map_t& tagChainMap, TString regionsFileNameTag)
+void UpdateFriends(tag_chain_map_t& tagChainMap, tag_tree_map_t& tagTreeMap, TString regionsFileNameTag)
 {
 //void UpdateFriends(tag_chain_map_t& tagChainMap){
 	// loop over all the tags
@@ -166,10 +177,39 @@ void UpdateFriends(tag_chain_map_t& tagChainMap, TString regionsFileNameTag)
 				exit(1);
 			}
 		}
+
+		// loop over the trees in memory
+		tree_map_t& treeMap = tagTreeMap[tag_chain_itr->first];
+		for(tree_map_t::const_iterator tree_itr = treeMap.begin();
+		        tree_itr != treeMap.end();
+		        tree_itr++) {
+			if(chain->GetFriend(tree_itr->first) == NULL) {
+				std::cout << "[STATUS] Adding friend branch in memory: " << tree_itr->first
+				          << " to tag " << tag_chain_itr->first << std::endl;
+				chain->AddFriend(tree_itr->second.get());
+			}
+
+			if(chain->GetEntries() != tree_itr->second->GetEntries()) {
+				std::cerr << "[ERROR] Not the same number of events: " << chain->GetEntries() << "\t" << tree_itr->second->GetEntries() << std::endl;
+				exit(1);
+			}
+		}
 	}
 	return;
 }
 
+//------------------------------------------------------------
+/** Inserts the new friend treeName of the tag:
+ * the chain of its files in the tagChainMap or the tree in memory in the tagTreeMap
+ */
+void InsertFriend(tag_chain_map_t& tagChainMap, tag_tree_map_t& tagTreeMap, TString tag, TString treeName, TTree *tree)
+{
+	tree->SetTitle(tag);
+	TChain *chain = dynamic_cast<TChain *>(tree);
+	if(chain != NULL) tagChainMap[tag].insert(std::make_pair(treeName, pTChain_t(chain)));
+	else tagTreeMap[tag].insert(std::make_pair(treeName, pTTree_t(tree)));
+}
+
 //------------------------------------------------------------
 void Dump(tag_chain_map_t& tagChainMap, TString tag = "s", Long64_t firstentry = 0)
 {
@@ -183,13 +223,15 @@ void Dump(tag_chain_map_t& tagChainMap, TString tag = "s", Long64_t firstentry =
 b tag are merged in the new \b tag
  *
  * A new tagChain with name=tag is added to the tagChainMap. All the tagChains with tag starting with \b tag are merged
+ * The trees in memory of the tagTreeMap are merged in new trees in memory, in the same order
  * After the merging the friend list is updated by \ref UpdateFriends
  */
-void MergeSamples(tag_chain_map_t& tagChainMap, TString regionsFileNameTag, TString tag = "s")
+void MergeSamples(tag_chain_map_t& tagChainMap, tag_tree_map_t& tagTreeMap, TString regionsFileNameTag, TString tag = "s")
 {
 
 	std::pair<TString, chain_map_t > pair_tmp_tag(tag, chain_map_t()); // make_pair not work with scram b
 	tagChainMap.insert(pair_tmp_tag);
+	std::map<TString, TList> memTrees; // trees in memory to be merged, in the order of the tags
 
 	//loop over all the tags
 	for(tag_chain_map_t::const_iterator tag_chain_itr = tagChainMap.begin();
@@ -212,8 +254,26 @@ void MergeSamples(tag_chain_map_t& tagChainMap, TString regionsFileNameTag, TStr
 			std::cout << tag << "\t" << tag_chain_itr->first << "\t" << chainName <<  "\t" << chain_itr->second.get() << "\t" << chain_itr->second->GetTitle() << std::endl;
 
 		}
+
+		tree_map_t& treeMap = tagTreeMap[tag_chain_itr->first];
+		for(tree_map_t::const_iterator tree_itr = treeMap.begin();
+		        tree_itr != treeMap.end();
+		        tree_itr++) {
+			memTrees[tree_itr->first].Add(tree_itr->second.get());
+		}
 	}
-	UpdateFriends(tagChainMap, regionsFileNameTag);
+
+	for(std::map<TString, TList>::iterator memTrees_itr = memTrees.begin();
+	        memTrees_itr != memTrees.end();
+	        memTrees_itr++) {
+		gROOT->cd();
+		TTree *tree = TTree::MergeTrees(&(memTrees_itr->second));
+		tree->SetDirectory(NULL);
+		tree->ResetBranchAddresses();
+		tree->SetTitle(tag);
+		tagTreeMap[tag].insert(std::make_pair(memTrees_itr->first, pTTree_t(tree)));
+	}
+	UpdateFriends(tagChainMap, tagTreeMap, regionsFileNameTag);
 	return;
 }
 
@@ -266,6 +326,12 @@ int main(int argc, char **argv)
 	unsigned int nEventsMinDiag = 0;
 	unsigned int nEventsMinOffDiag = 0;
 	unsigned int nSmearToy = 1;
+	unsigned int nThreads = 1;
+	std::string eventCacheDir;
+	std::string likelihoodType;
+	double checkpointInterval = 600;
+	unsigned int nWalkers = 32, nBurnIn = 100;
+	std::vector<double> mcFractions;
 
 	int pdfSystWeightIndex = -1;
 	std::string minimType;
@@ -372,6 +438,7 @@ int main(int argc, char **argv)
 	//("addPtBranches", "")  //add new pt branches ( 3 by default, fra, ele, pho)
 	("addBranch", po::value< std::vector<string> >(&branchList), "")
 	("saveAddBranchTree", "")
+	("memFriends", "keep the new friend trees (pileup, r9Weight, ZPtWeight, addBranch) in memory instead of the tmp/ files, unless they are saved with the save options (with --nThreads > 1 each worker thread reads its own copy)")
 	//    ("signal,s", po::value< std::vector <string> >(&signalFiles), "Signal file (can be called multiple times putting the files in a chain")
 	//    ("bkg,b", po::value< std::vector <string> >(&bkgFiles), "Bkg file (can be called multiple times putting the files in a chain")
 	//    ("data,d", po::value< std::vector <string> >(&dataFiles), "Data file (can be called multiple times putting the files in a chain")
@@ -391,7 +458,7 @@ int main(int argc, char **argv)
 	;
 	smearerOption.add_options()
 	("smearerFit",  "call the smearing")
-	("smearerType", po::value<string>(&minimType)->default_value("profile"), "minimization algo")
+	("smearerType", po::value<string>(&minimType)->default_value("profile"), "minimization algo: profile, migrad (Minuit2 with batched gradient), migradNumerical (RooMinuit), MCMC, sampling, ensemble (affine-invariant ensemble MCMC, see --nWalkers), surrogate (profile with quadratic-model line searches)")
 	("onlyDiagonal", "if want to use only diagonal categories")
 	("autoBin", "")
 	("autoNsmear", "")
@@ -399,7 +466,14 @@ int main(int argc, char **argv)
 	("isDataSmeared", "")
 	("plotOnly", "active if you don't want to do the smearing")
 	("profileOnly", "")
+	("profile2D", "likelihood map in (rho, phi) of each constTerm/alpha pair, instead of the rho, phi and rho_phi4 profiles")
+	("resume", "restart the profile minimization from the last checkpoint in outDirFitResData")
+	("checkpointInterval", po::value<double>(&checkpointInterval)->default_value(600), "min time in seconds between two checkpoints of the profile minimization")
+	("mcFraction", po::value< std::vector<double> >(&mcFractions), "warm start: minimization with this fraction of the MC events (by event hash) before the full one, repeat the option for several stages (ex. --mcFraction 0.05 --mcFraction 0.25). Only profile, surrogate and migrad")
 	("numIter", po::value<unsigned int>(&nIter)->default_value(300), "number of MCMC steps")
+	("nWalkers", po::value<unsigned int>(&nWalkers)->default_value(32), "number of walkers of the ensemble MCMC, evaluated in parallel with nThreads")
+	("nBurnIn", po::value<unsigned int>(&nBurnIn)->default_value(100), "burn-in steps of the ensemble MCMC, not recorded in the chain")
+	("hessianCovariance", "after the minimization (migrad, migradNumerical, profile, surrogate), parameter covariance from the hessian of the NLL in covariance-<runRange>-<commonCut>.txt")
 	("nEventsMinDiag", po::value<unsigned int>(&nEventsMinDiag)->default_value(1000), "min num events in diagonal categories")
 	("nEventsMinOffDiag", po::value<unsigned int>(&nEventsMinOffDiag)->default_value(2000), "min num events in off-diagonal categories")
 	("onlyScale",    "fix the smearing to constant")
@@ -407,6 +481,9 @@ int main(int argc, char **argv)
 	("alphaGoldFix", "alphaTerm for gold electrons fixed to the low eta region")
 	("smearingEt", "alpha term depend on sqrt(Et) and not on sqrt(E)")
 	("nSmearToy", po::value<unsigned int>(&nSmearToy)->default_value(0), "")
+	("nThreads", po::value<unsigned int>(&nThreads)->default_value(1), "number of threads for the NLL evaluation of the categories and for the new friend trees (one file per file of the chain)")
+	("eventCacheDir", po::value<string>(&eventCacheDir), "directory where the imported events are saved and reused by the next jobs with the same inputs (name, size and modification time of the files; not used with --memFriends)")
+	("likelihood", po::value<string>(&likelihoodType)->default_value("binomial"), "likelihood of the data given the smeared MC: binomial, poisson, multinomial")
 	("pdfSystWeightIndex", po::value<int>(&pdfSystWeightIndex)->default_value(-1), "Index of the weight to be used")
 	;
 
@@ -600,9 +677,15 @@ int main(int argc, char **argv)
 	  ) return 1;
 
 	//============================== Reading the config file with the list of chains
+	tag_tree_map_t tagTreeMap; // new friend trees in memory, deleted after the chains
 	tag_chain_map_t tagChainMap;
 	TString tag, chainName, fileName;
 
+	// the trees are persisted only when requested
+	bool memFriends = vm.count("memFriends") && !vm.count("saveAddBranchTree") && !vm.count("savePUTreeWeight")
+	                  && !vm.count("saveR9TreeWeight") && !vm.count("saveRootMacro");
+	if(memFriends) std::cout << "[INFO] The new friend trees are kept in memory" << std::endl;
+
 	TString chainFileListTag = chainFileListName;
 	chainFileListTag.Remove(0, chainFileListTag.Last('/') + 1);
 	chainFileListTag.ReplaceAll(".dat", "");
@@ -734,26 +817,23 @@ int main(int argc, char **argv)
 			if(tag_chain_itr->second.count(treeName) != 0) continue; //skip if already present
 			TChain * ch = tag_chain_itr->second.find("selected")->second.get();
 
-			TString filename = "tmp/r9Weight_" + tag_chain_itr->first + "-" + chainFileListTag + ".root";
+			TString filename = "tmp/r9Weight_" + tag_chain_itr->first + "-" + chainFileListTag;
 			std::cout << "[STATUS] Saving r9Weights tree to root file:" << filename << std::endl;
 
-			TFile f(filename, "recreate");
-			if(!f.IsOpen() || f.IsZombie()) {
-				std::cerr << "[ERROR] File for r9Weights: " << filename << " not opened" << std::endl;
+			// one file per file of the chain with more than one thread
+			FriendFileProducer producer(ch, nThreads);
+			producer.Add(treeName, filename, [&](TString treename) {
+				return r9Weights.NewFiller(treename);
+			});
+			TTree *corrTree = producer.Run(memFriends)[0];
+			if(corrTree == NULL) {
+				std::cerr << "[ERROR] r9Weights tree for " << tag_chain_itr->first << " not produced" << std::endl;
 				exit(1);
 			}
-			TTree *corrTree = r9Weights.GetTreeWeight(ch);
-			f.cd();
-			corrTree->Write();
 			std::cout << "[INFO] Data      entries: " << ch->GetEntries() << std::endl;
 			std::cout << "       r9Weights entries: " << corrTree->GetEntries() << std::endl;
-			delete corrTree;
 
-			f.Write();
-			f.Close();
-			chain_map_t::iterator chain_itr = (tag_chain_itr->second.insert(make_pair(treeName, pTChain_t(new TChain(treeName))))).first;
-			chain_itr->second->SetTitle(tag_chain_itr->first);
-			chain_itr->second->Add(filename);
+			InsertFriend(tagChainMap, tagTreeMap, tag_chain_itr->first, treeName, corrTree);
 
 		} // end of data samples loop
 	} // end of r9Weight
@@ -765,7 +845,7 @@ int main(int argc, char **argv)
 	if(vm.count("ZPtWeightFile")) {
 		std::cout << "------------------------------------------------------------" << std::endl;
 		std::cout << "[STATUS] Getting ZPtWeights from file: " << ZPtWeightFile << std::endl;
-		UpdateFriends(tagChainMap, regionsFileNameTag);
+		UpdateFriends(tagChainMap, tagTreeMap, regionsFileNameTag);
 		ZPtWeights_class ZPtWeights;
 		ZPtWeights.ReadFromFile(ZPtWeightFile);
 
@@ -780,26 +860,22 @@ int main(int argc, char **argv)
 			if(tag_chain_itr->second.count(treeName) != 0) continue; //skip if already present
 			TChain * ch = (tag_chain_itr->second.find("selected"))->second.get();
 
-			TString filename = "tmp/ZPtWeight_" + tag_chain_itr->first + "-" + chainFileListTag + ".root";
+			TString filename = "tmp/ZPtWeight_" + tag_chain_itr->first + "-" + chainFileListTag;
 			std::cout << "[STATUS] Saving r9Weights tree to root file:" << filename << std::endl;
 
-			TFile f(filename, "recreate");
-			if(!f.IsOpen() || f.IsZombie()) {
-				std::cerr << "[ERROR] File for ZPtWeights: " << filename << " not opened" << std::endl;
+			FriendFileProducer producer(ch, nThreads);
+			producer.Add(treeName, filename, [&](TString treename) {
+				return ZPtWeights.NewFiller(treename, "ZPt_" + energyBranchName);
+			});
+			TTree *corrTree = producer.Run(memFriends)[0];
+			if(corrTree == NULL) {
+				std::cerr << "[ERROR] ZPtWeights tree for " << tag_chain_itr->first << " not produced" << std::endl;
 				exit(1);
 			}
-			TTree *corrTree = ZPtWeights.GetTreeWeight(ch, "ZPt_" + energyBranchName);
-			f.cd();
-			corrTree->Write();
 			std::cout << "[INFO] Data      entries: " << ch->GetEntries() << std::endl;
 			std::cout << "       ZPtWeights entries: " << corrTree->GetEntries() << std::endl;
-			delete corrTree;
 
-			f.Write();
-			f.Close();
-			chain_map_t::iterator chain_itr = (tag_chain_itr->second.insert(make_pair(treeName, pTChain_t(new TChain(treeName))))).first;
-			chain_itr->second->SetTitle(tag_chain_itr->first);
-			chain_itr->second->Add(filename);
+			InsertFriend(tagChainMap, tagTreeMap, tag_chain_itr->first, treeName, corrTree);
 
 		} // end of data samples loop
 	} // end of r9Weight
@@ -839,21 +915,18 @@ int main(int argc, char **argv)
 				TChain * ch = (tag_chain_itr->second.find("selected"))->second.get();
 				if((tag_chain_itr->second.count("pileup"))) continue;
 				TString treeName = "pileup";
-				TString filename = "tmp/mcPUtree" + tag_chain_itr->first + ".root";
-				TFile f(filename, "recreate");
-				if(f.IsOpen()) {
-					f.cd();
-
-					TTree *puTree = puWeights.GetTreeWeight(ch, true, puBranchName.c_str());
-					puTree->SetName(treeName);
-					puTree->Write();
-					delete puTree;
-					f.Write();
-					f.Close();
-					chain_map_t::iterator chain_itr = (tag_chain_itr->second.insert(make_pair(treeName, pTChain_t(new TChain(treeName))))).first;
-					chain_itr->second->SetTitle(tag_chain_itr->first);
-					chain_itr->second->Add(filename);
+				TString filename = "tmp/mcPUtree" + tag_chain_itr->first;
+
+				FriendFileProducer producer(ch, nThreads);
+				producer.Add(treeName, filename, [&](TString treename) {
+					return puWeights.NewFiller(treename, puBranchName.c_str());
+				});
+				TTree *puTree = producer.Run(memFriends)[0];
+				if(puTree == NULL) {
+					std::cerr << "[ERROR] Pileup tree for " << tag_chain_itr->first << " not produced" << std::endl;
+					return 1;
 				}
+				InsertFriend(tagChainMap, tagTreeMap, tag_chain_itr->first, treeName, puTree);
 			}
 		}
 	}
@@ -956,10 +1029,11 @@ int main(int argc, char **argv)
 	newBrancher._commonCut = commonCut.c_str();
 	newBrancher._regionList = categories;
 
+	// new trees of each sample: (treeName, branchName)
+	std::map<TString, std::vector<std::pair<TString, TString> > > pendingBranches;
 	for( std::vector<string>::const_iterator branch_itr = branchList.begin();
 	        branch_itr != branchList.end();
 	        branch_itr++) {
-		UpdateFriends(tagChainMap, regionsFileNameTag);
 
 		TString treeName = *branch_itr;
 		TString t;
@@ -985,47 +1059,62 @@ int main(int argc, char **argv)
 			if((tag_chain_itr->first.CompareTo("s") == 0 || tag_chain_itr->first.CompareTo("d") == 0)) continue; //only data
 			if(tag_chain_itr->second.count(treeName) != 0) continue; //skip if already present
 			if(t != "" && !tag_chain_itr->first.Contains(t)) continue;
-			TChain * ch = (tag_chain_itr->second.find("selected"))->second.get();
+			std::vector<std::pair<TString, TString> >& pending = pendingBranches[tag_chain_itr->first];
+			if(std::find(pending.begin(), pending.end(), std::make_pair(treeName, branchName)) != pending.end()) continue;
+			pending.push_back(std::make_pair(treeName, branchName));
+		}
+	} //end of branches loop
 
-			//data
-			std::cout << "[STATUS] Adding branch " << branchName << " to " << tag_chain_itr->first << std::endl;
-			TString filename = "tmp/" + treeName + "_" + tag_chain_itr->first + "-" + chainFileListTag + ".root";
+	// all the new trees of a sample are filled in a single read pass of its chain (one job per file with more than one thread):
+	// a tree using the branches of another new tree (smearerCat of R9Eleprime) is filled in the next pass
+	for(tag_chain_map_t::iterator tag_chain_itr = tagChainMap.begin();
+	        tag_chain_itr != tagChainMap.end();
+	        tag_chain_itr++) {
+		std::vector<std::pair<TString, TString> > pending = pendingBranches[tag_chain_itr->first];
+		bool isMC = tag_chain_itr->first.Contains("s");
+		while(!pending.empty()) {
+			UpdateFriends(tagChainMap, tagTreeMap, regionsFileNameTag);
+			TChain * ch = (tag_chain_itr->second.find("selected"))->second.get();
 
-			TFile f(filename, "recreate");
-			if (!f.IsOpen()) {
-				std::cerr << "[ERROR] File for branch " << branchName << " not created" << std::endl;
-				return 1;
+			FriendFileProducer producer(ch, nThreads);
+			for(std::vector<std::pair<TString, TString> >::const_iterator pending_itr = pending.begin();
+			        pending_itr != pending.end();
+			        pending_itr++) {
+				TString treeName = pending_itr->first, branchName = pending_itr->second;
+				std::cout << "[STATUS] Adding branch " << branchName << " to " << tag_chain_itr->first << std::endl;
+				TString filename = "tmp/" + treeName + "_" + tag_chain_itr->first + "-" + chainFileListTag;
+				producer.Add(treeName, filename, [&newBrancher, &energyBranchName, branchName, isMC](TString treename) {
+					return newBrancher.NewFiller(treename, branchName, isMC, energyBranchName);
+				}, tag_chain_itr->first);
 			}
-			f.cd();
+			std::vector<TTree *> newTrees = producer.Run(memFriends);
 
-			TTree *newTree = newBrancher.AddBranch(ch, treeName, branchName, true, tag_chain_itr->first.Contains("s"), energyBranchName);
-			if(newTree == NULL) {
-				std::cerr << "[ERROR] New tree for branch " << treeName << " is NULL" << std::endl;
+			std::vector<std::pair<TString, TString> > deferred;
+			for(unsigned int i = 0; i < newTrees.size(); i++) {
+				if(newTrees[i] == NULL) {
+					deferred.push_back(pending[i]);
+					continue;
+				}
+				InsertFriend(tagChainMap, tagTreeMap, tag_chain_itr->first, pending[i].first, newTrees[i]);
+			}
+			if(deferred.size() == pending.size()) {
+				std::cerr << "[ERROR] New tree for branch " << deferred.front().first << " is NULL: input branches not found" << std::endl;
 				return 1;
 			}
-			f.cd();
-			newTree->SetTitle(tag_chain_itr->first);
-			newTree->Write();
-			delete newTree;
-			//f.Write();
-			f.Close();
-			std::pair<TString, pTChain_t > pair_tmp(treeName, pTChain_t(new TChain(treeName)));
-			chain_map_t::iterator chain_itr = (tag_chain_itr->second.insert(pair_tmp)).first;
-			chain_itr->second->SetTitle(tag_chain_itr->first);
-			chain_itr->second->Add(filename);
-		} //end of sample loop
-	} //end of branches loop
+			pending = deferred;
+		}
+	} //end of sample loop
 
 	//(tagChainMap["s"])["selected"]->GetEntries();
-	UpdateFriends(tagChainMap, regionsFileNameTag);
+	UpdateFriends(tagChainMap, tagTreeMap, regionsFileNameTag);
 
 	//create tag "s" if not present (due to multiple mc samples)
 	if(!tagChainMap.count("s")) {
 		//#ifdef DEBUG
 		std::cout << "==============================" << std::endl;
 		std::cout << "==============================" << std::endl;
-		MergeSamples(tagChainMap, regionsFileNameTag, "s");
-		MergeSamples(tagChainMap, regionsFileNameTag, "d");
+		MergeSamples(tagChainMap, tagTreeMap, regionsFileNameTag, "s");
+		MergeSamples(tagChainMap, tagTreeMap, regionsFileNameTag, "d");
 	}
 
 	ElectronCategory_class cutter;
@@ -1481,9 +1570,13 @@ int main(int argc, char **argv)
 		smearer.SetWeakWeight(vm.count("useWEAKweight"));
 
 		if(nSmearToy > 0) smearer._nSmearToy = nSmearToy;
+		smearer.SetNThreads(nThreads);
+		if(vm.count("eventCacheDir")) smearer.SetEventCacheDir(eventCacheDir.c_str());
+		smearer.SetLikelihoodType(likelihoodType.c_str());
 
 
 		smearer.SetHistBinning(80, 100, invMass_binWidth); // to do before Init
+		if(!mcFractions.empty()) smearer.EnableMCFractions(); // to do before Init
 		if(vm.count("runToy")) {
 			smearer.SetPuWeight(false);
 
@@ -1500,6 +1593,9 @@ int main(int argc, char **argv)
 			args.writeToStream(std::cout, kFALSE);
 			smearer.Init(commonCut.c_str(), eleID);
 		}
+		// checkpoints of the profile minimization, loaded before the first evaluation to continue the MarkovChain
+		ProfileCheckpoint checkpoint(outDirFitResData + "/checkpoint-" + r + "-" + TString(commonCut.c_str()) + ".root", checkpointInterval);
+		if(vm.count("resume") && (minimType == "profile" || minimType == "MCMC" || minimType == "surrogate")) checkpoint.Load(args, smearer);
 		myClock.Start();
 		smearer.evaluate();
 		myClock.Stop();
@@ -1522,17 +1618,39 @@ int main(int argc, char **argv)
 			//ph.SetCacheSize(100);
 			//ProposalFunction* pf = ph.GetProposalFunction();
 
+			// warm start: the parameters found with the reduced MC samples are the starting point of the next stage
+			if(!mcFractions.empty() && !vm.count("resume")
+			        && (minimType == "profile" || minimType == "surrogate" || minimType == "migrad")) {
+				std::sort(mcFractions.begin(), mcFractions.end());
+				for(std::vector<double>::const_iterator fraction_itr = mcFractions.begin();
+				        fraction_itr != mcFractions.end() && *fraction_itr < 1;
+				        fraction_itr++) {
+					std::cout << "[STATUS] Warm start stage with MC fraction " << *fraction_itr << std::endl;
+					smearer.SetMCFraction(*fraction_itr);
+					if(minimType == "migrad") MinimizationMigrad(smearer, args);
+					else MinimizationProfile(smearer, args, nIter, false, NULL, minimType == "surrogate");
+					args.writeToStream(std::cout, kFALSE);
+				}
+				smearer.SetMCFraction(1);
+			}
+
 			if(minimType == "migrad") {
+				MinimizationMigrad(smearer, args);
+				args.writeToStream(std::cout, kFALSE);
+			} else if(minimType == "migradNumerical") {
 
 				//fitres =
 				m.fit("");
 				//m.migrad();
 				//m.hesse();
 			} else if(minimType == "profile") {
-				MinimizationProfile(smearer, args, nIter);
+				MinimizationProfile(smearer, args, nIter, false, &checkpoint);
+				args.writeToStream(std::cout, kFALSE);
+			} else if(minimType == "surrogate") {
+				MinimizationProfile(smearer, args, nIter, false, &checkpoint, true);
 				args.writeToStream(std::cout, kFALSE);
 			} else if(minimType == "MCMC") {
-				MinimizationProfile(smearer, args, nIter, true);
+				MinimizationProfile(smearer, args, nIter, true, &checkpoint);
 				args.writeToStream(std::cout, kFALSE);
 			} else if(minimType == "sampling") {
 				RooArgList 	 argList_(args);
@@ -1558,6 +1676,11 @@ int main(int argc, char **argv)
 				mcChain->SaveAs("tmp/newChain.root");
 				delete mcChain;
 
+			} else if(minimType == "ensemble") {
+				NLLRecorder chain;
+				SampleEnsembleMCMC(smearer, args, nIter, nWalkers, nBurnIn, chain);
+				chain.SaveAs(outDirFitResData + "/mcmc-" + r + "-" + TString(commonCut.c_str()) + ".root");
+				args.writeToStream(std::cout, kFALSE);
 			}
 		}
 
@@ -1567,6 +1690,11 @@ int main(int argc, char **argv)
 		if(!vm.count("profileOnly") && !vm.count("plotOnly")) {
 			args.writeToFile(outDirFitResData + "/params-" + r + "-" + TString(commonCut.c_str()) + ".txt");
 			smearer._markov.SaveAs((outDirFitResData + "/markov-" + r + "-" + TString(commonCut.c_str()) + ".root"));
+			// O(nPars^2) smearings: only on request and after a minimization, not after the samplings
+			if(vm.count("hessianCovariance") && (minimType == "migrad" || minimType == "migradNumerical"
+			                                     || minimType == "profile" || minimType == "surrogate")) {
+				HessianCovariance(smearer, args, outDirFitResData + "/covariance-" + r + "-" + TString(commonCut.c_str()) + ".txt");
+			}
 		}
 
 		//RooDataSet *dSet = smearer.GetMarkovChainAsDataSet();
@@ -1633,55 +1761,70 @@ int main(int argc, char **argv)
 					double rho = 0, Emean = 0;
 					smearer.SetDataSet(name, TString(var->GetName()) + TString(var2->GetName()));
 					if(vm.count("constTermFix")) MinProfile2D(var, var2, smearer, -1, 0., min, rho, Emean, false);
-					smearer.dataset->Write();
-
-					// rho profile
-					name2.ReplaceAll("constTerm", "rho");
-					smearer.SetDataSet(name2, "rho");
-					Double_t v1 = var->getVal();
-					Double_t v2 = var2->getVal();
-					var2->setVal(0);
-					var->setVal(rho);
-					TGraph *profil = NULL;
-					profil = GetProfile(var, smearer, 0);
-					var2->setVal(v2);
-					var->setVal(v1);
-					TString n = "profileChi2_" + name2 + "_";
-					n += randomInt;
-					profil->SetName(n);
-					TCanvas c("c_" + name);
-					profil->Draw("AP*");
-					fOutProfile.cd();
-					profil->Write();
-					delete profil;
-					smearer.dataset->Write();
-
-
-					// phi profile
-					name2.ReplaceAll("rho", "phi");
-					smearer.SetDataSet(name2, "phi");
-					profil = GetProfile(var, var2, smearer, true, rho, Emean);
-					n = "profileChi2_" + name2 + "_";
-					n += randomInt;
-					profil->SetName(n);
-					profil->Draw("AP*");
-					fOutProfile.cd();
-					profil->Write();
-					delete profil;
-					smearer.dataset->Write();
-
-					// rho profile with fixed phi!=pi/2
-					name2.ReplaceAll("phi", "rho_phi4");
-					smearer.SetDataSet(name2, "rho_phi4");
-					profil = GetProfile(var, var2, smearer, true, 0, Emean, 0.785);
-					n = "profileChi2_" + name2 + "_";
-					n += randomInt;
-					profil->SetName(n);
-					profil->Draw("AP*");
-					fOutProfile.cd();
-					profil->Write();
-					delete profil;
-					smearer.dataset->Write();
+					smearer.dataset->WriteDataSet();
+
+					if(vm.count("profile2D")) {
+						// (rho, phi) map in one parallel pass, instead of the rho, phi and rho_phi4 profiles
+						name2.ReplaceAll("constTerm", "rhoPhi");
+						smearer.SetDataSet(name2, "rhoPhi");
+						if(Emean == 0) Emean = sqrt(smearer.GetMeanEnergy(*var));
+						TH2F *profil2D = GetProfile2D(var, var2, smearer, Emean);
+						TString n = "profileChi2_" + name2 + "_";
+						n += randomInt;
+						profil2D->SetName(n);
+						fOutProfile.cd();
+						profil2D->Write();
+						delete profil2D;
+						smearer.dataset->WriteDataSet();
+					} else {
+						// rho profile
+						name2.ReplaceAll("constTerm", "rho");
+						smearer.SetDataSet(name2, "rho");
+						Double_t v1 = var->getVal();
+						Double_t v2 = var2->getVal();
+						var2->setVal(0);
+						var->setVal(rho);
+						TGraph *profil = NULL;
+						profil = GetProfile(var, smearer, 0);
+						var2->setVal(v2);
+						var->setVal(v1);
+						TString n = "profileChi2_" + name2 + "_";
+						n += randomInt;
+						profil->SetName(n);
+						TCanvas c("c_" + name);
+						profil->Draw("AP*");
+						fOutProfile.cd();
+						profil->Write();
+						delete profil;
+						smearer.dataset->WriteDataSet();
+
+
+						// phi profile
+						name2.ReplaceAll("rho", "phi");
+						smearer.SetDataSet(name2, "phi");
+						profil = GetProfile(var, var2, smearer, true, rho, Emean);
+						n = "profileChi2_" + name2 + "_";
+						n += randomInt;
+						profil->SetName(n);
+						profil->Draw("AP*");
+						fOutProfile.cd();
+						profil->Write();
+						delete profil;
+						smearer.dataset->WriteDataSet();
+
+						// rho profile with fixed phi!=pi/2
+						name2.ReplaceAll("phi", "rho_phi4");
+						smearer.SetDataSet(name2, "rho_phi4");
+						profil = GetProfile(var, var2, smearer, true, 0, Emean, 0.785);
+						n = "profileChi2_" + name2 + "_";
+						n += randomInt;
+						profil->SetName(n);
+						profil->Draw("AP*");
+						fOutProfile.cd();
+						profil->Write();
+						delete profil;
+						smearer.dataset->WriteDataSet();
+					}
 
 // 		// rho profile with fixed phi!=pi/2
 // 		name2.ReplaceAll("rho_phi4", "rho_phi6");
@@ -1693,7 +1836,7 @@ int main(int argc, char **argv)
 // 		fOutProfile.cd();
 // 		profil->Write();
 // 		delete profil;
-// 		smearer.dataset->Write();
+// 		smearer.dataset->WriteDataSet();
 
 // 		// rho profile with fixed phi!=pi/2
 // 		name2.ReplaceAll("rho_phi6", "rho_phi3");
@@ -1705,7 +1848,7 @@ int main(int argc, char **argv)
 // 		fOutProfile.cd();
 // 		profil->Write();
 // 		delete profil;
-// 		smearer.dataset->Write();
+// 		smearer.dataset->WriteDataSet();
 
 
 				}
@@ -1725,7 +1868,7 @@ int main(int argc, char **argv)
 				fOutProfile.cd();
 				profil->Write();
 				std::cout << "Saved profile for " << name << std::endl;
-				smearer.dataset->Write();
+				smearer.dataset->WriteDataSet();
 				delete profil;
 			}
 			std::cout << "Cloning args" << std::endl;
@@ -0,0 +1,234 @@
+/**\file
+\brief 	Benchmark of the RooSmearer with synthetic Z->ee events
+
+The events are generated in memory, no ntuple is needed: the true
+invariant mass follows a Breit-Wigner, the response of each electron
+a Crystal Ball (low tail) with a scale and an additional gaussian
+resolution depending on the region of the electron (data only).
+
+Timings of the initialization, of the NLL evaluation and of the
+profile minimization are written in a JSON file, to follow the
+performances of the smearer between versions.
+
+Example:
+  ./bin/benchmarkSmearer.exe --nRegions 6 --nEvents 200000 --nThreads 4 --output benchmark.json
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <boost/program_options.hpp>
+
+#include <TStopwatch.h>
+#include <TRandom3.h>
+#include <TString.h>
+#include <RooRealVar.h>
+#include <RooArgSet.h>
+
+#include "../interface/RooSmearer.hh"
+#include "../interface/CounterRNG.hh"
+#include "../interface/nllProfile.hh"
+
+#define MZ 91.188
+#define GAMMAZ 2.4952
+
+namespace po = boost::program_options;
+
+/// standard Crystal Ball (low tail) in units of sigma
+double CrystalBall(TRandom3& gen, double alpha, double n)
+{
+	double tailArea = n / (alpha * (n - 1)) * exp(-0.5 * alpha * alpha);
+	double coreArea = sqrt(M_PI / 2) * (1 + TMath::Erf(alpha / sqrt(2.)));
+	if(gen.Uniform() * (tailArea + coreArea) < coreArea) {
+		double t;
+		do {
+			t = gen.Gaus(0, 1);
+		} while(t < -alpha);
+		return t;
+	}
+	// inverse of the cumulative of the power law tail
+	return n / alpha - alpha - n / alpha * pow(gen.Uniform(), 1. / (1 - n));
+}
+
+/// response and true energy of an electron
+void GenerateElectron(TRandom3& gen, double scale, double constTerm, double& energy, double& response)
+{
+	const double sigmaCB = 0.01, alphaCB = 1., nCB = 3.;
+	energy = 45 * (1 + 0.5 * gen.Uniform());
+	response = scale * (1 + sigmaCB * CrystalBall(gen, alphaCB, nCB));
+	if(constTerm > 0) response *= gen.Gaus(1, constTerm);
+	return;
+}
+
+/// one cache per pair of regions, in the order of RooSmearer::InitCategories
+std::vector<zee_events_t> GenerateEvents(TRandom3& gen, unsigned int nRegions, Long64_t nEvents,
+        const std::vector<double>& scales, const std::vector<double>& constTerms, Long64_t& eventNumber)
+{
+	std::vector<zee_events_t> cache;
+	for(unsigned int iRegion1 = 0; iRegion1 < nRegions; iRegion1++) {
+		for(unsigned int iRegion2 = iRegion1; iRegion2 < nRegions; iRegion2++) {
+			zee_events_t eventCache;
+			eventCache.reserve(nEvents);
+			for(Long64_t iEvent = 0; iEvent < nEvents; iEvent++) {
+				double mass;
+				do {
+					mass = gen.BreitWigner(MZ, GAMMAZ);
+				} while(mass < 60 || mass > 120);
+				double energy1, response1, energy2, response2;
+				GenerateElectron(gen, scales[iRegion1], constTerms[iRegion1], energy1, response1);
+				GenerateElectron(gen, scales[iRegion2], constTerms[iRegion2], energy2, response2);
+
+				ZeeEvent event;
+				event.energy_ele1 = energy1 * response1;
+				event.energy_ele2 = energy2 * response2;
+				event.invMass = mass * sqrt(response1 * response2);
+				event.weight = 1;
+				event.eventKey = CounterRNG::EventKey(1, eventNumber++);
+				eventCache.push_back(event);
+			}
+			cache.push_back(eventCache);
+		}
+	}
+	return cache;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int nRegions, nSmearToy, nThreads, nEvaluations, nIterProfile;
+	Long64_t nEvents;
+	double dataFraction;
+	std::string outputFile;
+
+	po::options_description desc("Benchmark options");
+	desc.add_options()
+	("help,h", "Help message")
+	("nRegions", po::value<unsigned int>(&nRegions)->default_value(4), "number of regions: nRegions*(nRegions+1)/2 categories")
+	("nEvents", po::value<Long64_t>(&nEvents)->default_value(100000), "MC events per category")
+	("dataFraction", po::value<double>(&dataFraction)->default_value(0.2), "data events per category / MC events per category")
+	("nSmearToy", po::value<unsigned int>(&nSmearToy)->default_value(20), "")
+	("nThreads", po::value<unsigned int>(&nThreads)->default_value(1), "")
+	("nEvaluations", po::value<unsigned int>(&nEvaluations)->default_value(10), "number of timed NLL evaluations with all the scales changed")
+	("nIterProfile", po::value<unsigned int>(&nIterProfile)->default_value(1), "run MinimizationProfile if > 0")
+	("output", po::value<std::string>(&outputFile)->default_value("benchmarkSmearer.json"), "JSON file with the results")
+	;
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+	if (vm.count("help")) {
+		std::cout << desc << std::endl;
+		return 0;
+	}
+
+	//------------------------------ parameters, as in ZFitter
+	std::vector<TString> regions;
+	RooArgSet args;
+	std::vector<RooArgSet> args_vec;
+	std::vector<double> dataScales, dataConstTerms, mcScales(nRegions, 1.), mcConstTerms(nRegions, 0.);
+	for(unsigned int iRegion = 0; iRegion < nRegions; iRegion++) {
+		TString region = TString::Format("region%u", iRegion);
+		regions.push_back(region);
+		dataScales.push_back(1 + 0.005 * ((int)(iRegion % 3) - 1));
+		dataConstTerms.push_back(0.005 + 0.01 * iRegion / nRegions);
+
+		RooRealVar *scale_ = new RooRealVar("scale_" + region, "scale_" + region, 1.0, 0.95, 1.05, "GeV");
+		scale_->setError(0.005);
+		RooRealVar *const_term_ = new RooRealVar("constTerm_" + region, "constTerm_" + region, 0.01, 0.000, 0.05);
+		const_term_->setError(0.03);
+		RooRealVar *alpha_ = new RooRealVar("alpha_" + region, "alpha_" + region, 0.0, 0., 0.20);
+		alpha_->setError(0.01);
+		alpha_->setConstant(true);
+		args.add(*scale_);
+		args.add(*const_term_);
+		args.add(*alpha_);
+		args_vec.push_back(RooArgSet(*scale_, *alpha_, *const_term_));
+	}
+
+	//------------------------------ events
+	TStopwatch clock;
+	clock.Start();
+	TRandom3 gen(12345);
+	Long64_t eventNumber = 0;
+	std::vector<zee_events_t> mc = GenerateEvents(gen, nRegions, nEvents, mcScales, mcConstTerms, eventNumber);
+	std::vector<zee_events_t> data = GenerateEvents(gen, nRegions, (Long64_t)(nEvents * dataFraction), dataScales, dataConstTerms, eventNumber);
+	clock.Stop();
+	double generationTime = clock.RealTime();
+	Long64_t nEventsMC = 0, nEventsData = 0;
+	for(size_t i = 0; i < mc.size(); i++) nEventsMC += mc[i].size();
+	for(size_t i = 0; i < data.size(); i++) nEventsData += data[i].size();
+	std::cout << "[INFO] Generated " << nEventsMC << " MC and " << nEventsData << " data events in " << mc.size() << " categories" << std::endl;
+
+	//------------------------------ init
+	RooSmearer smearer("smearer", NULL, NULL, NULL, regions, args_vec, args, "energyEle");
+	smearer._nSmearToy = nSmearToy;
+	smearer._deactive_minEventsDiag = 0;
+	smearer._deactive_minEventsOffDiag = 0;
+	smearer.SetNThreads(nThreads);
+	smearer.SetHistBinning(80, 100, 0.25);
+	smearer.SetEventCaches(data, mc);
+	data.clear();
+	mc.clear();
+
+	clock.Start();
+	smearer.Init("", "loose"); // cuts not used: the events are already in the caches
+	clock.Stop();
+	double initTime = clock.RealTime();
+
+	//------------------------------ evaluations: the scales are changed each time, no category is cached
+	RooArgList argList(args);
+	clock.Start();
+	for(unsigned int iEval = 0; iEval < nEvaluations; iEval++) {
+		for(int i = 0; i < argList.getSize(); i++) {
+			RooRealVar *var = (RooRealVar *) argList.at(i);
+			if(TString(var->GetName()).BeginsWith("scale_")) var->setVal(1 + 0.0001 * (iEval + 1));
+		}
+		smearer.evaluate();
+	}
+	clock.Stop();
+	double evaluateTime = clock.RealTime() / std::max(nEvaluations, 1U);
+
+	//------------------------------ profile minimization
+	double profileTime = 0;
+	int nProfileEvaluations = 0;
+	if(nIterProfile > 0) {
+		for(int i = 0; i < argList.getSize(); i++) {
+			RooRealVar *var = (RooRealVar *) argList.at(i);
+			if(TString(var->GetName()).BeginsWith("scale_")) var->setVal(1);
+		}
+		int nEvaluationsBefore = smearer._markov.Size();
+		clock.Start();
+		MinimizationProfile(smearer, args, nIterProfile);
+		clock.Stop();
+		profileTime = clock.RealTime();
+		nProfileEvaluations = smearer._markov.Size() - nEvaluationsBefore;
+	}
+
+	//------------------------------ results
+	std::stringstream json;
+	json << "{\n"
+	     << "  \"benchmark\": \"RooSmearer\",\n"
+	     << "  \"nRegions\": " << nRegions << ",\n"
+	     << "  \"nCategories\": " << nRegions * (nRegions + 1) / 2 << ",\n"
+	     << "  \"nEventsMC\": " << nEventsMC << ",\n"
+	     << "  \"nEventsData\": " << nEventsData << ",\n"
+	     << "  \"nSmearToy\": " << nSmearToy << ",\n"
+	     << "  \"nThreads\": " << nThreads << ",\n"
+	     << "  \"generationTime_s\": " << generationTime << ",\n"
+	     << "  \"initTime_s\": " << initTime << ",\n"
+	     << "  \"evaluateTime_s\": " << evaluateTime << ",\n"
+	     << "  \"evaluations_per_s\": " << ((evaluateTime > 0) ? 1. / evaluateTime : 0) << ",\n"
+	     << "  \"events_per_s\": " << ((evaluateTime > 0) ? nEventsMC / evaluateTime : 0) << ",\n"
+	     << "  \"profileTime_s\": " << profileTime << ",\n"
+	     << "  \"profileEvaluations\": " << nProfileEvaluations << ",\n"
+	     << "  \"profileEvaluations_per_s\": " << ((profileTime > 0) ? nProfileEvaluations / profileTime : 0) << "\n"
+	     << "}\n";
+	std::cout << json.str();
+	std::ofstream f(outputFile.c_str());
+	if(!f.good()) {
+		std::cerr << "[ERROR] Cannot write " << outputFile << std::endl;
+		return 1;
+	}
+	f << json.str();
+	f.close();
+	return 0;
+}
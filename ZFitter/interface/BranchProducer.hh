@@ -0,0 +1,164 @@
+#ifndef branchproducer_hh
+#define branchproducer_hh
+
+#include <stdlib.h>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <string>
+#include <typeinfo>
+#include <functional>
+#include <TString.h>
+#include <TTree.h>
+#include <TChain.h>
+
+#define ADDBRANCH_MAXLEN 16 ///< max number of values of an input branch (arrays of the electrons)
+
+class BranchProducer;
+
+/** \class BranchFiller
+ * \brief computation of the branches of one new tree, filled by the BranchProducer in its read pass of the chain
+ *
+ * The inputs are the buffers of BranchProducer::Input, shared with the
+ * other fillers of the pass: they must not be modified.
+ */
+class BranchFiller
+{
+public:
+	/// the new tree is created in the current directory
+	BranchFiller(TString treename);
+	virtual ~BranchFiller();
+
+	/// input branches (BranchProducer::Input) and branches of the new tree: false if an input is not in the chain
+	virtual bool Init(BranchProducer& producer) = 0;
+	/// called when the chain moves to a new tree
+	virtual void Notify(TChain *chain) {};
+	/// values of the new branches for the current entry
+	virtual void Compute(Long64_t ientry) = 0;
+
+	inline TTree *GetTree() {
+		return _tree;
+	};
+	/// the tree is then owned by the caller
+	inline TTree *ReleaseTree() {
+		TTree *tree = _tree;
+		_tree = NULL;
+		return tree;
+	};
+
+protected:
+	TTree *_tree;
+};
+
+/** \class BranchProducer
+ * \brief fills several new trees in a single read pass of the chain
+ *
+ * All the branches of the chain are disabled but the union of the inputs
+ * of the fillers, each input branch is read once in a buffer shared by the fillers.
+ */
+class BranchProducer
+{
+public:
+	BranchProducer(TChain *chain);
+	/// deletes the fillers, not the trees returned by Run, and enables again all the branches of the chain
+	~BranchProducer();
+
+	/// the filler is owned by the producer; false if its inputs are not all in the chain
+	bool Add(BranchFiller *filler);
+
+	/** buffer of the branch branchName, read at each entry: NULL if the branch is not in the chain.
+	 * The same branch must have the same type in all the fillers
+	 */
+	template<class T> T *Input(TString branchName);
+	/// branch read at each entry without address (used by TTreeFormula): false if not in the chain
+	bool Activate(TString branchName);
+
+	inline TChain *GetChain() {
+		return _chain;
+	};
+
+	/** single read pass of the entries [firstEntry, lastEntry) of the chain (lastEntry < 0: up to the end):
+	 * the new trees, in the order of Add, owned by the caller
+	 */
+	std::vector<TTree *> Run(Long64_t firstEntry = 0, Long64_t lastEntry = -1);
+
+private:
+	class input_t
+	{
+	public:
+		std::string type;
+		std::vector<double> buffer; ///< double for the alignment
+	};
+
+	TChain *_chain;
+	std::vector<BranchFiller *> _fillers;
+	std::map<TString, input_t> _inputs;
+};
+
+template<class T> T *BranchProducer::Input(TString branchName)
+{
+	if(_chain->GetBranch(branchName) == NULL) return NULL;
+
+	input_t& input = _inputs[branchName];
+	if(input.buffer.empty()) {
+		input.type = typeid(T).name();
+		input.buffer.resize((ADDBRANCH_MAXLEN * sizeof(T)) / sizeof(double) + 1, 0.);
+		_chain->SetBranchStatus(branchName, 1);
+		_chain->SetBranchAddress(branchName, (T *) &input.buffer[0]);
+	} else if(input.type != typeid(T).name()) {
+		std::cerr << "[ERROR] Branch " << branchName << " read with two different types" << std::endl;
+		exit(1);
+	}
+	return (T *) &input.buffer[0];
+}
+
+/** \class FriendFileProducer
+ * \brief new friend trees of a chain, produced in parallel one file of the chain per job
+ *
+ * Each job reads the entries of one file of the chain (with its friends)
+ * with the copy of the chain of its worker thread and its own fillers, and writes the new
+ * trees of these entries in its own file: the chain of the new files
+ * has the same entries in the same order as the original chain.
+ * With one thread, the chain is read once and each new tree is written in a single file.
+ *
+ * In memory, the new trees are not written in files: the trees of the
+ * jobs are merged in a single tree without directory, to be added as
+ * friend of the chain.
+ */
+class FriendFileProducer
+{
+public:
+	/// filler of the new tree treename, called once per job
+	typedef std::function<BranchFiller *(TString treename)> factory_t;
+
+	FriendFileProducer(TChain *chain, unsigned int nThreads = 1);
+
+	/// the tree treeName (with title if not empty) is written in fileName + ".root" (one thread) or fileName + "_<iFile>.root"
+	void Add(TString treeName, TString fileName, factory_t factory, TString title = "");
+
+	/** new trees, in the order of Add: the TChain of the new files, or the tree in memory (owned by the caller).
+	 * NULL if the inputs of the filler are not in the chain (it can be produced in a later pass)
+	 */
+	std::vector<TTree *> Run(bool inMemory = false);
+
+private:
+	class newTree_t
+	{
+	public:
+		TString treeName, fileName, title;
+		factory_t factory;
+	};
+
+	TChain *_chain;
+	unsigned int _nThreads;
+	std::vector<newTree_t> _newTrees;
+};
+
+/** copy of the chain and of its friends, to be read by a worker thread.
+ * The friend trees in memory are copied in full: one copy per worker, reused for all its jobs
+ */
+TChain *CloneChain(TTree *chain);
+/// deletes the chain and its friends
+void DeleteChain(TTree *chain);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef counterrng_hh
+#define counterrng_hh
+
+#include <cmath>
+#include <stdint.h>
+
+/** \file
+ * \brief stateless counter-based generator of the smearing gaussian deviates
+ *
+ * Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as
+ * 1, 2, 3", SC11): a bijection of a 128 bit counter under a 64 bit
+ * key. The counter is made of the event key, the electron and the
+ * toy index, so the same deviate is regenerated at every evaluation of
+ * the likelihood without being stored and independently of the order
+ * of the events, of the number of toys and of the threads.
+ *
+ * Each call of the generator gives two normal deviates (Box-Muller):
+ * toys 2j and 2j+1 of an electron come from the same counter.
+ */
+namespace CounterRNG
+{
+static const uint32_t SEED = 12345; ///< key of the generator, as the seeds used elsewhere in the fitter
+
+/// event key from the run and event numbers (different runs can have the same event numbers in MC)
+inline uint64_t EventKey(uint64_t runNumber, uint64_t eventNumber)
+{
+	// splitmix64 finalizer of the combination
+	uint64_t z = eventNumber + 0x9E3779B97F4A7C15ULL * (runNumber + 1);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/// Philox4x32 with 10 rounds: ctr is replaced by the random output
+inline void Philox4x32(uint32_t ctr[4], uint32_t key0, uint32_t key1)
+{
+	for(int round = 0; round < 10; round++) {
+		uint64_t product0 = (uint64_t) 0xD2511F53U * ctr[0];
+		uint64_t product1 = (uint64_t) 0xCD9E8D57U * ctr[2];
+		uint32_t hi0 = product0 >> 32, lo0 = (uint32_t) product0;
+		uint32_t hi1 = product1 >> 32, lo1 = (uint32_t) product1;
+		ctr[0] = hi1 ^ ctr[1] ^ key0;
+		ctr[1] = lo1;
+		ctr[2] = hi0 ^ ctr[3] ^ key1;
+		ctr[3] = lo0;
+		key0 += 0x9E3779B9U;
+		key1 += 0xBB67AE85U;
+	}
+}
+
+/// uniform in (0,1) from 32 random bits: never 0, so that log can be taken
+inline double Uniform(uint32_t x)
+{
+	return (x + 0.5) * (1. / 4294967296.);
+}
+
+/// N(0,1) deviates of the toys [0, nToy) of the electron (0 or 1) of the event
+inline void Normals(uint64_t eventKey, unsigned int electron, unsigned int nToy, double *normals)
+{
+	for(unsigned int iToy = 0; iToy < nToy; iToy += 2) {
+		uint32_t ctr[4] = {iToy / 2, electron, (uint32_t) eventKey, (uint32_t)(eventKey >> 32)};
+		Philox4x32(ctr, SEED, 0);
+		double r = sqrt(-2. * log(Uniform(ctr[0])));
+		double phi = 2. * M_PI * Uniform(ctr[1]);
+		normals[iToy] = r * cos(phi);
+		if(iToy + 1 < nToy) normals[iToy + 1] = r * sin(phi);
+	}
+}
+
+/// uniform in (0,1) of the event, independent of the smearings: selection of reduced statistics subsamples
+inline double EventFraction(uint64_t eventKey)
+{
+	uint32_t ctr[4] = {0, 2, (uint32_t) eventKey, (uint32_t)(eventKey >> 32)};
+	Philox4x32(ctr, SEED, 0);
+	return Uniform(ctr[0]);
+}
+}
+
+#endif
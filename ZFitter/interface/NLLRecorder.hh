@@ -0,0 +1,100 @@
+#ifndef nllrecorder_hh
+#define nllrecorder_hh
+
+#include <cstdio>
+#include <vector>
+#include <TString.h>
+#include <RooArgSet.h>
+#include <RooArgList.h>
+#include <RooDataSet.h>
+#include <RooStats/MarkovChain.h>
+
+/** \class NLLRecorder
+ * \brief append-only record of the points evaluated by the RooSmearer
+ *
+ * Replaces the RooStats::MarkovChain and the RooDataSet filled at each
+ * evaluation: a point is a plain row (values of the parameters, nll and
+ * weight, all in double precision) written in a preallocated columnar chunk,
+ * full chunks are spilled to a temporary file.  The RooFit objects are
+ * built only when the record is saved.
+ *
+ * The parameters are read from the RooArgSet given to SetParameters,
+ * that must stay alive as long as points are added.
+ */
+class NLLRecorder
+{
+public:
+	NLLRecorder(TString name = "", TString title = "", size_t chunkSize = 4096);
+	~NLLRecorder();
+
+	/// the columns of the record: one for each parameter
+	void SetParameters(const RooArgSet& params);
+
+	/// add a point with the current values of the parameters
+	void Add(double nll, double weight = 1);
+	/// add a point with the values in values (by name), slower
+	void Add(const RooArgSet& values, double nll, double weight = 1);
+	/// same as Add, the RooStats::MarkovChain interface
+	inline void AddFast(const RooArgSet& values, double nll, double weight) {
+		Add(values, nll, weight);
+	};
+
+	/// number of recorded points
+	inline size_t Size() const {
+		return _nSpilled + _nRows;
+	};
+	void Clear();
+
+	/** points among the last nLast ones where all the parameters but free have their current value:
+	 * values of free and nll, in the order of the record
+	 */
+	void GetSlice(const RooAbsArg& free, size_t nLast, std::vector<double>& x, std::vector<double>& nll) const;
+
+	inline TString GetName() const {
+		return _name;
+	};
+
+	/// new MarkovChain (named _markov_chain) with all the points, owned by the caller
+	RooStats::MarkovChain *GetMarkovChain() const;
+	/// new RooDataSet with the parameters and the nll, owned by the caller
+	RooDataSet *GetDataSet() const;
+	/// weighted dataset of the parameters, as RooStats::MarkovChain::GetAsDataSet
+	RooDataSet *GetAsDataSet() const;
+
+	/// MarkovChain written in the current directory, returns the number of bytes written (0 on failure)
+	Int_t Write(const char *name) const;
+	/// MarkovChain saved in the file fileName
+	void SaveAs(TString fileName) const;
+	/// RooDataSet written in the current directory with the name of the recorder
+	void WriteDataSet() const;
+
+private:
+	class chunk_t
+	{
+	public:
+		std::vector<double> values; ///< column-major: values[iParam * chunkSize + iRow]
+		std::vector<double> nll;
+		std::vector<double> weight;
+	};
+
+	NLLRecorder(const NLLRecorder&);
+	NLLRecorder& operator=(const NLLRecorder&);
+
+	void Spill();
+	/// the chunk iChunk, from the spill file or the current one
+	const chunk_t& ReadChunk(size_t iChunk, chunk_t& buffer) const;
+	/// call f(values, nll, weight) for each point, values in the order of the parameters
+	template<class F> void Loop(RooArgList& values, F f) const;
+
+	TString _name, _title;
+	size_t _chunkSize;
+	RooArgList _params;
+	std::vector<RooAbsReal *> _paramPtrs;
+
+	chunk_t _chunk;
+	size_t _nRows;    ///< points in _chunk
+	size_t _nSpilled; ///< points in the spill file
+	FILE *_spillFile;
+};
+
+#endif
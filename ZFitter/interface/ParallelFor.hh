@@ -0,0 +1,57 @@
+#ifndef parallelfor_hh
+#define parallelfor_hh
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+/** \file
+ * \brief minimal helper to run independent jobs on a set of worker threads
+ *
+ * Jobs are identified by their index in [0, nJobs) and are taken by
+ * the workers from a shared counter, so the scheduling is dynamic.
+ * Each job must write only in its own memory: the results should be
+ * collected (e.g. summed) by the caller after the function returns,
+ * in job index order, to be independent from the number of threads.
+ */
+
+/** run job(iJob, iWorker) for iJob in [0, nJobs) using up to nThreads threads:
+ * iWorker in [0, nThreads) is the index of the thread running the job,
+ * for buffers reused by all the jobs of a worker
+ */
+inline void ParallelForWorkers(unsigned int nThreads, size_t nJobs, const std::function<void(size_t, unsigned int)>& job)
+{
+	if(nThreads > nJobs) nThreads = nJobs;
+	if(nThreads <= 1) {
+		for(size_t iJob = 0; iJob < nJobs; iJob++) job(iJob, 0);
+		return;
+	}
+
+	std::atomic<size_t> nextJob(0);
+	auto worker = [&](unsigned int iWorker) {
+		for(size_t iJob = nextJob++; iJob < nJobs; iJob = nextJob++) job(iJob, iWorker);
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(nThreads - 1);
+	for(unsigned int iThread = 1; iThread < nThreads; iThread++) threads.push_back(std::thread(worker, iThread));
+	worker(0); // the calling thread works as well
+	for(std::vector<std::thread>::iterator thread_itr = threads.begin();
+	        thread_itr != threads.end();
+	        thread_itr++) {
+		thread_itr->join();
+	}
+	return;
+}
+
+/// run job(iJob) for iJob in [0, nJobs) using up to nThreads threads
+inline void ParallelFor(unsigned int nThreads, size_t nJobs, const std::function<void(size_t)>& job)
+{
+	ParallelForWorkers(nThreads, nJobs, [&](size_t iJob, unsigned int) {
+		job(iJob);
+	});
+	return;
+}
+
+#endif
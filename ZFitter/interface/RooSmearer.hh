@@ -2,6 +2,8 @@
 #define roosmearer_hh
 
 #include <iomanip>
+#include <array>
+#include <map>
 
 #include <TChain.h>
 #include <TH1F.h>
@@ -13,8 +15,8 @@
 
 #include <RooAbsReal.h>
 #include <RooSetProxy.h>
-#include <RooStats/MarkovChain.h>
 #include "SmearingImporter.hh"
+#include "NLLRecorder.hh"
 //#define DEBUG
 /*
 
@@ -30,6 +32,10 @@ public:
 		smearHist_data = NULL;
 		hist_mc = NULL;
 		smearHist_mc = NULL;
+		rgen = NULL;
+		scaleVar1 = alphaVar1 = constVar1 = NULL;
+		scaleVar2 = alphaVar2 = constVar2 = NULL;
+		nEventsMC = 0;
 	};
 
 	inline ~ZeeCategory() {
@@ -56,6 +62,7 @@ public:
 public:
 	zee_events_t *data_events;
 	zee_events_t *mc_events;
+	size_t nEventsMC; ///< MC events used for the smearing: the first ones of mc_events (see RooSmearer::SetMCFraction)
 
 	int categoryIndex1, categoryIndex2;
 	TString categoryName1;
@@ -63,6 +70,10 @@ public:
 	RooArgSet pars1;
 	RooArgSet pars2;
 
+	// parameters of the category, resolved once at initialization (NULL if not in pars)
+	RooAbsReal *scaleVar1, *alphaVar1, *constVar1;
+	RooAbsReal *scaleVar2, *alphaVar2, *constVar2;
+
 	// old values
 	double scale1, constant1, alpha1;
 	double scale2, constant2, alpha2;
@@ -77,11 +88,24 @@ public:
 	TH1F *hist_mc;
 	TH1F *smearHist_mc;
 
+	TRandom3 *rgen; ///< random generator of the category: one stream per category to be thread safe and reproducible
+
 	bool active;
 	unsigned int nSmearToy;
 	unsigned int nLLtoy;
 
 	double nll, nllRMS;
+
+	/// key of the NLL cache: scale1, alpha1, constant1, scale2, alpha2, constant2, nSmearToy, nLLtoy
+	typedef std::array<double, 8> nllCacheKey_t;
+	/// NLL and smeared MC histogram (contents and sum of weights squared) for one set of values
+	class nllCacheEntry_t
+	{
+	public:
+		double nll, nllRMS;
+		std::vector<float> smearHist_mc, smearHist_mc_sumw2;
+	};
+	std::map<nllCacheKey_t, nllCacheEntry_t> nllCache;
 };
 
 // parameters params are provided externally to leave flexibiility in
@@ -158,9 +182,55 @@ public:
 	inline void SetPdfSystWeight(int value) {
 		importer.SetPdfSystWeight(value);
 	};
+	inline void SetEventCacheDir(TString dir) {
+		importer.SetEventCacheDir(dir);
+	};
 
 	void SetNSmear(unsigned int n_smear = 0, unsigned int nlltoy = 0);
 
+	/// number of threads used to update the NLL of the categories (1 = serial)
+	void SetNThreads(unsigned int nThreads);
+
+	/// max number of parameter points with the NLL cached per category (0 = no cache)
+	inline void SetNLLCacheSize(unsigned int nllCacheSize) {
+		_nllCacheSize = nllCacheSize;
+	};
+
+	/// events provided by the caller instead of being imported from the chains (e.g. benchmarks): to be set before Init
+	inline void SetEventCaches(const std::vector<zee_events_t>& data, const std::vector<zee_events_t>& mc) {
+		data_events_cache = data;
+		mc_events_cache = mc;
+	};
+
+	/** the MC events of each category are sorted by CounterRNG::EventFraction at Init:
+	 * the reduced statistics samples of SetMCFraction are then the first events of the caches, no copy is done.
+	 * To be called before Init.
+	 */
+	inline void EnableMCFractions() {
+		_mcFractionsEnabled = true;
+	};
+	/** use only the MC events with CounterRNG::EventFraction < fraction (1 = all the events).
+	 * The NLL caches are cleared and all the categories are smeared again at the next evaluation:
+	 * the NLL values of different fractions are not comparable.
+	 */
+	void SetMCFraction(double fraction);
+	inline double GetMCFraction() const {
+		return _mcFraction;
+	};
+	/// first point of the MarkovChain evaluated with the current MC fraction
+	inline size_t GetMCFractionStart() const {
+		return _mcFractionStart;
+	};
+
+	/// likelihood of the data histogram given the smeared MC pdf
+	enum likelihood_t {
+		kBinomial = 0,
+		kPoisson,
+		kMultinomial
+	};
+	/// binomial (default), poisson or multinomial: to be set before Init
+	void SetLikelihoodType(TString type);
+
 	inline void SetToyScale(float scaleToy = 1.01, float constTermToy = 0.01) {
 		importer._scaleToy = scaleToy;
 		importer._constTermToy = constTermToy;
@@ -196,17 +266,17 @@ public:
 	inline RooDataSet *GetMarkovChainAsDataSet() {
 		return _markov.GetAsDataSet();
 	};
-	inline RooDataSet *SetDataSet(TString name = "profile", TString title = "", double nllMin_ = 0) {
+	inline NLLRecorder *SetDataSet(TString name = "profile", TString title = "", double nllMin_ = 0) {
 		if(dataset != NULL) {
-			std::cerr << "[WARNING] Removing last dataset: " << std::endl;
-			dataset->Print();
+			std::cerr << "[WARNING] Removing last dataset: " << dataset->GetName() << "\t" << dataset->Size() << " entries" << std::endl;
 			delete dataset;
 		}
 		//nllMin=nllMin_;
-		dataset = new RooDataSet(name, title, RooArgSet(_paramSet, nllVar));
+		dataset = new NLLRecorder(name, title);
+		dataset->SetParameters(_paramSet);
 		return dataset;
 	};
-	inline RooDataSet *GetDataSet(void) {
+	inline NLLRecorder *GetDataSet(void) {
 		return dataset;
 	}
 private:
@@ -230,45 +300,83 @@ public:
 	unsigned int _deactive_minEventsOffDiag;
 	double nllMin;
 	unsigned int _nSmearToy;
+	unsigned int _nThreads;
+	unsigned int _nllCacheSize;
+	likelihood_t _likelihoodType;
 private:
 
 	unsigned int _nLLtoy;
 	TRandom3* rgen_;
 	TStopwatch *myClock;
+	std::vector<TH1F *> _scratchHistos; ///< smeared MC histograms of the worker threads of GetNLLGradient, GetNLLHessian and EvaluatePoints
 
 	double lastNLL;
 	double lastNLLrms;
 	double nllBase;
-	RooRealVar nllVar;
+
+	bool _mcFractionsEnabled;
+	double _mcFraction;
+	size_t _mcFractionStart;
 
 public:
 	bool _isDataSmeared;
 	bool _autoBin;
 	bool _autoNsmear;
 	bool smearscan;
-	RooDataSet *dataset;
+	NLLRecorder *dataset; ///< points with the nll computed, converted to RooDataSet by WriteDataSet
 
-	RooStats::MarkovChain _markov;
+	NLLRecorder _markov; ///< all the evaluated points, converted to RooStats::MarkovChain when saved
 private:
 	void SetCache(Long64_t nEvents = 0, bool cacheToy = false, bool externToy = true);
 	void InitCategories(bool mcToy = false);
+	/// MC events of each cache in increasing CounterRNG::EventFraction
+	void SortMCByFraction();
 
 	//double smearedEnergy(float ene,float scale,float alpha,float
 	//constant) const;
-	double smearedEnergy(double *smear, unsigned int nGen, float ene, float scale, float alpha, float constant, const float *fixedSmearings = NULL) const;
+	/// smear[i] = scale + sigma * normals[i], or gaussians from gen if normals is NULL
+	double smearedEnergy(double *smear, unsigned int nGen, float ene, float scale, float alpha, float constant, const double *normals, TRandom3 *gen) const;
 	void SetSmearedHisto(const zee_events_t& cache,
 	                     RooArgSet pars1, RooArgSet pars2,
 	                     TString categoryName1, TString categoryName2, unsigned int nSmearToy,
-	                     TH1F *hist) const;
+	                     TH1F *hist, TRandom3 *gen, size_t nEvents = (size_t) -1) const;
+	/// does not access the RooFit parameters: can be used by the worker threads; only the first nEvents of the cache are used
+	void SetSmearedHisto(const zee_events_t& cache,
+	                     float scale1, float alpha1, float constant1,
+	                     float scale2, float alpha2, float constant2,
+	                     unsigned int nSmearToy,
+	                     TH1F *hist, TRandom3 *gen, size_t nEvents = (size_t) -1) const;
 
 	void SetHisto(const zee_events_t& cache, TH1F *hist) const;
 	void SetAutoBin(ZeeCategory& category, double min, double max); // set using statistics
 	void ResetBinning(ZeeCategory& category);
 	bool isCategoryChanged(ZeeCategory& category, bool updateVar = true) const;
+	/// resolve the scale, alpha and constTerm parameters of the two electrons of the category
+	void SetCategoryVars(ZeeCategory& category) const;
+
+	/// key of the NLL cache for the current values of the category
+	ZeeCategory::nllCacheKey_t GetNLLCacheKey(const ZeeCategory& category) const;
+	/// restore nll, nllRMS and smearHist_mc from the cache: false if not cached
+	bool GetCachedNLL(ZeeCategory& category) const;
+	/// store nll, nllRMS and smearHist_mc in the cache
+	void SetCachedNLL(ZeeCategory& category) const;
 
 
 	double getLogLikelihood(TH1F* data, TH1F* prob) const;
-	void UpdateCategoryNLL(ZeeCategory& cat, unsigned int nLLtoy, bool multiSmearToy = true);
+	/** the values of the parameters stored in the category (scale1, alpha1, ...) are used: they have to be updated before by isCategoryChanged.
+	 * data: data histogram of the category, NULL to get it by GetSmearedHisto (it can use RooFit: not from the worker threads)
+	 */
+	void UpdateCategoryNLL(ZeeCategory& cat, unsigned int nLLtoy, bool multiSmearToy = true, TH1F *data = NULL);
+	/// -logL of the category (mean and RMS over nLLtoy) with values = {scale1, alpha1, constant1, scale2, alpha2, constant2}, the MC is smeared in mc
+	void GetCategoryNLL(const ZeeCategory& cat, TH1F *data, const double *values,
+	                    unsigned int nLLtoy, bool multiSmearToy, TH1F *mc, double& nll, double& nllRMS) const;
+	/// one scratch histogram per thread, created in the main thread from ref
+	void AllocateScratchHistos(const TH1F *ref);
+	/// scratch histogram of the worker thread iWorker (see ParallelForWorkers), with the binning of ref
+	TH1F *GetScratchHisto(unsigned int iWorker, const TH1F *ref) const;
+	/// sum of the nll of the active categories, updates lastNLL, nllMin and the dataset (if updated)
+	double SumCategoryNLL(bool updated) const;
+	void AddToMarkovChain(double nll) const;
 
 
 	int Trag_eq(int row, int col, int N) const;
@@ -283,6 +391,35 @@ public:
 
 	double getCompatibility(bool forceUpdate = false) const;
 	void DumpNLL(void) const;
+
+	/// indices of the active categories depending on each of the parameters
+	std::vector<std::vector<size_t> > GetDependentCategories(const RooArgList& pars) const;
+	/// weighted mean energy of the MC electrons whose smearing depends on par (active categories)
+	double GetMeanEnergy(const RooAbsArg& par) const;
+	/** central finite-difference gradient of the NLL wrt the parameters (RooRealVar) with the given steps
+	 * for each parameter only the categories depending on it are smeared at x+h and x-h,
+	 * all the smearings of all the parameters are done in one parallel pass.
+	 * x+h and x-h are clipped to the range of the parameter: one-sided difference at a limit
+	 */
+	void GetNLLGradient(const RooArgList& pars, const double *steps,
+	                    const std::vector<std::vector<size_t> >& dependentCategories, double *grad);
+	/** finite-difference hessian of the NLL wrt the parameters (RooRealVar) with the given steps,
+	 * hessian is a pars.getSize()*pars.getSize() row-major matrix.
+	 * Diagonal terms: central second differences on the categories depending on the parameter;
+	 * off-diagonal terms: only the categories shared by the two parameters, from the (+h_i,+h_j) and
+	 * (-h_i,-h_j) points and the points of the diagonal terms.
+	 * All the smearings are done in one parallel pass, the categories are not modified.
+	 * x+h and x-h are clipped to the range of the parameters: the differences use the offsets actually set
+	 * (0 on the diagonal for a parameter at a limit).
+	 */
+	void GetNLLHessian(const RooArgList& pars, const double *steps,
+	                   const std::vector<std::vector<size_t> >& dependentCategories, std::vector<double>& hessian);
+	/** NLL in each of the points (values of vars), as evaluate() called for each point in sequence:
+	 * same values and same entries in the dataset and in the MarkovChain.
+	 * The changed categories of all the points are smeared in one parallel pass,
+	 * each on its own histogram. The vars are left at the last point.
+	 */
+	std::vector<double> EvaluatePoints(const RooArgList& vars, const std::vector<std::vector<double> >& points);
 	//  float getCompatibility(const RooSmearer *ptr);
 	inline RooArgSet GetParams(void) {
 		return _paramSet;
@@ -0,0 +1,96 @@
+#ifndef smearercatclassifier_hh
+#define smearercatclassifier_hh
+
+#include <vector>
+#include <TString.h>
+#include <TChain.h>
+#include <TLeaf.h>
+#include <TTreeFormula.h>
+#include "ElectronCategory_class.hh"
+
+/** \class SmearerCatClassifier
+ * \brief smearerCat of an event from per-electron region indices
+ *
+ * The smearer categories are the ordered pairs (region1 <= region2) of
+ * the region list: the event is in the first pair where electron 1 is
+ * in region1 and electron 2 in region2 (or the opposite, then swapped).
+ * Instead of one TTreeFormula per pair, each electron is classified once
+ * in the regions and the pair is looked up in a table.
+ *
+ * The regions made only of the cuts below are compiled into per-electron
+ * comparisons, with the same branches, constants and double precision as
+ * the TTreeFormula of ElectronCategory_class::GetCut:
+ *  - EB EBp EBm EE EEp EEm gold bad highR9 lowR9 all
+ *  - absEta_X_Y, Et_X, Et_X_Y, R9_X_Y
+ *
+ * The other regions use a TTreeFormula per electron (GetCut with nEle=1, 2)
+ * and one for the diagonal pair (nEle=0).
+ */
+class SmearerCatClassifier
+{
+public:
+	/// regions without the common cut, the branches must be active
+	SmearerCatClassifier(const std::vector<TString>& regions, ElectronCategory_class& cutter, bool isMC, TChain *chain);
+	~SmearerCatClassifier();
+
+	/// to be called when the tree of the chain changes
+	void UpdateFormulaLeaves();
+
+	/** index of the category of the current entry (-1 if none),
+	 * swap if electron 1 is in the second region of the pair
+	 */
+	int GetCategory(bool& swap);
+
+	inline unsigned int GetNCompiled() const {
+		return _nCompiled;
+	};
+
+private:
+	/// quantities of the compiled cuts
+	enum quantity_t {
+		kEta = 0,
+		kAbsEta,
+		kR9,
+		kR9prime,
+		kEt,
+		kNQuantities
+	};
+	enum op_t {kGT, kGE, kLT, kLE};
+
+	class cut_t
+	{
+	public:
+		quantity_t quantity;
+		op_t op;
+		double value;
+	};
+
+	class region_t
+	{
+	public:
+		bool compiled;
+		std::vector<cut_t> cuts;        ///< compiled: AND of the cuts
+		TTreeFormula *formulas[3];  ///< not compiled: both electrons (diagonal), electron 1, electron 2
+	};
+
+	/// false if one of the cuts of the region is not compiled
+	bool Compile(TString region, std::vector<cut_t>& cuts) const;
+	/// value of the compiled quantities of the electron
+	void ReadElectron(unsigned int iEle, double *values) const;
+	bool Pass(const std::vector<cut_t>& cuts, const double *values) const;
+
+	TChain *_chain;
+	bool _corrEle;
+	TString _energyBranchName;
+	std::vector<region_t> _regions;
+	std::vector<std::vector<int> > _pairIndex; ///< index of the category of the regions (i, j), i <= j
+	unsigned int _nCompiled;
+	std::vector<size_t> _regions1, _regions2; ///< regions of the electrons of the current entry
+
+	// leaves of the compiled quantities: etaEle, R9Ele, R9Eleprime, energy, etaSCEle, scaleEle
+	TString _leafNames[6];
+	TLeaf *_leaves[6];
+	bool _needed[6];
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef smearergradfunction_hh
+#define smearergradfunction_hh
+
+#include <vector>
+#include <Math/IFunction.h>
+#include <RooArgList.h>
+#include <RooArgSet.h>
+#include "RooSmearer.hh"
+
+/** \class SmearerGradFunction
+ * \brief NLL of the RooSmearer with its gradient, for Minuit2
+ *
+ * The function is evaluated on the floating parameters of the
+ * smearer (not constant RooRealVar). The gradient is computed by
+ * RooSmearer::GetNLLGradient: central finite differences where, for
+ * each parameter, only the categories depending on it are smeared
+ * again, instead of one evaluation of the full NLL per parameter and
+ * per step as with the numerical derivatives of Migrad.
+ */
+class SmearerGradFunction: public ROOT::Math::IMultiGradFunction
+{
+public:
+	/// steps of the finite differences: relStep * max(|x|, 1)
+	SmearerGradFunction(RooSmearer& smearer, RooArgSet args, double relStep = 1e-3);
+
+	ROOT::Math::IMultiGenFunction *Clone() const;
+	unsigned int NDim() const;
+
+	void Gradient(const double *x, double *grad) const;
+	void FdF(const double *x, double& f, double *df) const;
+
+	inline const RooArgList& GetParameters() const {
+		return _pars;
+	};
+
+private:
+	double DoEval(const double *x) const;
+	double DoDerivative(const double *x, unsigned int icoord) const;
+
+	/// set the values of the parameters of the smearer
+	void SetParameters(const double *x) const;
+
+	RooSmearer& _smearer;
+	RooArgList _pars; ///< floating parameters
+	double _relStep;
+	std::vector<std::vector<size_t> > _dependentCategories; ///< categories depending on each parameter
+
+	// last gradient: Minuit asks for the derivatives one at a time through DoDerivative
+	mutable std::vector<double> _lastX, _lastGrad;
+};
+
+/// minimization of the smearer NLL with Minuit2 Migrad and the batched gradient
+void MinimizationMigrad(RooSmearer& smearer, RooArgSet args);
+
+#endif
@@ -2,13 +2,14 @@
 #define SmearingImporter_hh
 
 #include <iostream>
+#include <string>
 
 #include <TChain.h>
 #include <TString.h>
 #include <TMath.h>
 #include <TEntryList.h>
 
-#define NSMEARTOYLIM 31
+#define IMPORT_BLOCKSIZE 100000 ///< selected entries imported by a worker in one go
 
 #include "ZeeEvent.hh"
 #include "ElectronCategory_class.hh"
@@ -31,7 +32,7 @@ class SmearingImporter
 	typedef std::vector<event_cache_t> regions_cache_t;
 public:
 	// constructor
-	inline SmearingImporter() {};
+	inline SmearingImporter(): _nThreads(1) {};
 	SmearingImporter(std::vector<TString> regionList, TString energyBranchName, TString commonCut = "");
 
 
@@ -80,6 +81,14 @@ public:
 	inline void SetPdfSystWeight(int value) {
 		_pdfWeightIndex = value;
 	};
+	/// directory for the binary event cache files (empty = not used)
+	inline void SetEventCacheDir(TString dir) {
+		_eventCacheDir = dir;
+	};
+	/// number of threads reading the chain in Import (the events are the same for any value)
+	inline void SetNThreads(unsigned int nThreads) {
+		_nThreads = (nThreads > 0) ? nThreads : 1;
+	};
 
 	std::vector<TString> _regionList;
 	float _scaleToy, _constTermToy;
@@ -104,12 +113,23 @@ private:
 	bool _onlyDiagonal;
 	bool _isSmearingEt;
 	int  _pdfWeightIndex;
+	TString _eventCacheDir;
+	unsigned int _nThreads;
 
 	ElectronCategory_class cutter;
 
+	class importBranches_t; // branch buffers, defined in SmearingImporter.cc
+
 	void Import(TTree *chain, regions_cache_t& cache, TString oddString, bool isMC, Long64_t nEvents = 0, bool isToy = false, bool externToy = true);
+	/// import the selected entries [firstEntry, lastEntry) of the entry list into cache, counting the events included and excluded by weight
+	void ImportBlock(TTree *chain, importBranches_t& branches, const std::vector<Long64_t>& entryNumbers,
+	                 Long64_t firstEntry, Long64_t lastEntry, UInt_t seed,
+	                 regions_cache_t& cache, Long64_t& includedEvents, Long64_t& excludedByWeight, bool isMC, bool isToy);
 	void ImportToy(Long64_t nEvents, event_cache_t& eventCache, bool isMC);
 
+	/// text with everything the imported events depend on (inputs, selection, options), to identify the event cache file: empty if the chain has friend trees in memory (no cache)
+	std::string GetCacheDescription(TChain *chain, bool isMC, bool odd, Long64_t nEvents, bool isToy, bool externToy);
+
 };
 
 
@@ -0,0 +1,45 @@
+#ifndef smearingkernel_hh
+#define smearingkernel_hh
+
+#include <vector>
+#include <TH1F.h>
+
+/** \class SmearingKernel
+ * \brief fills the smeared invariant mass of the events into plain arrays
+ *
+ * Replaces TH1F::Fill in the inner loop of RooSmearer::SetSmearedHisto:
+ *  - the smeared invariant masses of all the toys of an event are
+ *    computed with AVX or SSE2 instructions if available at compile
+ *    time, scalar code otherwise
+ *  - the bin index is computed arithmetically (uniform binning only),
+ *    with the same formula used by TAxis::FindBin
+ *  - the weights are accumulated in sum(w) and sum(w^2) arrays
+ *    and copied into the histogram once by CopyTo
+ */
+class SmearingKernel
+{
+public:
+	/// takes the binning from the histogram
+	SmearingKernel(const TH1F *hist);
+
+	/// empty the arrays
+	void Reset(void);
+
+	/// fill invMass * sqrt(smear1[i] * smear2[i]) for i in [0, nToy)
+	void Fill(float invMass, float weight, const double *smear1, const double *smear2, unsigned int nToy);
+
+	/// replace the content, errors, entries and statistics of the histogram
+	void CopyTo(TH1F *hist) const;
+
+private:
+	int _nBins;
+	double _xMin, _xMax;
+
+	std::vector<double> _sumw, _sumw2; ///< bin 0 is the underflow, bin nBins+1 the overflow
+	std::vector<double> _mass, _binX;  ///< buffers for the toys of one event
+
+	double _entries;
+	double _tsumw, _tsumw2, _tsumwx, _tsumwx2; ///< statistics as in TH1::Fill
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef weighttable_hh
+#define weighttable_hh
+
+#include <stdlib.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+/** \class WeightTable
+ * \brief weights binned in x, the map (bin low edge, weight) of the weight classes compiled in arrays
+ *
+ * The weight of x is the one of the last bin with low edge <= x, as
+ * (--map.upper_bound(x))->second: x above the last low edge (or NaN) is in the last bin.
+ * The map lookup is not defined below the first low edge, the table gives the first bin.
+ *
+ * With uniform bins the bin is computed from x and then checked against
+ * the low edges (same bin as the map also at the edges), otherwise it is
+ * a binary search in the array of the low edges.
+ */
+class WeightTable
+{
+public:
+	typedef std::map<double, float> weight_map_t;
+
+	WeightTable();
+	/// the map must not be empty
+	WeightTable(const weight_map_t& weights);
+
+	inline bool IsUniform() const {
+		return _uniform;
+	};
+	inline size_t GetNbins() const {
+		return _edges.size();
+	};
+
+	/// index of the bin of x in the arrays
+	inline size_t FindBin(double x) const;
+	inline float GetBinWeight(size_t bin) const {
+		return _weights[bin];
+	};
+	inline float GetWeight(double x) const {
+		return _weights[FindBin(x)];
+	};
+	/// weights of a column of n values
+	template<class T> void GetWeights(size_t n, const T *x, float *weights) const;
+
+private:
+	std::vector<double> _edges;  ///< bin low edges
+	std::vector<float> _weights;
+	bool _uniform;
+	double _invWidth;            ///< 1/bin width with uniform bins
+};
+
+inline size_t WeightTable::FindBin(double x) const
+{
+	size_t nBins = _edges.size();
+	if(!(x >= _edges[0])) return (x != x) ? nBins - 1 : 0; // NaN: upper_bound gives end()
+
+	size_t bin;
+	if(_uniform) {
+		double pos = (x - _edges[0]) * _invWidth;
+		bin = (pos >= nBins - 1) ? nBins - 1 : (size_t) pos;
+		// rounding of the computed bin at the edges
+		while(bin + 1 < nBins && _edges[bin + 1] <= x) bin++;
+		while(bin > 0 && _edges[bin] > x) bin--;
+	} else {
+		bin = std::upper_bound(_edges.begin(), _edges.end(), x) - _edges.begin() - 1;
+	}
+	return bin;
+}
+
+template<class T> void WeightTable::GetWeights(size_t n, const T *x, float *weights) const
+{
+	for(size_t i = 0; i < n; i++) weights[i] = _weights[FindBin(x[i])];
+}
+
+/** \class WeightArray
+ * \brief weights of integer keys, the map (key, weight) compiled in a dense array from the min to the max key
+ *
+ * Same as map.find(key): the keys not in the map have no weight.
+ */
+class WeightArray
+{
+public:
+	typedef std::map<int, double> weight_map_t;
+
+	WeightArray();
+	WeightArray(const weight_map_t& weights);
+
+	/// false if the key is not in the map
+	inline bool Find(int key, double& weight) const {
+		long long index = (long long) key - _minKey;
+		if(index < 0 || index >= (long long) _weights.size() || !_hasWeight[index]) return false;
+		weight = _weights[index];
+		return true;
+	};
+	inline int GetMinKey() const {
+		return _minKey;
+	};
+	inline bool IsEmpty() const {
+		return _weights.empty();
+	};
+
+private:
+	int _minKey;
+	std::vector<double> _weights;
+	std::vector<bool> _hasWeight;
+};
+
+#endif
@@ -15,6 +15,9 @@
 #include <TTree.h>
 #include <TChain.h>
 
+#include "BranchProducer.hh"
+#include "WeightTable.hh"
+
 using namespace std;
 
 
@@ -30,16 +33,28 @@ class ZPtWeights_class
 public:
 	ZPtWeights_class(void);
 	~ZPtWeights_class(void);
+	/// not copyable: indexTables point into the tables of this object
+	ZPtWeights_class(const ZPtWeights_class&) = delete;
+	ZPtWeights_class& operator=(const ZPtWeights_class&) = delete;
 
 	void ReadFromFile(std::string filename);
 
 	TTree *GetTreeWeight(TChain *tree,  TString ZPtBranchName, bool fastLoop = true);
+	/// filler of the ZPtWeight branch: the weights are read, not copied
+	BranchFiller *NewFiller(TString treename, TString ZPtBranchName);
 
-	double GetPtWeight(double ZPt_, int pdfWeightIndex); //all array of two elements (the two electrons)
+	double GetPtWeight(double ZPt_, int pdfWeightIndex) const; //all array of two elements (the two electrons)
+	/// weights of the indices [1, nIndices) in weights[1, nIndices)
+	void GetPtWeights(double ZPt_, int nIndices, Float_t *weights) const;
 private:
+	/// tables of the histograms used by GetPtWeight
+	void Compile();
+
 	TFile *f_ZPt;
 
 	std::map<TString , ZPtweight_map_t> ZPtweights;
+	std::map<TString, WeightTable> ZPttables; ///< histograms compiled in tables
+	std::vector<const WeightTable *> indexTables; ///< table of ZPtWeight_<index>, NULL if not in the file
 	//map<int,double> ZPtweights;
 	std::map<TString, TH1F *> ZPtHistMap;
 
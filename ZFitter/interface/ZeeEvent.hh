@@ -1,7 +1,11 @@
 #ifndef zeeevent_hh
 #define zeeevent_hh
 
+#include <vector>
+#include <stdint.h>
+
 /// class ZeeEvent ZeeEvent.h "interface/ZeeEvent.h"
+/// single event as filled by the importer, stored in the ZeeEventCache
 
 class ZeeEvent
 {
@@ -10,8 +14,72 @@ public:
 	float energy_ele2;
 	float invMass;
 	float weight;
-	float *smearings_ele1, *smearings_ele2;
+	uint64_t eventKey; ///< key of the smearing random numbers (CounterRNG::EventKey)
+};
+
+/** \class ZeeEventCache
+ * \brief structure-of-arrays event cache of a category
+ *
+ * The event quantities are stored in contiguous arrays (one per
+ * variable). The gaussian smearings of the electrons are not stored:
+ * they are regenerated from the event key by the counter-based
+ * generator (CounterRNG.hh).
+ */
+class ZeeEventCache
+{
+public:
+	inline size_t size() const {
+		return invMass.size();
+	};
+	inline bool empty() const {
+		return invMass.empty();
+	};
+	inline void clear() {
+		energy_ele1.clear();
+		energy_ele2.clear();
+		invMass.clear();
+		weight.clear();
+		eventKey.clear();
+	};
+	inline void reserve(size_t n) {
+		energy_ele1.reserve(n);
+		energy_ele2.reserve(n);
+		invMass.reserve(n);
+		weight.reserve(n);
+		eventKey.reserve(n);
+	};
+	/// release the memory not used after the filling
+	inline void shrink_to_fit() {
+		energy_ele1.shrink_to_fit();
+		energy_ele2.shrink_to_fit();
+		invMass.shrink_to_fit();
+		weight.shrink_to_fit();
+		eventKey.shrink_to_fit();
+	};
+
+	inline void push_back(const ZeeEvent& event) {
+		energy_ele1.push_back(event.energy_ele1);
+		energy_ele2.push_back(event.energy_ele2);
+		invMass.push_back(event.invMass);
+		weight.push_back(event.weight);
+		eventKey.push_back(event.eventKey);
+	};
+
+	/// add all the events of another cache
+	inline void append(const ZeeEventCache& other) {
+		energy_ele1.insert(energy_ele1.end(), other.energy_ele1.begin(), other.energy_ele1.end());
+		energy_ele2.insert(energy_ele2.end(), other.energy_ele2.begin(), other.energy_ele2.end());
+		invMass.insert(invMass.end(), other.invMass.begin(), other.invMass.end());
+		weight.insert(weight.end(), other.weight.begin(), other.weight.end());
+		eventKey.insert(eventKey.end(), other.eventKey.begin(), other.eventKey.end());
+	};
+
+	std::vector<float> energy_ele1;
+	std::vector<float> energy_ele2;
+	std::vector<float> invMass;
+	std::vector<float> weight;
+	std::vector<uint64_t> eventKey; ///< key of the smearing random numbers
 };
 
-typedef std::vector<ZeeEvent> zee_events_t;
+typedef ZeeEventCache zee_events_t;
 #endif
@@ -0,0 +1,43 @@
+#ifndef zeeeventcachefile_hh
+#define zeeeventcachefile_hh
+
+#include <string>
+#include <vector>
+#include <TString.h>
+#include "ZeeEvent.hh"
+
+/** \class ZeeEventCacheFile
+ * \brief binary columnar file with the event caches of all the categories
+ *
+ * The file is written after the first import of the events by the
+ * SmearingImporter and it is memory-mapped when reading it back.
+ * Layout (native endianness):
+ *  - header: magic, version, hash and full text of the description of
+ *    the inputs (file list, regions, selection, commonCut, weight flags...)
+ *  - table of categories: number of events
+ *  - for each category, aligned to 64 bytes: energy_ele1, energy_ele2,
+ *    invMass, weight and eventKey
+ *
+ * A file is used only if the description stored in the header is
+ * identical to the one of the current job, stale files are ignored
+ * and overwritten.
+ */
+class ZeeEventCacheFile
+{
+public:
+	typedef std::vector<zee_events_t> regions_cache_t;
+
+	/// 64 bit FNV-1a hash
+	static unsigned long long Hash(const std::string& description);
+
+	/// file name in dir from the hash of the description
+	static TString GetFileName(TString dir, const std::string& description);
+
+	/// write the caches: false if the file cannot be written
+	static bool Write(TString fileName, const std::string& description, const regions_cache_t& cache);
+
+	/// read the caches: false if the file does not exist or does not match the description
+	static bool Read(TString fileName, const std::string& description, regions_cache_t& cache);
+};
+
+#endif
@@ -26,6 +26,7 @@
 #include <TBranch.h>
 #include <TChain.h>
 
+#include "BranchProducer.hh"
 #include "EnergyScaleCorrection_class.hh"
 
 
@@ -43,17 +44,19 @@ public:
 	TTree* AddBranch_R9Eleprime(TChain* originalTree, TString treename, bool isMC);
 	TTree* AddBranch_ZPt(TChain* originalTree, TString treename, TString energyBranchName, bool fastLoop = true);
 
+	/** filler of the branch BranchName (same names as AddBranch) in the new tree treename,
+	 * to be added to a BranchProducer: NULL if BranchName is not defined
+	 */
+	BranchFiller *NewFiller(TString treename, TString BranchName, bool isMC = false, TString energyBranchName = "");
+
 
 	EnergyScaleCorrection_class *scaler;
 	TString _commonCut;
 	std::vector<TString> _regionList;
 
 private:
-	TTree* AddBranch_LTweight(TChain* originalChain, TString treename);
-	TTree* AddBranch_EleIDSF(TChain* originalChain, TString treename, TString branchname, TString energyBranchName, bool isMC);
-	TTree* AddBranch_invMassSigma(TChain* originalChain, TString treename, TString invMassBranchName, bool fastLoop = true, bool isMC = true);
-	TTree* AddBranch_iSM(TChain* originalChain, TString treename, TString iSMEleName, bool fastLoop);
-	TTree* AddBranch_smearerCat(TChain* originalChain, TString treename, bool isMC);
+	/// tree of a single filler
+	TTree *Produce(TChain *originalChain, BranchFiller *filler);
 
 };
 
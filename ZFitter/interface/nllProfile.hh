@@ -5,6 +5,7 @@
 #include <TFile.h>
 #include <TObjArray.h>
 #include <TObjString.h>
+#include <TVectorD.h>
 #include <TCanvas.h>
 #include <TH2F.h>
 #include <TROOT.h>
@@ -29,7 +30,12 @@
 #include <TSystem.h>
 
 #include <iostream>
+#include <fstream>
 #include <vector>
+#include <set>
+#include <algorithm>
+#include <string>
+#include <ctime>
 
 #include <ctype.h>
 #include <stdio.h>
@@ -59,6 +65,12 @@
 //#define DEBUG
 #define MEM_DEBUG
 #define PROFILE_NBINS 2000
+#define BRENT_NLL_TOLERANCE 0.005 ///< minimum NLL tolerance of the line search (the NLL RMS is 0 with fixed smearings)
+#define BRENT_MAXITER 100
+#define SURROGATE_MAXITER 30
+#define SURROGATE_RADIUS 4 ///< initial trust region of the surrogate line search, in steps
+#define SURROGATE_NLAST 20000 ///< points of the MarkovChain looked at by the surrogate line search
+#define HESSIAN_STEP 5 ///< step of the finite differences of the hessian, in line search bins
 
 using namespace RooStats;
 
@@ -68,18 +80,287 @@ using namespace RooStats;
 TGraph *GetProfile(RooRealVar *var, RooSmearer& compatibility, int level = -1, bool warningEnable = false, bool trueEval = true, float rho = 0, float Emean = 0, float phi = 0);
 TGraph *GetProfile(RooRealVar *var1, RooRealVar *var2, RooSmearer& smearer, bool trueEval = true, double rho = 0, double Emean = 0, float phi = 0);
 TGraph *GetProfile(RooRealVar *var, RooSmearer& compatibility, int level, bool warningEnable, bool trueEval, float rho, float Emean, float phi);
+/** NLL map on a (rho, phi) grid of bin centers: alpha = rho * Emean * cos(phi), constTerm = rho * sin(phi)
+ * with phi in [0, pi/2] and rho in [0, rhoMax], the largest rho keeping both parameters in their range.
+ * All the points are evaluated in one RooSmearer::EvaluatePoints call: only the categories
+ * of the region are smeared, in parallel. The parameters are restored at the end.
+ */
+TH2F *GetProfile2D(RooRealVar *constVar, RooRealVar *alphaVar, RooSmearer& smearer, double Emean, int nRho = 40, int nPhi = 32);
 TTree *dataset2tree(RooDataSet *dataset);
 TMatrixDSym* GetCovariance( RooStats::MarkovChain *chain, TString var1, TString var2);
 bool stopFindMin1D(Int_t i, Int_t iLocMin, Double_t chi2, Double_t min, Double_t locmin, float phiMin = 2);
+
+/** \class ProfileScan1D
+ * \brief walk of FindMin1D along a grid of points, one trial point at a time
+ *
+ * The grid is scanned from iMinStart towards the positive side, then
+ * towards the negative side, until stopFindMin1D. The caller sets the
+ * parameter to X[Index()], evaluates the NLL and gives it to Set():
+ * several independent scans can then share the same evaluate().
+ */
+class ProfileScan1D
+{
+public:
+	/// Y is filled with the mean of the NLL values in each point
+	ProfileScan1D(Int_t N, Int_t iMinStart, Double_t min, float phiMin, Double_t *Y);
+
+	inline bool Done() const {
+		return _done;
+	};
+	/// grid index of the next trial point
+	inline Int_t Index() const {
+		return _i;
+	};
+	/// +1 positive side, -1 negative side
+	inline int Direction() const {
+		return _direction;
+	};
+	inline Double_t GetLocMin() const {
+		return _locmin;
+	};
+	/// index of the minimum, -1 if no sensitivity to the parameter
+	inline Int_t GetMinIndex() const {
+		return _noSensitivity ? -1 : _iLocMin;
+	};
+	/// NLL at the current trial point
+	void Set(Double_t chi2);
+
+private:
+	void NextSide();
+
+	Int_t _N, _iMinStart, _i, _iLocMin;
+	int _direction;
+	Double_t _min, _locmin;
+	float _phiMin;
+	Double_t *_Y;
+	std::vector<int> _NY;
+	bool _done, _noSensitivity;
+};
+
 Int_t FindMin1D(RooRealVar *var, Double_t *X, Int_t N, Int_t iMinStart, Double_t min, RooSmearer& smearer, bool update = true, Double_t *Y = NULL, RooRealVar *var2 = NULL, Double_t *X2 = NULL);
-void MinimizationProfile(RooSmearer& smearer, RooArgSet args, long unsigned int nIterMCMC, bool mcmc = false);
+
+/** \class BrentScan1D
+ * \brief bracketed 1D minimization (Brent), one trial point at a time
+ *
+ * The minimum is first bracketed starting from x0 with steps growing
+ * by the golden ratio, inside [xMin, xMax], then refined by parabolic
+ * interpolation and golden-section steps. The search stops when the
+ * bracket is narrower than xTolerance, or when the NLL at the bracket
+ * ends is within nllTolerance from the minimum: below the noise of the
+ * NLL (RooSmearer::GetNllRMS) the minimum is not moved any more.
+ * As ProfileScan1D the caller evaluates the NLL at Next() and gives it to Set().
+ */
+class BrentScan1D
+{
+public:
+	BrentScan1D(Double_t x0, Double_t step, Double_t xMin, Double_t xMax,
+	            Double_t xTolerance, Double_t nllTolerance);
+
+	inline bool Done() const {
+		return _state == kDone;
+	};
+	/// next trial point
+	inline Double_t Next() const {
+		return _u;
+	};
+	inline Double_t GetMinX() const {
+		return _x;
+	};
+	inline Double_t GetMinNLL() const {
+		return _fx;
+	};
+	/// same NLL in x0 and x0+-step: no sensitivity to the parameter
+	inline bool NoSensitivity() const {
+		return _noSensitivity;
+	};
+	inline int GetNEvaluations() const {
+		return _nEvaluations;
+	};
+	/// NLL at the current trial point
+	void Set(Double_t f);
+
+private:
+	enum state_t {kStart, kUp, kDown, kExpand, kBrent, kDone};
+	/// bracket from x0 and x0+-step, or start to walk downhill
+	void StartBracket();
+	/// next downhill point, or stop at the limit of the range
+	void Expand();
+	void StartBrent();
+	/// compute the next Brent trial point, or stop
+	void BrentStep();
+	/// clamp x in [xMin, xMax]
+	Double_t Clamp(Double_t x) const;
+
+	state_t _state;
+	Double_t _x0, _step, _xMin, _xMax, _xTolerance, _nllTolerance;
+	Double_t _u; ///< point being evaluated
+	Double_t _a, _b, _fa, _fb; ///< bracket
+	Double_t _x, _w, _v, _fx, _fw, _fv, _d, _e; ///< Brent: best, second and previous second best points
+	Double_t _fUp, _fDown;
+	int _nEvaluations, _iter;
+	bool _noSensitivity;
+};
+
+/// Brent search of the minimum of var from its current value, with the precision of the GetProfile grid (level 5)
+BrentScan1D LineSearch(RooRealVar *var, RooSmearer& smearer);
+
+/** \class SurrogateScan1D
+ * \brief 1D minimization on a quadratic model of the NLL, one trial point at a time
+ *
+ * The model is a parabola fitted (least squares) to the points inside a
+ * trust region around the best point, starting from the points already
+ * evaluated: its minimum is proposed and confirmed by a true evaluation.
+ * The trust region grows if the model predicts well the improvement
+ * and shrinks if not. The search stops when the proposed step is below
+ * xTolerance or the predicted improvement below nllTolerance.
+ * If the model is not convex the search continues with a BrentScan1D.
+ * Same interface as BrentScan1D.
+ */
+class SurrogateScan1D
+{
+public:
+	/// x, nll: points already evaluated with the other parameters at their current values
+	SurrogateScan1D(Double_t x0, Double_t step, Double_t xMin, Double_t xMax,
+	                Double_t xTolerance, Double_t nllTolerance,
+	                const std::vector<double>& x, const std::vector<double>& nll);
+
+	inline bool Done() const {
+		return _fallback ? _brent.Done() : _done;
+	};
+	inline Double_t Next() const {
+		return _fallback ? _brent.Next() : _u;
+	};
+	inline Double_t GetMinX() const {
+		return (_fallback && _brent.GetMinNLL() < _fc) ? _brent.GetMinX() : _xc;
+	};
+	inline Double_t GetMinNLL() const {
+		return (_fallback && _brent.GetMinNLL() < _fc) ? _brent.GetMinNLL() : _fc;
+	};
+	inline bool NoSensitivity() const {
+		return _noSensitivity || (_fallback && _brent.NoSensitivity());
+	};
+	/// true evaluations, without the points given to the constructor
+	inline int GetNEvaluations() const {
+		return _nEvaluations;
+	};
+	/// NLL at the current trial point
+	void Set(Double_t f);
+
+private:
+	/// fit the model and set the next trial point, or stop
+	void Propose();
+	/// parabola a + b*t + c*t^2, t = (x - _xc) / _step, on the points within the trust region
+	bool Fit(Double_t& a, Double_t& b, Double_t& c) const;
+	/// index of a point at x (within xTolerance / 10), -1 if none
+	int Find(Double_t x) const;
+
+	Double_t _step, _xMin, _xMax, _xTolerance, _nllTolerance;
+	std::vector<double> _x, _f; ///< all the points
+	Double_t _xc, _fc; ///< best point
+	Double_t _radius; ///< trust region
+	Double_t _u; ///< point being evaluated
+	Double_t _predicted; ///< improvement predicted by the model at _u, 0 for the points to start the fit
+	int _nEvaluations, _iter;
+	bool _done, _noSensitivity, _fallback;
+	BrentScan1D _brent;
+};
+
+/// surrogate search of the minimum of var, starting from the points of the MarkovChain of the smearer
+SurrogateScan1D SurrogateLineSearch(RooRealVar *var, RooSmearer& smearer);
+
+/** \class ProfileCheckpoint
+ * \brief state of MinimizationProfile, saved periodically to restart an interrupted job
+ *
+ * The checkpoint is a ROOT file with the parameters (values, errors
+ * and constant flags), the counters of the minimization, nllMin and
+ * the MarkovChain of the smearer. It is written in a temporary file
+ * then renamed: an interrupted job always leaves a complete checkpoint.
+ */
+class ProfileCheckpoint
+{
+public:
+	/// no checkpoint is written if fileName is empty, interval in seconds
+	ProfileCheckpoint(TString fileName = "", double interval = 600);
+
+	/// write the checkpoint if the last one is older than interval, or if force
+	void Save(RooArgSet args, RooSmearer& smearer, bool force = false);
+	/// restore the parameters, the counters and the MarkovChain: false if there is no checkpoint
+	bool Load(RooArgSet args, RooSmearer& smearer);
+
+	inline bool IsResumed() const {
+		return _resumed;
+	};
+	/// parameter already minimized in the current iteration
+	inline bool IsDone(const RooAbsArg *var) const {
+		return _doneParams.count(var->GetName()) != 0;
+	};
+	inline void SetDone(const RooAbsArg *var) {
+		_doneParams.insert(var->GetName());
+	};
+	/// true if the current iteration has been interrupted
+	inline bool InIteration() const {
+		return !_doneParams.empty();
+	};
+	/// to be called at the end of each iteration
+	inline void ClearDone() {
+		_doneParams.clear();
+	};
+
+	int phase; ///< 0 = scale minimization, 1 = smearing + scale minimization, 2 = done
+	int nIter;
+	Double_t min, min_old;
+	bool updateError;
+
+private:
+	TString _fileName;
+	double _interval;
+	time_t _lastSave;
+	bool _resumed;
+	std::set<std::string> _doneParams;
+};
+
+/// profile minimization, with SurrogateScan1D instead of BrentScan1D for the 1D line searches if surrogate
+void MinimizationProfile(RooSmearer& smearer, RooArgSet args, long unsigned int nIterMCMC, bool mcmc = false, ProfileCheckpoint *checkpoint = NULL,
+                         bool surrogate = false);
 
 bool MinProfile(RooRealVar *var, RooSmearer& smearer, int iProfile,
-                Double_t min_old, Double_t& min, double rho = 0, double Emean = 0, bool update = true, bool dscan = false);
+                Double_t min_old, Double_t& min, double rho = 0, double Emean = 0, bool update = true, bool dscan = false, bool surrogate = false);
+
+/// groups of parameters with no category in common (see RooSmearer::GetDependentCategories), in the order of vars
+std::vector<std::vector<RooRealVar *> > GroupIndependentParameters(const std::vector<RooRealVar *>& vars, const RooSmearer& smearer);
+
+/** profile minimization of parameters with no category in common:
+ * the scans of all the parameters move together, with one evaluate() per step,
+ * the NLL seen by each parameter is rebuilt from the nll of its categories.
+ * The parameters being independent, the minima are the ones of MinProfile called for each parameter.
+ */
+bool MinProfileGroup(const std::vector<RooRealVar *>& vars, RooSmearer& smearer, int iProfile,
+                     Double_t min_old, Double_t& min);
 
 bool MinProfile2D(RooRealVar *var1, RooRealVar *var2, RooSmearer& smearer, int iProfile,
                   Double_t min_old, Double_t& min, double& rho, double& Emean, bool update = true, bool dscan = false);
 
+/** ensemble MCMC of the floating parameters of args, with the smearer NLL as -log(likelihood)
+ *
+ * Affine-invariant ensemble sampler (Goodman and Weare stretch move, a = 2):
+ * the nWalkers walkers are split in two halves, each walker of a half moves along the
+ * line to a random walker of the other half. The proposals of a half are evaluated
+ * together by RooSmearer::EvaluatePoints, in parallel over walkers and categories.
+ * At least 2 walkers per parameter are recommended.
+ *
+ * The states of the walkers after the burn-in are recorded in chain (weight 1),
+ * the parameters are set to the posterior mean, their errors to the posterior RMS.
+ */
+void SampleEnsembleMCMC(RooSmearer& smearer, RooArgSet args, unsigned int nSteps, unsigned int nWalkers,
+                        unsigned int nBurnIn, NLLRecorder& chain, unsigned int seed = 12345);
+
+/** covariance of the floating parameters of args from the hessian of the NLL at their current values (the minimum),
+ * computed by RooSmearer::GetNLLHessian in one parallel pass.
+ * The values, errors, covariance and correlation matrices are written in the text file fileName
+ * (only a warning if it cannot be opened). Parameters at a limit of their range are left out.
+ */
+void HessianCovariance(RooSmearer& smearer, RooArgSet args, TString fileName);
+
 
 
 class ShervinMinuit: public PdfProposal
@@ -11,6 +11,9 @@
 #include <TTree.h>
 #include <TChain.h>
 
+#include "BranchProducer.hh"
+#include "WeightTable.hh"
+
 #define MAX_PU_REWEIGHT 59
 using namespace std;
 
@@ -21,22 +24,36 @@ class puWeights_class
 
 public:
 	puWeights_class(void);
+	/// copy with its own iterator of the run ranges and warning counter (one per thread)
+	puWeights_class(const puWeights_class& weights);
 	~puWeights_class(void);
 
 	void ReadFromFile(std::string filename);
 	void ReadFromFiles(std::string mcPUFile, std::string dataPUFile, int runMin = 1);
 
 	TTree *GetTreeWeight(TChain *tree, bool fastLoop = true, TString nPUbranchName = "nPU");
+	/// filler of the puWeight branch, with its own copy of the weights
+	BranchFiller *NewFiller(TString treename = "pileup", TString nPUbranchName = "nPU");
 
 	// made with only on-time PU
 	double GetWeight(int nPU, int runNumber = 1);
 
+	inline unsigned int GetWarningCounter() const {
+		return warningCounter;
+	};
+
 private:
 	//std::map<const int,double> PUweights;
 	typedef std::map<int, double> PUweights_t; ///< map of (nPU,weight) for a given run range: weights map
 	typedef std::map<int, PUweights_t>  PUWeightsRunDepMap_t; ///< map of (runMin,weights map)
+	typedef std::map<int, WeightArray> PUWeightsRunDepTable_t; ///< map of (runMin,weights array)
+
+	/// weights maps compiled in arrays, without the empty ones
+	void Compile();
+
 	PUWeightsRunDepMap_t PUWeightsRunDepMap;  ///< map of the weights
-	PUWeightsRunDepMap_t::const_iterator PUweights_itr; ///< iterator to the weights of the last run range
+	PUWeightsRunDepTable_t PUWeightsRunDepTable; ///< weights read by GetWeight
+	PUWeightsRunDepTable_t::const_iterator PUweights_itr; ///< iterator to the weights of the last run range
 	unsigned int warningCounter;
 };
 
@@ -15,6 +15,9 @@
 #include <TTree.h>
 #include <TChain.h>
 
+#include "BranchProducer.hh"
+#include "WeightTable.hh"
+
 using namespace std;
 
 
@@ -30,19 +33,36 @@ class r9Weights_class
 public:
 	r9Weights_class(void);
 	~r9Weights_class(void);
+	/// not copyable: etaTables, R9Tables and ptTable point into the tables of this object
+	r9Weights_class(const r9Weights_class&) = delete;
+	r9Weights_class& operator=(const r9Weights_class&) = delete;
 
 	void ReadFromFile(std::string filename);
 
 	TTree *GetTreeWeight(TChain *tree, bool fastLoop = true,
 	                     TString etaElebranchName = "etaEle", TString R9ElebranchName = "R9Ele",
 	                     TString ptElebranchName = "PtEle");
-
-	double GetWeight(double etaEle_, double R9Ele_);
-	double GetPtWeight(double PtEle_);
+	/// filler of the r9Weight and ptWeight branches: the weights are read, not copied
+	BranchFiller *NewFiller(TString treename = "r9Weight",
+	                        TString etaElebranchName = "etaEle", TString R9ElebranchName = "R9Ele",
+	                        TString ptElebranchName = "PtEle");
+
+	double GetWeight(double etaEle_, double R9Ele_) const;
+	double GetPtWeight(double PtEle_) const;
+	/// weights of the n electrons
+	void GetWeights(size_t n, const Float_t *etaEle, const Float_t *R9Ele, Float_t *weights) const;
+	void GetPtWeights(size_t n, const Float_t *PtEle, Float_t *weights) const;
 private:
+	/// tables of the histograms used by GetWeight and GetPtWeight
+	void Compile();
+
 	TFile *f_r9;
 
 	std::map<TString , r9weight_map_t> r9weights;
+	std::map<TString, WeightTable> r9tables; ///< histograms compiled in tables
+	/// R9EtaWeight and R9Weight tables of the categories (eta, Gold/Bad): NULL if not in the file
+	const WeightTable *etaTables[4][2], *R9Tables[4][2];
+	const WeightTable *ptTable;
 	//map<int,double> r9weights;
 	std::map<TString, TH1F *> r9HistMap;
 
@@ -0,0 +1,307 @@
+#include "../interface/BranchProducer.hh"
+#include "../interface/ParallelFor.hh"
+#include <TROOT.h>
+#include <TFile.h>
+#include <TObjArray.h>
+#include <TChainElement.h>
+#include <TFriendElement.h>
+#include <TList.h>
+#include <iomanip>
+#include <mutex>
+
+//------------------------------ BranchFiller, BranchProducer
+BranchFiller::BranchFiller(TString treename):
+	_tree(new TTree(treename, treename))
+{
+}
+
+BranchFiller::~BranchFiller()
+{
+	delete _tree;
+}
+
+BranchProducer::BranchProducer(TChain *chain):
+	_chain(chain)
+{
+	_chain->SetBranchStatus("*", 0);
+}
+
+BranchProducer::~BranchProducer()
+{
+	for(std::vector<BranchFiller *>::iterator filler_itr = _fillers.begin(); filler_itr != _fillers.end(); filler_itr++) delete *filler_itr;
+	_chain->SetBranchStatus("*", 1);
+	_chain->ResetBranchAddresses();
+}
+
+bool BranchProducer::Add(BranchFiller *filler)
+{
+	if(!filler->Init(*this)) {
+		delete filler;
+		return false;
+	}
+	_fillers.push_back(filler);
+	return true;
+}
+
+bool BranchProducer::Activate(TString branchName)
+{
+	if(_chain->GetBranch(branchName) == NULL) return false;
+	_chain->SetBranchStatus(branchName, 1);
+	return true;
+}
+
+std::vector<TTree *> BranchProducer::Run(Long64_t firstEntry, Long64_t lastEntry)
+{
+	// the progress is shown only for the whole chain, not for the jobs of FriendFileProducer
+	bool showProgress = lastEntry < 0;
+	if(lastEntry < 0) lastEntry = _chain->GetEntries();
+	Long64_t entries = lastEntry - firstEntry;
+	_chain->LoadTree(firstEntry);
+	Int_t treenumber = -1;
+
+	if(showProgress) {
+		std::cout << "[STATUS] Filling " << _fillers.size() << " trees in one pass of: " << _chain->GetTitle()
+		          << "\t" << "with " << entries << " entries" << std::endl;
+		std::cerr << "[00%]";
+	}
+	for(Long64_t ientry = firstEntry; ientry < lastEntry; ientry++) {
+		_chain->GetEntry(ientry);
+		if(_chain->GetTreeNumber() != treenumber) {
+			treenumber = _chain->GetTreeNumber();
+			for(std::vector<BranchFiller *>::iterator filler_itr = _fillers.begin(); filler_itr != _fillers.end(); filler_itr++) (*filler_itr)->Notify(_chain);
+		}
+		for(std::vector<BranchFiller *>::iterator filler_itr = _fillers.begin(); filler_itr != _fillers.end(); filler_itr++) {
+			(*filler_itr)->Compute(ientry);
+			(*filler_itr)->GetTree()->Fill();
+		}
+		if(showProgress && entries >= 100 && ientry % (entries / 100) == 0) std::cerr << "\b\b\b\b" << std::setw(2) << ientry / (entries / 100) << "%]";
+	}
+	if(showProgress) std::cout << std::endl;
+
+	// the trees must not point to the buffers of the fillers, deleted with the producer
+	std::vector<TTree *> trees;
+	for(std::vector<BranchFiller *>::iterator filler_itr = _fillers.begin(); filler_itr != _fillers.end(); filler_itr++) {
+		trees.push_back((*filler_itr)->ReleaseTree());
+		trees.back()->ResetBranchAddresses();
+	}
+	return trees;
+}
+
+//------------------------------ FriendFileProducer
+FriendFileProducer::FriendFileProducer(TChain *chain, unsigned int nThreads):
+	_chain(chain), _nThreads(nThreads > 0 ? nThreads : 1)
+{
+	if(_nThreads > 1) ROOT::EnableThreadSafety();
+}
+
+void FriendFileProducer::Add(TString treeName, TString fileName, factory_t factory, TString title)
+{
+	newTree_t newTree;
+	newTree.treeName = treeName;
+	newTree.fileName = fileName;
+	newTree.title = title;
+	newTree.factory = factory;
+	_newTrees.push_back(newTree);
+}
+
+std::vector<TTree *> FriendFileProducer::Run(bool inMemory)
+{
+	//------------------------------ jobs: the entries of each file of the chain
+	bool perFile = _nThreads > 1;
+	std::vector<Long64_t> firstEntries(1, 0);
+	Long64_t entries = _chain->GetEntries(); // it also gets the entries of each file
+	if(perFile) {
+		TObjArray *fileElements = _chain->GetListOfFiles();
+		for(int i = 0; i < fileElements->GetEntries(); i++) {
+			firstEntries.push_back(firstEntries.back() + ((TChainElement *) fileElements->At(i))->GetEntries());
+		}
+		if(firstEntries.back() != entries) {
+			std::cerr << "[ERROR] Entries of the files of " << _chain->GetTitle() << " not consistent with the chain: "
+			          << firstEntries.back() << " != " << entries << std::endl;
+			exit(1);
+		}
+	} else firstEntries.push_back(entries);
+	size_t nJobs = firstEntries.size() - 1;
+
+	std::vector<std::vector<TString> > fileNames(_newTrees.size(), std::vector<TString>(nJobs));
+	for(size_t iTree = 0; iTree < _newTrees.size(); iTree++) {
+		for(size_t iJob = 0; iJob < nJobs; iJob++) {
+			fileNames[iTree][iJob] = _newTrees[iTree].fileName;
+			if(perFile) {
+				fileNames[iTree][iJob] += "_";
+				fileNames[iTree][iJob] += iJob;
+			}
+			fileNames[iTree][iJob] += ".root";
+		}
+	}
+
+	if(perFile) std::cout << "[STATUS] Filling " << _newTrees.size() << " trees of " << _chain->GetTitle() << " in "
+		                  << nJobs << (inMemory ? " jobs" : " files") << " with " << _nThreads << " threads" << std::endl;
+
+	// entries of each new tree of each job: -1 if the inputs are not in the chain
+	std::vector<std::vector<Long64_t> > nEntries(nJobs, std::vector<Long64_t>(_newTrees.size(), -1));
+	std::vector<std::vector<TTree *> > memTrees(nJobs, std::vector<TTree *>(_newTrees.size(), NULL));
+	// each worker reads its own copy of the chain, made at its first job and reused for the next ones:
+	// the friend trees in memory are copied once per worker, not once per file
+	std::vector<TChain *> workerChains(_nThreads, NULL);
+	ParallelForWorkers(_nThreads, nJobs, [&](size_t iJob, unsigned int iWorker) {
+		TChain *chain = _chain;
+		if(perFile) {
+			if(workerChains[iWorker] == NULL) workerChains[iWorker] = CloneChain(_chain);
+			chain = workerChains[iWorker];
+		}
+		{
+			BranchProducer producer(chain);
+			std::vector<TFile *> files;
+			std::vector<size_t> added;
+			for(size_t iTree = 0; iTree < _newTrees.size(); iTree++) {
+				TFile *f = NULL;
+				if(inMemory) gROOT->cd();
+				else {
+					f = new TFile(fileNames[iTree][iJob], "recreate");
+					if(!f->IsOpen() || f->IsZombie()) {
+						std::cerr << "[ERROR] File " << fileNames[iTree][iJob] << " not created" << std::endl;
+						exit(1);
+					}
+					f->cd();
+				}
+				BranchFiller *filler = _newTrees[iTree].factory(_newTrees[iTree].treeName);
+				if(filler == NULL) {
+					std::cerr << "[ERROR] New tree " << _newTrees[iTree].treeName << " is NULL" << std::endl;
+					exit(1);
+				}
+				if(!producer.Add(filler)) {
+					if(f != NULL) f->Close();
+					delete f;
+					continue;
+				}
+				files.push_back(f);
+				added.push_back(iTree);
+			}
+			if(!added.empty()) {
+				std::vector<TTree *> newTrees = perFile ? producer.Run(firstEntries[iJob], firstEntries[iJob + 1]) : producer.Run();
+				for(size_t i = 0; i < added.size(); i++) {
+					if(_newTrees[added[i]].title != "") newTrees[i]->SetTitle(_newTrees[added[i]].title);
+					nEntries[iJob][added[i]] = newTrees[i]->GetEntries();
+					if(inMemory) {
+						newTrees[i]->SetDirectory(NULL);
+						memTrees[iJob][added[i]] = newTrees[i];
+						continue;
+					}
+					files[i]->cd();
+					newTrees[i]->Write();
+					delete newTrees[i];
+					files[i]->Close();
+					delete files[i];
+				}
+			}
+		}
+	});
+	for(std::vector<TChain *>::iterator chain_itr = workerChains.begin(); chain_itr != workerChains.end(); chain_itr++) {
+		if(*chain_itr != NULL) DeleteChain(*chain_itr);
+	}
+
+	//------------------------------ friend trees, checking the alignment with the chain
+	std::vector<TTree *> trees(_newTrees.size(), NULL);
+	for(size_t iTree = 0; iTree < _newTrees.size(); iTree++) {
+		size_t nProduced = 0;
+		for(size_t iJob = 0; iJob < nJobs; iJob++) if(nEntries[iJob][iTree] >= 0) nProduced++;
+		if(nProduced == 0) continue;
+
+		for(size_t iJob = 0; iJob < nJobs; iJob++) {
+			if(nEntries[iJob][iTree] != firstEntries[iJob + 1] - firstEntries[iJob]) {
+				std::cerr << "[ERROR] Tree " << _newTrees[iTree].treeName << " of job " << iJob << " has "
+				          << nEntries[iJob][iTree] << " entries instead of " << firstEntries[iJob + 1] - firstEntries[iJob] << std::endl;
+				exit(1);
+			}
+		}
+
+		TTree *newTree = NULL;
+		if(inMemory) {
+			newTree = memTrees[0][iTree];
+			if(nJobs > 1) { // concatenated in the order of the files
+				TList jobTrees;
+				for(size_t iJob = 0; iJob < nJobs; iJob++) jobTrees.Add(memTrees[iJob][iTree]);
+				gROOT->cd();
+				newTree = TTree::MergeTrees(&jobTrees);
+				newTree->SetDirectory(NULL);
+				newTree->ResetBranchAddresses();
+				for(size_t iJob = 0; iJob < nJobs; iJob++) delete memTrees[iJob][iTree];
+			}
+		} else {
+			TChain *newChain = new TChain(_newTrees[iTree].treeName);
+			for(size_t iJob = 0; iJob < nJobs; iJob++) newChain->Add(fileNames[iTree][iJob], nEntries[iJob][iTree]);
+			newTree = newChain;
+		}
+		if(newTree->GetEntries() != entries) {
+			std::cerr << "[ERROR] Friend " << _newTrees[iTree].treeName << " not aligned with " << _chain->GetTitle()
+			          << ": " << newTree->GetEntries() << " != " << entries << " entries" << std::endl;
+			exit(1);
+		}
+		trees[iTree] = newTree;
+	}
+	return trees;
+}
+
+//------------------------------ copies of the chains for the worker threads
+namespace
+{
+std::mutex memTreeMutex; ///< the friend trees in memory are read by one thread at a time to be copied
+
+TTree *CloneFriend(TTree *tree)
+{
+	if(dynamic_cast<TChain *>(tree) != NULL) return CloneChain(tree);
+
+	// tree in memory (FriendFileProducer::Run(true)): full copy, the disabled branches would not be copied.
+	// The readers make one copy per worker thread and reuse it for all their jobs
+	std::lock_guard<std::mutex> lock(memTreeMutex);
+	tree->SetBranchStatus("*", 1);
+	TTree *clone = tree->CloneTree(-1);
+	clone->SetDirectory(NULL);
+	clone->ResetBranchAddresses();
+	clone->SetBranchStatus("*", 0);
+	return clone;
+}
+}
+
+TChain *CloneChain(TTree *chain)
+{
+	TChain *clone = new TChain(chain->GetName(), chain->GetTitle());
+	TChain *chain_ = dynamic_cast<TChain *>(chain);
+	if(chain_ == NULL) {
+		std::cerr << "[ERROR] Multithreaded reading implemented only for TChains" << std::endl;
+		exit(1);
+	}
+	TObjArray *fileElements = chain_->GetListOfFiles();
+	for(int i = 0; i < fileElements->GetEntries(); i++) {
+		// the known entries of the files avoid to open all of them to find the offsets
+		TChainElement *element = (TChainElement *) fileElements->At(i);
+		clone->Add(element->GetTitle(), element->GetEntries());
+	}
+	if(chain->GetListOfFriends() != NULL) {
+		TIterator *it = chain->GetListOfFriends()->MakeIterator();
+		for(TFriendElement *friendElement = (TFriendElement *) it->Next(); friendElement != NULL; friendElement = (TFriendElement *) it->Next()) {
+			clone->AddFriend(CloneFriend(friendElement->GetTree()), friendElement->GetName());
+		}
+		delete it;
+	}
+	clone->SetBranchStatus("*", 0);
+	return clone;
+}
+
+void DeleteChain(TTree *chain)
+{
+	if(chain->GetListOfFriends() != NULL) {
+		std::vector<TTree *> friends;
+		TIterator *it = chain->GetListOfFriends()->MakeIterator();
+		for(TFriendElement *friendElement = (TFriendElement *) it->Next(); friendElement != NULL; friendElement = (TFriendElement *) it->Next()) {
+			friends.push_back(friendElement->GetTree());
+		}
+		delete it;
+		for(std::vector<TTree *>::const_iterator friend_itr = friends.begin(); friend_itr != friends.end(); friend_itr++) {
+			chain->RemoveFriend(*friend_itr);
+			DeleteChain(*friend_itr);
+		}
+	}
+	delete chain;
+}
@@ -0,0 +1,213 @@
+#include "../interface/NLLRecorder.hh"
+#include <iostream>
+#include <cstdlib>
+#include <RooRealVar.h>
+#include <TIterator.h>
+
+NLLRecorder::NLLRecorder(TString name, TString title, size_t chunkSize):
+	_name(name), _title(title), _chunkSize(chunkSize > 0 ? chunkSize : 1),
+	_nRows(0), _nSpilled(0), _spillFile(NULL)
+{
+}
+
+NLLRecorder::~NLLRecorder()
+{
+	if(_spillFile != NULL) fclose(_spillFile);
+}
+
+void NLLRecorder::SetParameters(const RooArgSet& params)
+{
+	Clear();
+	_params.removeAll();
+	_paramPtrs.clear();
+	TIterator *it = params.createIterator();
+	for(RooAbsArg *arg = (RooAbsArg *)it->Next(); arg != NULL; arg = (RooAbsArg *)it->Next()) {
+		RooAbsReal *var = dynamic_cast<RooAbsReal *>(arg);
+		if(var == NULL) continue;
+		_params.add(*var);
+		_paramPtrs.push_back(var);
+	}
+	delete it;
+
+	_chunk.values.resize(_paramPtrs.size() * _chunkSize);
+	_chunk.nll.resize(_chunkSize);
+	_chunk.weight.resize(_chunkSize);
+}
+
+void NLLRecorder::Clear()
+{
+	if(_spillFile != NULL) fclose(_spillFile);
+	_spillFile = NULL;
+	_nRows = 0;
+	_nSpilled = 0;
+}
+
+void NLLRecorder::Add(double nll, double weight)
+{
+	if(_nRows == _chunkSize) Spill();
+	for(size_t iParam = 0; iParam < _paramPtrs.size(); iParam++) {
+		_chunk.values[iParam * _chunkSize + _nRows] = _paramPtrs[iParam]->getVal();
+	}
+	_chunk.nll[_nRows] = nll;
+	_chunk.weight[_nRows] = weight;
+	_nRows++;
+}
+
+void NLLRecorder::Add(const RooArgSet& values, double nll, double weight)
+{
+	if(_nRows == _chunkSize) Spill();
+	for(size_t iParam = 0; iParam < _paramPtrs.size(); iParam++) {
+		RooAbsReal *var = dynamic_cast<RooAbsReal *>(values.find(_paramPtrs[iParam]->GetName()));
+		if(var == NULL) var = _paramPtrs[iParam];
+		_chunk.values[iParam * _chunkSize + _nRows] = var->getVal();
+	}
+	_chunk.nll[_nRows] = nll;
+	_chunk.weight[_nRows] = weight;
+	_nRows++;
+}
+
+void NLLRecorder::Spill()
+{
+	if(_spillFile == NULL) {
+		_spillFile = tmpfile();
+		if(_spillFile == NULL) {
+			std::cerr << "[ERROR] Cannot create the spill file of the recorder " << _name << std::endl;
+			exit(1);
+		}
+	}
+	// ReadChunk may have moved the position
+	fseek(_spillFile, 0, SEEK_END);
+	if(fwrite(&_chunk.values[0], sizeof(double), _chunk.values.size(), _spillFile) != _chunk.values.size()
+	        || fwrite(&_chunk.nll[0], sizeof(double), _chunkSize, _spillFile) != _chunkSize
+	        || fwrite(&_chunk.weight[0], sizeof(double), _chunkSize, _spillFile) != _chunkSize) {
+		std::cerr << "[ERROR] Cannot write the spill file of the recorder " << _name << std::endl;
+		exit(1);
+	}
+	_nSpilled += _nRows;
+	_nRows = 0;
+}
+
+const NLLRecorder::chunk_t& NLLRecorder::ReadChunk(size_t iChunk, chunk_t& buffer) const
+{
+	if(iChunk == _nSpilled / _chunkSize) return _chunk;
+
+	long chunkBytes = (_chunk.values.size() * sizeof(double) + 2 * _chunkSize * sizeof(double));
+	buffer.values.resize(_chunk.values.size());
+	buffer.nll.resize(_chunkSize);
+	buffer.weight.resize(_chunkSize);
+	if(fseek(_spillFile, iChunk * chunkBytes, SEEK_SET) != 0
+	        || fread(&buffer.values[0], sizeof(double), buffer.values.size(), _spillFile) != buffer.values.size()
+	        || fread(&buffer.nll[0], sizeof(double), _chunkSize, _spillFile) != _chunkSize
+	        || fread(&buffer.weight[0], sizeof(double), _chunkSize, _spillFile) != _chunkSize) {
+		std::cerr << "[ERROR] Cannot read the spill file of the recorder " << _name << std::endl;
+		exit(1);
+	}
+	return buffer;
+}
+
+template<class F> void NLLRecorder::Loop(RooArgList& values, F f) const
+{
+	chunk_t buffer;
+	size_t nChunks = _nSpilled / _chunkSize + 1;
+	for(size_t iChunk = 0; iChunk < nChunks; iChunk++) {
+		const chunk_t& chunk = ReadChunk(iChunk, buffer);
+		size_t nRows = (iChunk + 1 == nChunks) ? _nRows : _chunkSize;
+		for(size_t iRow = 0; iRow < nRows; iRow++) {
+			for(int iParam = 0; iParam < values.getSize(); iParam++) {
+				((RooRealVar *) values.at(iParam))->setVal(chunk.values[iParam * _chunkSize + iRow]);
+			}
+			f(chunk.nll[iRow], chunk.weight[iRow]);
+		}
+	}
+}
+
+void NLLRecorder::GetSlice(const RooAbsArg& free, size_t nLast, std::vector<double>& x, std::vector<double>& nll) const
+{
+	x.clear();
+	nll.clear();
+	int iFree = -1;
+	std::vector<double> current(_paramPtrs.size());
+	for(size_t iParam = 0; iParam < _paramPtrs.size(); iParam++) {
+		current[iParam] = _paramPtrs[iParam]->getVal();
+		if(TString(_paramPtrs[iParam]->GetName()) == free.GetName()) iFree = iParam;
+	}
+	if(iFree < 0) return;
+
+	size_t first = (Size() > nLast) ? Size() - nLast : 0;
+	size_t lastChunk = _nSpilled / _chunkSize;
+	chunk_t buffer;
+	for(size_t iChunk = first / _chunkSize; iChunk <= lastChunk; iChunk++) {
+		const chunk_t& chunk = ReadChunk(iChunk, buffer);
+		size_t nRows = (iChunk == lastChunk) ? _nRows : _chunkSize;
+		for(size_t iRow = (iChunk == first / _chunkSize) ? first % _chunkSize : 0; iRow < nRows; iRow++) {
+			bool same = true;
+			for(size_t iParam = 0; iParam < _paramPtrs.size() && same; iParam++) {
+				same = ((int)iParam == iFree || chunk.values[iParam * _chunkSize + iRow] == current[iParam]);
+			}
+			if(!same) continue;
+			x.push_back(chunk.values[iFree * _chunkSize + iRow]);
+			nll.push_back(chunk.nll[iRow]);
+		}
+	}
+}
+
+RooStats::MarkovChain *NLLRecorder::GetMarkovChain() const
+{
+	RooArgSet *snapshot = (RooArgSet *) RooArgSet(_params).snapshot(kFALSE);
+	RooArgList values;
+	for(size_t iParam = 0; iParam < _paramPtrs.size(); iParam++) values.add(*snapshot->find(_paramPtrs[iParam]->GetName()));
+
+	RooStats::MarkovChain *chain = new RooStats::MarkovChain();
+	chain->SetParameters(*snapshot);
+	Loop(values, [&](double nll, double weight) {
+		chain->AddFast(*snapshot, nll, weight);
+	});
+	delete snapshot;
+	return chain;
+}
+
+RooDataSet *NLLRecorder::GetDataSet() const
+{
+	RooArgSet *snapshot = (RooArgSet *) RooArgSet(_params).snapshot(kFALSE);
+	RooArgList values;
+	for(size_t iParam = 0; iParam < _paramPtrs.size(); iParam++) values.add(*snapshot->find(_paramPtrs[iParam]->GetName()));
+
+	RooRealVar nllVar("nll", "", 0, 1e20);
+	RooDataSet *dataset = new RooDataSet(_name, _title, RooArgSet(*snapshot, nllVar));
+	Loop(values, [&](double nll, double weight) {
+		nllVar.setVal(nll);
+		dataset->add(RooArgSet(*snapshot, nllVar));
+	});
+	delete snapshot;
+	return dataset;
+}
+
+RooDataSet *NLLRecorder::GetAsDataSet() const
+{
+	RooStats::MarkovChain *chain = GetMarkovChain();
+	RooDataSet *dataset = chain->GetAsDataSet();
+	delete chain;
+	return dataset;
+}
+
+Int_t NLLRecorder::Write(const char *name) const
+{
+	RooStats::MarkovChain *chain = GetMarkovChain();
+	Int_t nBytes = chain->Write(name);
+	delete chain;
+	return nBytes;
+}
+
+void NLLRecorder::SaveAs(TString fileName) const
+{
+	RooStats::MarkovChain *chain = GetMarkovChain();
+	chain->SaveAs(fileName);
+	delete chain;
+}
+
+void NLLRecorder::WriteDataSet() const
+{
+	RooDataSet *dataset = GetDataSet();
+	dataset->Write();
+	delete dataset;
+}
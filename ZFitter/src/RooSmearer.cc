@@ -7,10 +7,53 @@
 //#define MEM_DEBUG
 #include <TSystem.h>
 #include <TIterator.h>
+#include <TROOT.h>
+#include "../interface/ParallelFor.hh"
+#include "../interface/SmearingKernel.hh"
+#include "../interface/CounterRNG.hh"
+#include <RooRealVar.h>
+#include <thread>
+#include <algorithm>
+#include <limits>
+#include <iterator>
+
+namespace
+{
+/// bin contents, errors and entries of a smeared histogram, kept without the TH1F (results of the parallel jobs)
+class histoContent_t
+{
+public:
+	std::vector<float> content;
+	std::vector<double> sumw2;
+	double entries;
+
+	void Save(const TH1F *h)
+	{
+		content.resize(h->GetNbinsX() + 2);
+		for(int bin = 0; bin <= h->GetNbinsX() + 1; bin++) content[bin] = h->GetBinContent(bin);
+		const TArrayD *sumw2From = h->GetSumw2();
+		sumw2.assign(sumw2From->fArray, sumw2From->fArray + sumw2From->fN);
+		entries = h->GetEntries();
+	};
+	/// same binning as the saved histogram
+	void Load(TH1F *h) const
+	{
+		for(int bin = 0; bin <= h->GetNbinsX() + 1; bin++) h->SetBinContent(bin, content[bin]);
+		TArrayD *sumw2To = h->GetSumw2();
+		if(sumw2To->fN == (int) sumw2.size()) std::copy(sumw2.begin(), sumw2.end(), sumw2To->fArray);
+		h->SetEntries(entries);
+	};
+};
+}
 
 RooSmearer::~RooSmearer(void)
 {
-
+	// the categories are copied in ZeeCategories: the generator is deleted here and not by ~ZeeCategory
+	for(std::vector<ZeeCategory>::iterator cat_itr = ZeeCategories.begin(); cat_itr != ZeeCategories.end(); cat_itr++) {
+		delete cat_itr->rgen;
+		cat_itr->rgen = NULL;
+	}
+	for(std::vector<TH1F *>::iterator h_itr = _scratchHistos.begin(); h_itr != _scratchHistos.end(); h_itr++) delete *h_itr;
 }
 
 RooSmearer::RooSmearer(const RooSmearer& old, const char* newname)
@@ -35,9 +78,9 @@ RooSmearer::RooSmearer(const char *name,  ///< name of the variable
 	_paramSet("paramSet", "Set of parameters", this),
 	invMass_min_(80), invMass_max_(100), invMass_bin_(0.25),
 	deltaNLLMaxSmearToy(330),
-	_deactive_minEventsDiag(1000), _deactive_minEventsOffDiag(1500), _nSmearToy(20),
+	_deactive_minEventsDiag(1000), _deactive_minEventsOffDiag(1500), _nSmearToy(20), _nThreads(1), _nllCacheSize(500), _likelihoodType(kBinomial),
 	nllBase(0),
-	nllVar("nll", "", 0, 1e20),
+	_mcFractionsEnabled(false), _mcFraction(1), _mcFractionStart(0),
 	_isDataSmeared(false),
 	_autoBin(false),
 	_autoNsmear(false),
@@ -95,8 +138,25 @@ void RooSmearer::SetCache(Long64_t nEvents, bool cacheToy, bool externToy)
 {
 	std::cout << "------------------------------------------------------------" << std::endl;
 	std::cout << "[STATUS] Importing cache events" << std::endl;
+	if(!data_events_cache.empty() && !mc_events_cache.empty()) {
+		std::cout << "[STATUS] --- Using the event caches set by SetEventCaches" << std::endl;
+		return;
+	}
 
-	if(data_events_cache.empty()) {
+	// data and MC read different chains: the data are imported in a separate thread with their own importer,
+	// the threads are shared between the data and the mc import
+	std::thread dataImport;
+	SmearingImporter dataImporter(importer);
+	if(data_events_cache.empty() && !cacheToy && _nThreads > 1) {
+		unsigned int nDataThreads = _nThreads / 2;
+		std::cout << "[STATUS] --- Setting cache for data (in parallel with mc, " << nDataThreads << " threads for data, "
+		          << _nThreads - nDataThreads << " for mc)" << std::endl;
+		dataImporter.SetNThreads(nDataThreads);
+		importer.SetNThreads(_nThreads - nDataThreads);
+		dataImport = std::thread([this, nEvents, &dataImporter]() {
+			data_events_cache = dataImporter.GetCache(_data_chain, false, false, nEvents);
+		});
+	} else if(data_events_cache.empty()) {
 		if(cacheToy) {
 			std::cout << "[STATUS] --- Setting toy cache for data" << std::endl;
 			data_events_cache = importer.GetCache(_signal_chain, false, false, nEvents, true, externToy); //importer.GetCacheToy(nEvents, false);
@@ -118,6 +178,8 @@ void RooSmearer::SetCache(Long64_t nEvents, bool cacheToy, bool externToy)
 			mc_events_cache = importer.GetCache(_signal_chain, true, false, nEvents);
 		}
 	}
+	if(dataImport.joinable()) dataImport.join();
+	importer.SetNThreads(_nThreads);
 
 
 #ifdef DEBUG
@@ -153,12 +215,14 @@ void RooSmearer::InitCategories(bool mcToy)
 //       }
 			cat.data_events = &(data_events_cache[index]);
 			cat.mc_events = &(mc_events_cache[index]);
+			cat.nEventsMC = cat.mc_events->size();
 
 			cat.categoryName1 += *region_ele1_itr;
 			cat.categoryName2 += *region_ele2_itr;
 
 			cat.pars1.add(_params_vec[cat.categoryIndex1]);
 			cat.pars2.add(_params_vec[cat.categoryIndex2]);
+			SetCategoryVars(cat);
 
 			cat.scale1 = 1;
 			cat.alpha1 = 0;
@@ -181,6 +245,9 @@ void RooSmearer::InitCategories(bool mcToy)
 			cat.invMass_min = invMass_min_;
 			cat.invMass_max = invMass_max_;
 
+			// fixed seed per category: the result does not depend on the number of threads
+			cat.rgen = new TRandom3(12345 + index);
+
 #ifdef DEBUG
 			std::cout << "[DEBUG] Cat ele1: " << cat.categoryName1 << "\t" << cat.categoryIndex1 << std::endl;
 			cat.pars1.Print();
@@ -210,7 +277,7 @@ void RooSmearer::InitCategories(bool mcToy)
 					SetSmearedHisto(*(cat.data_events),
 					                cat.pars1, cat.pars2,
 					                cat.categoryName1, cat.categoryName2, 1,
-					                cat.smearHist_data);
+					                cat.smearHist_data, cat.rgen);
 				}
 			}
 
@@ -341,12 +408,12 @@ TH1F *RooSmearer::GetSmearedHisto(ZeeCategory & category, bool isMC,
 			SetSmearedHisto(*cache,
 			                category.pars1, category.pars2,
 			                category.categoryName1, category.categoryName2, category.nSmearToy,
-			                *h);
+			                *h, category.rgen, category.nEventsMC);
 		} else {
 			SetSmearedHisto(*cache,
 			                category.pars1, category.pars2,
 			                category.categoryName1, category.categoryName2, 1,
-			                *h);
+			                *h, category.rgen, isMC ? category.nEventsMC : cache->size());
 		}
 		if(isMC) (*h)->Scale(1. / (*h)->Integral());
 		//} //else  std::cout << "Not changed: " << category.categoryName1 << "\t" << category.categoryName2 << std::endl;
@@ -374,12 +441,12 @@ void RooSmearer::SetHisto(const zee_events_t& cache, TH1F * hist) const
 	hist->Print();
 #endif
 	hist->Reset();
-	for(zee_events_t::const_iterator event_itr = cache.begin();
-	        event_itr != cache.end();
-	        event_itr++) {
-		hist->Fill( event_itr->invMass,
-		            //sqrt(2 * event_itr->energy_ele1 * event_itr->energy_ele2 * event_itr->angle_eta_ele1_ele2),
-		            event_itr->weight);
+	const float *invMass = cache.invMass.data();
+	const float *weight = cache.weight.data();
+	for(size_t iEvent = 0; iEvent < cache.size(); iEvent++) {
+		hist->Fill( invMass[iEvent],
+		            //sqrt(2 * energy_ele1 * energy_ele2 * angle_eta_ele1_ele2),
+		            weight[iEvent]);
 	}
 #ifdef DEBUG
 	hist->Print();
@@ -391,12 +458,8 @@ void RooSmearer::SetHisto(const zee_events_t& cache, TH1F * hist) const
 void RooSmearer::SetSmearedHisto(const zee_events_t& cache,
                                  RooArgSet pars1, RooArgSet pars2,
                                  TString categoryName1, TString categoryName2, unsigned int nSmearToy,
-                                 TH1F * hist) const
+                                 TH1F * hist, TRandom3 * gen, size_t nEvents) const
 {
-#ifdef CPU_DEBUG
-	//  myClock->Stop(); myClock->Start();
-#endif
-
 	// retrieve values from params for the category
 	float scale1 = pars1.getRealValue("scale_" + categoryName1, 0., kTRUE);
 	float constant1 = pars1.getRealValue("constTerm_" + categoryName1, 0., kTRUE);
@@ -413,37 +476,46 @@ void RooSmearer::SetSmearedHisto(const zee_events_t& cache,
 	//std::cout << "---" << std::endl;
 	//_paramSet.writeToStream(std::cout, kFALSE);
 #endif
-//   if(nSmearToy>NSMEARTOYLIM){
-//     std::cerr << "[ERROR] nSmearToy = " << nSmearToy << std::endl;
-//     exit(1);
-//   }
+	SetSmearedHisto(cache, scale1, alpha1, constant1, scale2, alpha2, constant2, nSmearToy, hist, gen, nEvents);
+	return;
+}
 
-	//double smearEne1[NSMEARTOYLIM], smearEne2[NSMEARTOYLIM]; // _nSmearToy<100
-	double smearEne1[1000], smearEne2[1000]; // _nSmearToy<100
-	if(cache.begin()->smearings_ele1 == NULL) {
-		std::cerr << "[ERROR] No smearings" << std::endl;
-		exit(1);
-	}
-	for(zee_events_t::const_iterator event_itr = cache.begin();
-	        event_itr != cache.end();
-	        event_itr++) {
-
-		//#ifdef FIXEDSMEARINGS
-		smearedEnergy(smearEne1, nSmearToy, event_itr->energy_ele1, scale1, alpha1, constant1, event_itr->smearings_ele1);
-		smearedEnergy(smearEne2, nSmearToy, event_itr->energy_ele2, scale2, alpha2, constant2, event_itr->smearings_ele2);
-		//#else
-		//	// random gen time is consuming!!! test different _nSmearToy to verify
-		//    smearedEnergy(smearEne1, nSmearToy, event_itr->energy_ele1, scale1, alpha1, constant1,NULL);
-		//    smearedEnergy(smearEne2, nSmearToy, event_itr->energy_ele2, scale2, alpha2, constant2,NULL);
-		//#endif
-//     if(event_itr==cache.begin()){
-//       std::cout << "fixedSmearings: " << event_itr->smearings_ele1[0] << "\t"  << scale1 << "\t" << alpha1 << "\t" << event_itr->energy_ele1 << "\t" << constant1 << "\t" << smearEne1[0] << std::endl;
-//     }
-		for(unsigned int iSmearToy = 0; iSmearToy < nSmearToy; iSmearToy++) {
-			hist->Fill(event_itr->invMass * sqrt(smearEne1[iSmearToy] * smearEne2[iSmearToy]),
-			           event_itr->weight);
-		}
+void RooSmearer::SetSmearedHisto(const zee_events_t& cache,
+                                 float scale1, float alpha1, float constant1,
+                                 float scale2, float alpha2, float constant2,
+                                 unsigned int nSmearToy,
+                                 TH1F * hist, TRandom3 * gen, size_t nEvents) const
+{
+#ifdef CPU_DEBUG
+	//  myClock->Stop(); myClock->Start();
+#endif
+
+	// any number of toys: the smearings are regenerated for each event
+	std::vector<double> smearEne1(nSmearToy), smearEne2(nSmearToy);
+	std::vector<double> normals1(nSmearToy), normals2(nSmearToy);
+	const float *energy_ele1 = cache.energy_ele1.data();
+	const float *energy_ele2 = cache.energy_ele2.data();
+	const float *invMass = cache.invMass.data();
+	const float *weight = cache.weight.data();
+	const uint64_t *eventKey = cache.eventKey.data();
+	SmearingKernel kernel(hist);
+	nEvents = std::min(nEvents, cache.size());
+	for(size_t iEvent = 0; iEvent < nEvents; iEvent++) {
+
+#ifdef FIXEDSMEARINGS
+		// same N(0,1) deviates at each evaluation: the likelihood is a smooth function of the parameters
+		CounterRNG::Normals(eventKey[iEvent], 0, nSmearToy, normals1.data());
+		CounterRNG::Normals(eventKey[iEvent], 1, nSmearToy, normals2.data());
+		smearedEnergy(smearEne1.data(), nSmearToy, energy_ele1[iEvent], scale1, alpha1, constant1, normals1.data(), gen);
+		smearedEnergy(smearEne2.data(), nSmearToy, energy_ele2[iEvent], scale2, alpha2, constant2, normals2.data(), gen);
+#else
+		// random gen time is consuming!!! test different _nSmearToy to verify
+		smearedEnergy(smearEne1.data(), nSmearToy, energy_ele1[iEvent], scale1, alpha1, constant1, NULL, gen);
+		smearedEnergy(smearEne2.data(), nSmearToy, energy_ele2[iEvent], scale2, alpha2, constant2, NULL, gen);
+#endif
+		kernel.Fill(invMass[iEvent], weight[iEvent], smearEne1.data(), smearEne2.data(), nSmearToy);
 	}
+	kernel.CopyTo(hist); // the previous content of the histogram is replaced
 	hist->Scale(1. / nSmearToy);
 //   if(hist->GetEntries()<hist->Integral()){
 //     hist->Print();
@@ -461,7 +533,7 @@ void RooSmearer::SetSmearedHisto(const zee_events_t& cache,
 
 
 
-double RooSmearer::smearedEnergy(double * smear, unsigned int nGen, float ene, float scale, float alpha, float constant, const float * fixedSmearings) const
+double RooSmearer::smearedEnergy(double * smear, unsigned int nGen, float ene, float scale, float alpha, float constant, const double * normals, TRandom3 * gen) const
 {
 	// sigmaMB = sigma Material Budget
 	// if I want to take into account the non perfet simulation of the
@@ -480,18 +552,15 @@ double RooSmearer::smearedEnergy(double * smear, unsigned int nGen, float ene, f
 			smear[i] = scale;
 		}
 	} else {
-#ifdef FIXEDSMEARINGS
-		for(unsigned int i = 0; i < NSMEARTOYLIM && i < nGen; i++) {
-			smear[i] = (double) (fixedSmearings[i] * sigma) + (scale);
-		}
-		for(unsigned int i = NSMEARTOYLIM; i < nGen; i++) {
-			smear[i] = rgen_->Gaus(scale, sigma);
-		}
-#else
-		for(unsigned int i = 0; i < nGen; i++) {
-			smear[i] = rgen_->Gaus(scale, sigma);
+		if(normals != NULL) {
+			for(unsigned int i = 0; i < nGen; i++) {
+				smear[i] = normals[i] * sigma + scale;
+			}
+		} else {
+			for(unsigned int i = 0; i < nGen; i++) {
+				smear[i] = gen->Gaus(scale, sigma);
+			}
 		}
-#endif
 	}
 	return smear[0];
 }
@@ -509,67 +578,64 @@ double RooSmearer::getLogLikelihood(TH1F * data, TH1F * prob) const
 		return -9999999.;
 	}
 
-#ifdef FUNC_DEBUG
-	//  std::cout << "Probability integral " << prob->Integral() << std::endl;
-#endif
+	// raw bin arrays (bin 0 is the underflow): no virtual call per bin
+	const int nBins = data->GetNbinsX();
+	const float *d = data->GetArray() + 1;
+	const float *p = prob->GetArray() + 1;
+	const TArrayD *sumw2Array = data->GetSumw2();
+	const double *sumw2 = (sumw2Array->fN == nBins + 2) ? sumw2Array->fArray + 1 : NULL;
 
-	//   if (fabs(prob->Integral() -1 ) > 1e-4 )
-	//     {
-	//       std::cout << "ERROR: probabilities are not properly normalized" << std::endl;
-	//       return -9999999.;
-	//     }
-
-	double logL = 0.;
 	//Not using underflows and overflows at the moment
-	for (int ibin = 1; ibin < data->GetNbinsX() + 1; ++ibin) {
-#ifdef FUNC_DEBUG
-		std::cout << "ibin " << ibin << "\tdata " << data->GetBinContent(ibin) << "\texpected " << prob->GetBinContent(ibin) << "\t MC " << prob->GetBinContent(ibin) * 514 << "\tlogL " << logL; //<< std::endl;
-		std::cout << std::fixed;
-		std::cout << setprecision(10) << "\tdeltaLogL =  " <<
-		          data->GetBinContent(ibin)* ROOT::Math::Util::EvalLog(prob->GetBinContent(ibin)) + (data->Integral() - data->GetBinContent(ibin))*ROOT::Math::Util::EvalLog(1 - prob->GetBinContent(ibin)) << "\t EvalLog = " << ROOT::Math::Util::EvalLog(prob->GetBinContent(ibin)) << std::endl;
+	double integral = 0.;
+	for (int i = 0; i < nBins; ++i) integral += d[i];
 
-#endif
-
-		//original version
-//      if(prob->GetBinContent(ibin)!=0){
-//
-//	double weight= 	(data->GetBinContent(ibin)>0) ? data->GetBinError(ibin) * data->GetBinError(ibin) / data->GetBinContent(ibin) : 1;
-//	//	std::cout << "weight = " << weight << std::endl;
-//#ifdef POISSON_LIKELIHOOD
-//	//Poisson likelihood
-//	logL+=  weight * (data->GetBinContent(ibin)* ROOT::Math::Util::EvalLog(prob->GetBinContent(ibin)) - prob->GetBinContent(ibin));
-//#else
-		// Binomial likelihood
-		if(prob->GetBinContent(ibin) > 0) {
-			double weight = 	(data->GetBinContent(ibin) > 0) ? data->GetBinError(ibin) * data->GetBinError(ibin) / data->GetBinContent(ibin) : 1;
-			logL += weight * (data->GetBinContent(ibin) * ROOT::Math::Util::EvalLog(prob->GetBinContent(ibin)) + (data->Integral() - data->GetBinContent(ibin)) * ROOT::Math::Util::EvalLog(1 - prob->GetBinContent(ibin)));
+	// effective weight of the data events in the bin: sumw2/sumw (1 if unweighted)
+	double logL = 0.;
+	switch(_likelihoodType) {
+	case kBinomial:
+		for (int i = 0; i < nBins; ++i) {
+			if(p[i] <= 0) continue;
+			double weight = (sumw2 != NULL && d[i] > 0) ? sumw2[i] / d[i] : 1;
+			logL += weight * (d[i] * ROOT::Math::Util::EvalLog(p[i]) + (integral - d[i]) * ROOT::Math::Util::EvalLog(1 - p[i]));
 		}
-		//#endif
-		//	}
-
-		//Multinomial
-		//if(prob->GetBinContent(ibin)>0){
-		//double weight= 	(data->GetBinContent(ibin)>0) ? data->GetBinError(ibin) * data->GetBinError(ibin) / data->GetBinContent(ibin) : 1;
-		//double weight=1;
-		//logL+= weight * (data->GetBinContent(ibin)* ROOT::Math::Util::EvalLog(prob->GetBinContent(ibin)));
-		//}
-
-#ifdef DEBUG
-		else {
-			std::cout << "MC ibin = 0: "
-			          << "ibin " << ibin << "\tdata " << data->GetBinContent(ibin)
-			          << "\texpected " << prob->GetBinContent(ibin)
-			          << "\tlogL " << logL
-			          << "\tdeltaLogL =  " <<
-			          data->GetBinContent(ibin)* ROOT::Math::Util::EvalLog(prob->GetBinContent(ibin)) + (data->Integral() - data->GetBinContent(ibin))*ROOT::Math::Util::EvalLog(1 - prob->GetBinContent(ibin))
-			          << "\t EvalLog = " << ROOT::Math::Util::EvalLog(prob->GetBinContent(ibin)) << std::endl;
+		break;
+	case kPoisson:
+		// expected events from the pdf normalized to the data
+		for (int i = 0; i < nBins; ++i) {
+			if(p[i] <= 0) continue;
+			double weight = (sumw2 != NULL && d[i] > 0) ? sumw2[i] / d[i] : 1;
+			double mu = integral * p[i];
+			logL += weight * (d[i] * ROOT::Math::Util::EvalLog(mu) - mu);
 		}
-#endif
+		break;
+	case kMultinomial:
+		for (int i = 0; i < nBins; ++i) {
+			if(p[i] <= 0) continue;
+			double weight = (sumw2 != NULL && d[i] > 0) ? sumw2[i] / d[i] : 1;
+			logL += weight * d[i] * ROOT::Math::Util::EvalLog(p[i]);
+		}
+		break;
 	}
-	//std::cout << "Finale logL = " << logL <<std::endl;
+#ifdef FUNC_DEBUG
+	std::cout << "[DEBUG] logL = " << logL << "\tintegral = " << integral << std::endl;
+#endif
 	return logL;
 }
 
+void RooSmearer::SetLikelihoodType(TString type)
+{
+	type.ToLower();
+	if(type == "binomial") _likelihoodType = kBinomial;
+	else if(type == "poisson") _likelihoodType = kPoisson;
+	else if(type == "multinomial") _likelihoodType = kMultinomial;
+	else {
+		std::cerr << "[ERROR] Likelihood type " << type << " not implemented: use binomial, poisson or multinomial" << std::endl;
+		exit(1);
+	}
+	std::cout << "[INFO] RooSmearer: using the " << type << " likelihood" << std::endl;
+	return;
+}
+
 
 
 double RooSmearer::getCompatibility(bool forceUpdate) const
@@ -596,17 +662,49 @@ double RooSmearer::getCompatibility(bool forceUpdate) const
 	//std::cout << "[DEBUG] Compatibility1: " << compatibility << "\t" << compatibility - nllMin << std::endl;
 	//compatibility=0;
 	bool updated = false;
+	// the parameters are read in the main thread (RooFit is not thread safe),
+	// then the changed categories are smeared in parallel
+	std::vector<ZeeCategory *> changedCategories;
 	for(std::vector<ZeeCategory>::iterator cat_itr = myClass->ZeeCategories.begin();
 	        cat_itr != myClass->ZeeCategories.end();
 	        cat_itr++) {
 		if(!cat_itr->active) continue;
-		if(forceUpdate || isCategoryChanged(*cat_itr, true)) { // && withSmearToy){
+		bool changed = isCategoryChanged(*cat_itr, true); // always called to update the values in the category
+		if(forceUpdate || changed) { // && withSmearToy){
 			updated = true;
 #ifdef DEBUG
 			std::cout << "[DEBUG] " << cat_itr->categoryName1 << " - " << cat_itr->categoryName2 << "\t isupdated" << std::endl;
 #endif
-			myClass->UpdateCategoryNLL(*cat_itr, cat_itr->nLLtoy); //the new nll has been updated for the category
+			// point already evaluated (e.g. profile scans): nll and smeared histogram from the cache
+			if(!forceUpdate && GetCachedNLL(*cat_itr)) continue;
+			changedCategories.push_back(&(*cat_itr));
+			// the data histogram can be smeared with the parameters of the category: filled here
+			dataHistos.push_back(myClass->GetSmearedHisto(*cat_itr, false, _isDataSmeared, true, false));
 		}
+	}
+
+	ParallelFor(_nThreads, changedCategories.size(), [&](size_t iCat) {
+		ZeeCategory *cat = changedCategories[iCat];
+		myClass->UpdateCategoryNLL(*cat, cat->nLLtoy, true, dataHistos[iCat]); //the new nll has been updated for the category
+		SetCachedNLL(*cat); // each category has its own cache: no lock needed
+	});
+
+	compatibility = SumCategoryNLL(updated);
+
+	//  myClock->Stop();
+	//  myClock->Print();
+	return compatibility;
+}
+
+double RooSmearer::SumCategoryNLL(bool updated) const
+{
+	RooSmearer* myClass = (RooSmearer *) this;
+	double compatibility = 0.;
+	// sum in the category order: same result for any number of threads
+	for(std::vector<ZeeCategory>::iterator cat_itr = myClass->ZeeCategories.begin();
+	        cat_itr != myClass->ZeeCategories.end();
+	        cat_itr++) {
+		if(!cat_itr->active) continue;
 		compatibility += cat_itr->nll;
 		myClass->lastNLLrms += (cat_itr->nllRMS * cat_itr->nllRMS);
 #ifdef DEBUG
@@ -616,8 +714,7 @@ double RooSmearer::getCompatibility(bool forceUpdate) const
 	}
 	//if(withSmearToy) std::cout << "[DEBUG] Compatibility2: " << compatibility << "\t" << compatibility - nllMin << std::endl;
 	if(dataset != NULL && updated) {
-		myClass->nllVar.setVal(compatibility);
-		myClass->dataset->add(RooArgSet(_paramSet, nllVar));
+		dataset->Add(compatibility);
 	}
 
 	myClass->lastNLL = compatibility;
@@ -631,15 +728,11 @@ double RooSmearer::getCompatibility(bool forceUpdate) const
 		}
 	}
 
-	//  myClock->Stop();
-	//  myClock->Print();
 	return compatibility;
 }
 
 
 
-
-
 Double_t RooSmearer::evaluate() const
 {
 #ifdef CPU_DEBUG
@@ -671,10 +764,7 @@ Double_t RooSmearer::evaluate() const
 	//#endif
 
 	//_markov.AddFast(*((RooArgSet *)_params.Clone()), comp_mean, 1.);
-	RooSmearer* myClass = (RooSmearer *) this;
-	double weight = (nllBase * 2 - comp_mean);
-	if(weight < 0) weight = 1;
-	myClass->_markov.AddFast(myClass->_paramSet, comp_mean, weight);
+	AddToMarkovChain(comp_mean);
 #ifdef CPU_DEBUG
 	///  myClock->Stop();
 	//  std::cout << "Elapsed time for add to MarkovChain: CPU " << myClock->CpuTime() << "; Real " <<  myClock->RealTime() << " s " << std::endl;
@@ -690,6 +780,110 @@ Double_t RooSmearer::evaluate() const
 
 
 
+std::vector<double> RooSmearer::EvaluatePoints(const RooArgList& vars, const std::vector<std::vector<double> >& points)
+{
+	std::vector<double> nll(points.size());
+	if(_nThreads <= 1) {
+		for(size_t iPoint = 0; iPoint < points.size(); iPoint++) {
+			for(int iVar = 0; iVar < vars.getSize(); iVar++) ((RooRealVar *) vars.at(iVar))->setVal(points[iPoint][iVar]);
+			nll[iPoint] = evaluate();
+		}
+		return nll;
+	}
+
+	class pointJob_t
+	{
+	public:
+		ZeeCategory *cat;
+		TH1F *data;
+		double values[6];
+		double nll, nllRMS;
+		bool cached;
+		histoContent_t mc; ///< smeared MC histogram of the point
+	};
+
+	// the parameters are read in the main thread (RooFit is not thread safe):
+	// the changed categories of each point are found as in a sequence of evaluate()
+	std::vector<pointJob_t> jobs;
+	std::vector<double> startNLL, startNLLRMS; // GetCachedNLL changes the nll of the category
+	for(size_t iCat = 0; iCat < ZeeCategories.size(); iCat++) {
+		startNLL.push_back(ZeeCategories[iCat].nll);
+		startNLLRMS.push_back(ZeeCategories[iCat].nllRMS);
+	}
+	std::vector<size_t> firstJob(points.size() + 1, 0); // jobs of the point iPoint: [firstJob[iPoint], firstJob[iPoint+1])
+	for(size_t iPoint = 0; iPoint < points.size(); iPoint++) {
+		for(int iVar = 0; iVar < vars.getSize(); iVar++) ((RooRealVar *) vars.at(iVar))->setVal(points[iPoint][iVar]);
+		for(std::vector<ZeeCategory>::iterator cat_itr = ZeeCategories.begin();
+		        cat_itr != ZeeCategories.end();
+		        cat_itr++) {
+			if(!cat_itr->active) continue;
+			if(!isCategoryChanged(*cat_itr, true)) continue;
+			pointJob_t job;
+			job.cat = &(*cat_itr);
+			job.data = GetSmearedHisto(*cat_itr, false, _isDataSmeared, true, false);
+			const double values[6] = {cat_itr->scale1, cat_itr->alpha1, cat_itr->constant1,
+			                          cat_itr->scale2, cat_itr->alpha2, cat_itr->constant2
+			                         };
+			std::copy(values, values + 6, job.values);
+			job.cached = GetCachedNLL(*cat_itr);
+			if(job.cached) {
+				job.nll = cat_itr->nll;
+				job.nllRMS = cat_itr->nllRMS;
+				job.mc.Save(cat_itr->smearHist_mc);
+			}
+			jobs.push_back(job);
+		}
+		firstJob[iPoint + 1] = jobs.size();
+	}
+
+	// each worker smears in its own histogram, the result of each point is kept in the job
+	if(!jobs.empty()) AllocateScratchHistos(jobs[0].cat->smearHist_mc);
+	ParallelForWorkers(_nThreads, jobs.size(), [&](size_t iJob, unsigned int iWorker) {
+		pointJob_t& job = jobs[iJob];
+		if(job.cached) return;
+		TH1F *mc = GetScratchHisto(iWorker, job.cat->smearHist_mc);
+		GetCategoryNLL(*job.cat, job.data, job.values, job.cat->nLLtoy, true, mc, job.nll, job.nllRMS);
+		job.mc.Save(mc);
+	});
+
+	// the categories are updated and the NLL summed point by point: same values, cache,
+	// dataset and MarkovChain as evaluate() called for each point
+	for(size_t iCat = 0; iCat < ZeeCategories.size(); iCat++) {
+		ZeeCategories[iCat].nll = startNLL[iCat];
+		ZeeCategories[iCat].nllRMS = startNLLRMS[iCat];
+	}
+	for(size_t iPoint = 0; iPoint < points.size(); iPoint++) {
+		for(int iVar = 0; iVar < vars.getSize(); iVar++) ((RooRealVar *) vars.at(iVar))->setVal(points[iPoint][iVar]);
+		for(size_t iJob = firstJob[iPoint]; iJob < firstJob[iPoint + 1]; iJob++) {
+			pointJob_t& job = jobs[iJob];
+			ZeeCategory& cat = *job.cat;
+			double *values[6] = {&cat.scale1, &cat.alpha1, &cat.constant1,
+			                     &cat.scale2, &cat.alpha2, &cat.constant2
+			                    };
+			for(unsigned int i = 0; i < 6; i++) *values[i] = job.values[i];
+			cat.nll = job.nll;
+			cat.nllRMS = job.nllRMS;
+			job.mc.Load(cat.smearHist_mc);
+			if(!job.cached) SetCachedNLL(cat);
+		}
+		nll[iPoint] = SumCategoryNLL(firstJob[iPoint + 1] > firstJob[iPoint]);
+		AddToMarkovChain(nll[iPoint]);
+	}
+	return nll;
+}
+
+void RooSmearer::AddToMarkovChain(double nll) const
+{
+	RooSmearer* myClass = (RooSmearer *) this;
+	double weight = (nllBase * 2 - nll);
+	if(weight < 0) weight = 1;
+	myClass->_markov.Add(nll, weight);
+	return;
+}
+
+
+
+
 int RooSmearer::Trag_eq(int row, int col, int N) const
 {
 	if (row <= col)
@@ -766,7 +960,7 @@ void RooSmearer::AutoNBins(ZeeCategory & category)
 		SetSmearedHisto(*(category.data_events),
 		                category.pars1, category.pars2,
 		                category.categoryName1, category.categoryName2, 1,
-		                category.smearHist_data);
+		                category.smearHist_data, category.rgen);
 	}
 
 	return;
@@ -829,6 +1023,7 @@ void RooSmearer::AutoNSmear(ZeeCategory & category)
 //   else  if( category.nSmearToy > 40) category.nSmearToy = 40; // fix the max to 20
 	//  category.nSmearToy=NSMEARTOYLIM;
 	if(!smearscan) return;
+	isCategoryChanged(category, true); // UpdateCategoryNLL uses the values stored in the category
 
 	//------------------------------ rescale mc histograms
 	double stdDev = 10, stdDevLim = 0.3;
@@ -1014,62 +1209,118 @@ bool RooSmearer::isCategoryChanged(ZeeCategory & category, bool updateVar) const
 #endif
 	bool changed = false;
 
-	RooArgList argList1(category.pars1);
-	RooArgList argList2(category.pars2);
+	// the parameters have been resolved in SetCategoryVars
+	const RooAbsReal *vars[6] = {category.scaleVar1, category.alphaVar1, category.constVar1,
+	                             category.scaleVar2, category.alphaVar2, category.constVar2
+	                            };
+	double *values[6] = {&category.scale1, &category.alpha1, &category.constant1,
+	                     &category.scale2, &category.alpha2, &category.constant2
+	                    };
 
 	// checking if one of the variables has changed
-	TIterator *it = argList1.createIterator();
-	for(RooRealVar *v = (RooRealVar *) it->Next(); v != NULL; v = (RooRealVar*) it->Next()) {
-		TString varName = v->GetName();
-		double varValue = v->getVal();
-		if(varName.Contains("scale") && varValue != category.scale1) {
-			changed = true;
-#ifdef DEBUG
-			std::cout << "scale changed for: " << category.categoryName1 << "\t" << category.scale1 << "\t" << varValue << "\t" << changed << "\t" << updateVar << std::endl;
-#endif
-			if(updateVar) category.scale1 = varValue;
-		}
-		if(varName.Contains("alpha")     && varValue != category.alpha1) {
+	for(unsigned int i = 0; i < 6; i++) {
+		if(vars[i] == NULL) continue;
+		double varValue = vars[i]->getVal();
+		if(varValue != *values[i]) {
 			changed = true;
 #ifdef DEBUG
-			std::cout << "alpha changed for: " << category.categoryName1 << "\t" << category.alpha1 << "\t" << varValue << "\t" << changed << std::endl;
+			std::cout << vars[i]->GetName() << " changed for: " << category.categoryName1 << " " << category.categoryName2 << "\t" << *values[i] << "\t" << varValue << "\t" << updateVar << std::endl;
 #endif
-			if(updateVar) category.alpha1 = varValue;
-		}
-		if(varName.Contains("constTerm") && varValue != category.constant1) {
-			changed = true;
-#ifdef DEBUG
-			std::cout << "alpha changed for: " << category.categoryName1 << "\t" << category.constant1 << "\t" << varValue << "\t" << changed << std::endl;
-#endif
-			if(updateVar) category.constant1 = varValue;
+			if(updateVar) *values[i] = varValue;
 		}
 	}
 
+	return changed;
+}
+
+void RooSmearer::SetCategoryVars(ZeeCategory & category) const
+{
+	RooArgList argList1(category.pars1);
+	RooArgList argList2(category.pars2);
+
+	TIterator *it = argList1.createIterator();
+	for(RooAbsReal *v = (RooAbsReal *) it->Next(); v != NULL; v = (RooAbsReal*) it->Next()) {
+		TString varName = v->GetName();
+		if(varName.Contains("scale"))     category.scaleVar1 = v;
+		if(varName.Contains("alpha"))     category.alphaVar1 = v;
+		if(varName.Contains("constTerm")) category.constVar1 = v;
+	}
 	delete it;
+
 	it = argList2.createIterator();
-	for(RooRealVar *v = (RooRealVar *) it->Next(); v != NULL; v = (RooRealVar*) it->Next()) {
+	for(RooAbsReal *v = (RooAbsReal *) it->Next(); v != NULL; v = (RooAbsReal*) it->Next()) {
 		TString varName = v->GetName();
-		double varValue = v->getVal();
+		if(varName.Contains("scale"))     category.scaleVar2 = v;
+		if(varName.Contains("alpha"))     category.alphaVar2 = v;
+		if(varName.Contains("constTerm")) category.constVar2 = v;
+	}
+	delete it;
+	return;
+}
 
-		if(varName.Contains("scale")     && varValue != category.scale2) {
-			changed = true;
-			if(updateVar) category.scale2 = varValue;
-		}
-		if(varName.Contains("alpha")     && varValue != category.alpha2) {
-			changed = true;
-			if(updateVar) category.alpha2 = varValue;
-		}
-		if(varName.Contains("constTerm") && varValue != category.constant2) {
-			changed = true;
-			if(updateVar) category.constant2 = varValue;
+ZeeCategory::nllCacheKey_t RooSmearer::GetNLLCacheKey(const ZeeCategory & category) const
+{
+	ZeeCategory::nllCacheKey_t key = {{
+			category.scale1, category.alpha1, category.constant1,
+			category.scale2, category.alpha2, category.constant2,
+			(double) category.nSmearToy, (double) category.nLLtoy
 		}
+	};
+	return key;
+}
+
+bool RooSmearer::GetCachedNLL(ZeeCategory & category) const
+{
+	if(_nllCacheSize == 0) return false;
+	std::map<ZeeCategory::nllCacheKey_t, ZeeCategory::nllCacheEntry_t>::const_iterator entry_itr = category.nllCache.find(GetNLLCacheKey(category));
+	if(entry_itr == category.nllCache.end()) return false;
+
+	const ZeeCategory::nllCacheEntry_t& entry = entry_itr->second;
+	TH1F *mc = category.smearHist_mc;
+	if(entry.smearHist_mc.size() != (size_t) mc->GetNbinsX() + 2) return false; // binning changed
+
+	category.nll = entry.nll;
+	category.nllRMS = entry.nllRMS;
+	double entries = mc->GetEntries();
+	for(int bin = 0; bin <= mc->GetNbinsX() + 1; bin++) mc->SetBinContent(bin, entry.smearHist_mc[bin]);
+	TArrayD *sumw2 = mc->GetSumw2();
+	if(sumw2->fN == mc->GetNbinsX() + 2) {
+		for(int bin = 0; bin <= mc->GetNbinsX() + 1; bin++) sumw2->fArray[bin] = entry.smearHist_mc_sumw2[bin];
 	}
+	mc->SetEntries(entries);
+	return true;
+}
 
-	delete it;
-	return changed;
+void RooSmearer::SetCachedNLL(ZeeCategory & category) const
+{
+	if(_nllCacheSize == 0) return;
+	if(category.nllCache.size() >= _nllCacheSize) category.nllCache.clear(); // keep the memory bounded
+
+	ZeeCategory::nllCacheEntry_t& entry = category.nllCache[GetNLLCacheKey(category)];
+	TH1F *mc = category.smearHist_mc;
+	entry.nll = category.nll;
+	entry.nllRMS = category.nllRMS;
+	entry.smearHist_mc.resize(mc->GetNbinsX() + 2);
+	entry.smearHist_mc_sumw2.resize(mc->GetNbinsX() + 2, 0.);
+	const TArrayD *sumw2 = mc->GetSumw2();
+	for(int bin = 0; bin <= mc->GetNbinsX() + 1; bin++) {
+		entry.smearHist_mc[bin] = mc->GetBinContent(bin);
+		if(sumw2->fN == mc->GetNbinsX() + 2) entry.smearHist_mc_sumw2[bin] = sumw2->fArray[bin];
+	}
+	return;
 }
 
 
+void RooSmearer::SetNThreads(unsigned int nThreads)
+{
+	if(nThreads == 0) nThreads = 1;
+	if(nThreads > 1) ROOT::EnableThreadSafety();
+	_nThreads = nThreads;
+	importer.SetNThreads(nThreads);
+	std::cout << "[INFO] RooSmearer: using " << _nThreads << " threads for the event import and the NLL evaluation" << std::endl;
+	return;
+}
+
 void RooSmearer::SetNSmear(unsigned int n_smear, unsigned int nlltoy)
 {
 
@@ -1098,7 +1349,9 @@ void RooSmearer::Init(TString commonCut, TString eleID, Long64_t nEvents, bool m
 	SetCommonCut(commonCut);
 	SetEleID(eleID);
 	SetCache(nEvents, mcToy, externToy);
+	if(_mcFractionsEnabled) SortMCByFraction();
 	InitCategories(mcToy);
+	if(_mcFraction < 1) SetMCFraction(_mcFraction);
 	TStopwatch cl;
 	cl.Start();
 	evaluate();
@@ -1120,13 +1373,33 @@ void RooSmearer::Init(TString commonCut, TString eleID, Long64_t nEvents, bool m
 	return;
 }
 
-void RooSmearer::UpdateCategoryNLL(ZeeCategory & cat, unsigned int nLLtoy, bool multiSmearToy)
+void RooSmearer::UpdateCategoryNLL(ZeeCategory & cat, unsigned int nLLtoy, bool multiSmearToy, TH1F * data)
 {
-	TH1F *data = GetSmearedHisto(cat, false, _isDataSmeared, true, false); ///-----> not need to repeate! 1 one smearing! otherwise bin errors are wrongly reduced
+	if(data == NULL) data = GetSmearedHisto(cat, false, _isDataSmeared, true, false); ///-----> not need to repeate! 1 one smearing! otherwise bin errors are wrongly reduced
 
+	// regenerate the histogram with the values stored in the category (no access to RooFit from the threads)
+	const double values[6] = {cat.scale1, cat.alpha1, cat.constant1,
+	                          cat.scale2, cat.alpha2, cat.constant2
+	                         };
+	GetCategoryNLL(cat, data, values, nLLtoy, multiSmearToy, cat.smearHist_mc, cat.nll, cat.nllRMS);
+	return;
+}
+
+void RooSmearer::GetCategoryNLL(const ZeeCategory & cat, TH1F * data, const double * values,
+                                unsigned int nLLtoy, bool multiSmearToy, TH1F * mc, double& nll, double& nllRMS) const
+{
 	double comp = 0., comp2 = 0.;
 	for(unsigned int itoy = 0; itoy < nLLtoy; itoy++) {
-		TH1F *mc = GetSmearedHisto(cat, true, true, true, true); // regenerate the histogram: forceNew
+		mc->Reset();
+		if(cat.mc_events->size() != 0) {
+			SetSmearedHisto(*(cat.mc_events),
+			                values[0], values[1], values[2],
+			                values[3], values[4], values[5],
+			                multiSmearToy ? cat.nSmearToy : 1,
+			                mc, cat.rgen, cat.nEventsMC);
+			mc->Scale(1. / mc->Integral());
+			mc->Smooth();
+		}
 
 		double c = getLogLikelihood(data, mc);
 		comp += c;
@@ -1136,8 +1409,340 @@ void RooSmearer::UpdateCategoryNLL(ZeeCategory & cat, unsigned int nLLtoy, bool
 	comp2 /= nLLtoy;
 //   std::cout << std::fixed << setprecision(10) << cat.categoryName1 << "  " << cat.categoryName2
 // 	    << "\t nll - comp = " << cat.nll +comp << std::endl;
-	cat.nll = -comp;
-	cat.nllRMS = sqrt(comp2 - comp * comp);
+	nll = -comp;
+	nllRMS = sqrt(comp2 - comp * comp);
+	return;
+}
+
+void RooSmearer::AllocateScratchHistos(const TH1F * ref)
+{
+	for(size_t iHisto = _scratchHistos.size(); iHisto < std::max(_nThreads, 1u); iHisto++) {
+		TH1F *h = (TH1F *) ref->Clone(TString::Format("scratchHisto_%lu", iHisto));
+		h->SetDirectory(NULL);
+		_scratchHistos.push_back(h);
+	}
+	return;
+}
+
+TH1F *RooSmearer::GetScratchHisto(unsigned int iWorker, const TH1F * ref) const
+{
+	TH1F *h = _scratchHistos[iWorker];
+	if(h->GetNbinsX() != ref->GetNbinsX() || h->GetXaxis()->GetXmin() != ref->GetXaxis()->GetXmin()
+	        || h->GetXaxis()->GetXmax() != ref->GetXaxis()->GetXmax()) {
+		h->SetBins(ref->GetNbinsX(), ref->GetXaxis()->GetXmin(), ref->GetXaxis()->GetXmax());
+	}
+	return h;
+}
+
+std::vector<std::vector<size_t> > RooSmearer::GetDependentCategories(const RooArgList & pars) const
+{
+	std::vector<std::vector<size_t> > dependentCategories(pars.getSize());
+	for(int iPar = 0; iPar < pars.getSize(); iPar++) {
+		const RooAbsArg *par = pars.at(iPar);
+		for(size_t iCat = 0; iCat < ZeeCategories.size(); iCat++) {
+			const ZeeCategory& cat = ZeeCategories[iCat];
+			if(!cat.active) continue;
+			const RooAbsReal *vars[6] = {cat.scaleVar1, cat.alphaVar1, cat.constVar1,
+			                             cat.scaleVar2, cat.alphaVar2, cat.constVar2
+			                            };
+			for(unsigned int i = 0; i < 6; i++) {
+				if(vars[i] != NULL && (vars[i] == par || vars[i]->dependsOn(*par))) {
+					dependentCategories[iPar].push_back(iCat);
+					break;
+				}
+			}
+		}
+	}
+	return dependentCategories;
+}
+
+void RooSmearer::SortMCByFraction()
+{
+	for(size_t iCache = 0; iCache < mc_events_cache.size(); iCache++) {
+		zee_events_t& cache = mc_events_cache[iCache];
+		std::vector<std::pair<double, size_t> > order(cache.size());
+		for(size_t iEvent = 0; iEvent < cache.size(); iEvent++) order[iEvent] = std::make_pair(CounterRNG::EventFraction(cache.eventKey[iEvent]), iEvent);
+		std::sort(order.begin(), order.end());
+
+		zee_events_t sorted;
+		sorted.reserve(cache.size());
+		for(size_t iEvent = 0; iEvent < order.size(); iEvent++) {
+			size_t i = order[iEvent].second;
+			sorted.energy_ele1.push_back(cache.energy_ele1[i]);
+			sorted.energy_ele2.push_back(cache.energy_ele2[i]);
+			sorted.invMass.push_back(cache.invMass[i]);
+			sorted.weight.push_back(cache.weight[i]);
+			sorted.eventKey.push_back(cache.eventKey[i]);
+		}
+		std::swap(cache, sorted);
+	}
+	return;
+}
+
+void RooSmearer::SetMCFraction(double fraction)
+{
+	if(fraction < 1 && !_mcFractionsEnabled) {
+		std::cerr << "[ERROR] RooSmearer::SetMCFraction: EnableMCFractions has to be called before Init" << std::endl;
+		exit(1);
+	}
+	_mcFraction = std::min(fraction, 1.);
+	_mcFractionStart = _markov.Size();
+	std::cout << "[INFO] RooSmearer: using the fraction " << _mcFraction << " of the MC events" << std::endl;
+	for(size_t iCat = 0; iCat < ZeeCategories.size(); iCat++) {
+		ZeeCategory& cat = ZeeCategories[iCat];
+		const zee_events_t& cache = *cat.mc_events;
+		if(_mcFraction >= 1) cat.nEventsMC = cache.size();
+		else { // the events are sorted by fraction: first event with fraction >= _mcFraction
+			size_t first = 0, last = cache.size();
+			while(first < last) {
+				size_t middle = (first + last) / 2;
+				if(CounterRNG::EventFraction(cache.eventKey[middle]) < _mcFraction) first = middle + 1;
+				else last = middle;
+			}
+			cat.nEventsMC = first;
+		}
+		cat.nllCache.clear();
+		// stored values not valid: the category is smeared again at the next evaluation
+		const RooAbsReal *vars[6] = {cat.scaleVar1, cat.alphaVar1, cat.constVar1,
+		                             cat.scaleVar2, cat.alphaVar2, cat.constVar2
+		                            };
+		double *values[6] = {&cat.scale1, &cat.alpha1, &cat.constant1,
+		                     &cat.scale2, &cat.alpha2, &cat.constant2
+		                    };
+		for(unsigned int i = 0; i < 6; i++) {
+			if(vars[i] != NULL) *values[i] = std::numeric_limits<double>::quiet_NaN();
+		}
+	}
+	nllMin = 1e20;
+	nllBase = 0;
+	return;
+}
+
+double RooSmearer::GetMeanEnergy(const RooAbsArg & par) const
+{
+	double sumE = 0, sumW = 0;
+	for(size_t iCat = 0; iCat < ZeeCategories.size(); iCat++) {
+		const ZeeCategory& cat = ZeeCategories[iCat];
+		if(!cat.active || cat.mc_events == NULL) continue;
+		const zee_events_t& cache = *cat.mc_events;
+		bool ele1 = (cat.alphaVar1 != NULL && (cat.alphaVar1 == &par || cat.alphaVar1->dependsOn(par)))
+		            || (cat.constVar1 != NULL && (cat.constVar1 == &par || cat.constVar1->dependsOn(par)));
+		bool ele2 = (cat.alphaVar2 != NULL && (cat.alphaVar2 == &par || cat.alphaVar2->dependsOn(par)))
+		            || (cat.constVar2 != NULL && (cat.constVar2 == &par || cat.constVar2->dependsOn(par)));
+		for(size_t iEvent = 0; iEvent < cache.size(); iEvent++) {
+			if(ele1) {
+				sumE += cache.weight[iEvent] * cache.energy_ele1[iEvent];
+				sumW += cache.weight[iEvent];
+			}
+			if(ele2) {
+				sumE += cache.weight[iEvent] * cache.energy_ele2[iEvent];
+				sumW += cache.weight[iEvent];
+			}
+		}
+	}
+	return (sumW > 0) ? sumE / sumW : 0;
+}
+
+void RooSmearer::GetNLLGradient(const RooArgList & pars, const double * steps,
+                                const std::vector<std::vector<size_t> >& dependentCategories, double * grad)
+{
+	class gradientJob_t
+	{
+	public:
+		ZeeCategory *cat;
+		TH1F *data;
+		double values[6];
+		double nll;
+	};
+
+	// the values of the shifted parameters are read in the main thread (RooFit is not thread safe)
+	std::vector<gradientJob_t> jobs;
+	std::vector<double> xUp(pars.getSize()), xDown(pars.getSize());
+	for(int iPar = 0; iPar < pars.getSize(); iPar++) {
+		RooRealVar *var = (RooRealVar *) pars.at(iPar);
+		double x = var->getVal();
+		for(int sign = 1; sign >= -1; sign -= 2) {
+			var->setVal(x + sign * steps[iPar]);
+			// setVal clips to the range of the variable: the difference is taken on the values actually set
+			(sign > 0 ? xUp : xDown)[iPar] = var->getVal();
+			for(std::vector<size_t>::const_iterator iCat_itr = dependentCategories[iPar].begin();
+			        iCat_itr != dependentCategories[iPar].end();
+			        iCat_itr++) {
+				gradientJob_t job;
+				job.cat = &ZeeCategories[*iCat_itr];
+				// the data histogram is the same for all the jobs: filled once here
+				job.data = GetSmearedHisto(*job.cat, false, _isDataSmeared, true, false);
+				const RooAbsReal *vars[6] = {job.cat->scaleVar1, job.cat->alphaVar1, job.cat->constVar1,
+				                             job.cat->scaleVar2, job.cat->alphaVar2, job.cat->constVar2
+				                            };
+				const double oldValues[6] = {job.cat->scale1, job.cat->alpha1, job.cat->constant1,
+				                             job.cat->scale2, job.cat->alpha2, job.cat->constant2
+				                            };
+				for(unsigned int i = 0; i < 6; i++) job.values[i] = (vars[i] != NULL) ? vars[i]->getVal() : oldValues[i];
+				jobs.push_back(job);
+			}
+		}
+		var->setVal(x);
+	}
+
+	// one scratch histogram per worker, the histograms of the categories are not modified
+	if(!jobs.empty()) AllocateScratchHistos(jobs[0].cat->smearHist_mc);
+	ParallelForWorkers(_nThreads, jobs.size(), [&](size_t iJob, unsigned int iWorker) {
+		gradientJob_t& job = jobs[iJob];
+		double nllRMS;
+		GetCategoryNLL(*job.cat, job.data, job.values, 1, true, GetScratchHisto(iWorker, job.cat->smearHist_mc), job.nll, nllRMS);
+	});
+
+	// sum in the job order: same result for any number of threads
+	std::vector<gradientJob_t>::const_iterator job_itr = jobs.begin();
+	for(int iPar = 0; iPar < pars.getSize(); iPar++) {
+		double nllUp = 0., nllDown = 0.;
+		for(size_t i = 0; i < dependentCategories[iPar].size(); i++, job_itr++) nllUp += job_itr->nll;
+		for(size_t i = 0; i < dependentCategories[iPar].size(); i++, job_itr++) nllDown += job_itr->nll;
+		// one-sided at a limit of the range, 0 if the range is a single point
+		grad[iPar] = (xUp[iPar] > xDown[iPar]) ? (nllUp - nllDown) / (xUp[iPar] - xDown[iPar]) : 0.;
+	}
+	return;
+}
+
+void RooSmearer::GetNLLHessian(const RooArgList & pars, const double * steps,
+                               const std::vector<std::vector<size_t> >& dependentCategories, std::vector<double>& hessian)
+{
+	class hessianJob_t
+	{
+	public:
+		ZeeCategory *cat;
+		TH1F *data;
+		double values[6];
+		double nll;
+	};
+
+	int nPars = pars.getSize();
+	std::vector<hessianJob_t> jobs;
+	std::vector<TH1F *> dataHistos(ZeeCategories.size(), NULL);
+	// job with the current values of the parameters, read in the main thread (RooFit is not thread safe)
+	auto addJob = [&](size_t iCat) {
+		hessianJob_t job;
+		job.cat = &ZeeCategories[iCat];
+		// the data histogram is the same for all the jobs of the category: filled once
+		if(dataHistos[iCat] == NULL) dataHistos[iCat] = GetSmearedHisto(*job.cat, false, _isDataSmeared, true, false);
+		job.data = dataHistos[iCat];
+		const RooAbsReal *vars[6] = {job.cat->scaleVar1, job.cat->alphaVar1, job.cat->constVar1,
+		                             job.cat->scaleVar2, job.cat->alphaVar2, job.cat->constVar2
+		                            };
+		const double oldValues[6] = {job.cat->scale1, job.cat->alpha1, job.cat->constant1,
+		                             job.cat->scale2, job.cat->alpha2, job.cat->constant2
+		                            };
+		for(unsigned int i = 0; i < 6; i++) job.values[i] = (vars[i] != NULL) ? vars[i]->getVal() : oldValues[i];
+		jobs.push_back(job);
+	};
+	// position of iCat in the (ordered) categories of iPar
+	auto position = [&](int iPar, size_t iCat) {
+		return std::lower_bound(dependentCategories[iPar].begin(), dependentCategories[iPar].end(), iCat) - dependentCategories[iPar].begin();
+	};
+
+	// central point: one job per category depending on at least one parameter
+	std::vector<int> centralJob(ZeeCategories.size(), -1);
+	for(int iPar = 0; iPar < nPars; iPar++) {
+		for(size_t i = 0; i < dependentCategories[iPar].size(); i++) {
+			size_t iCat = dependentCategories[iPar][i];
+			if(centralJob[iCat] >= 0) continue;
+			centralJob[iCat] = jobs.size();
+			addJob(iCat);
+		}
+	}
+
+	// x_i +/- h_i: jobs [firstJob[iPar][0], +size) for +h_i, [firstJob[iPar][1], +size) for -h_i
+	// setVal clips to the range of the variable: offsets[iPar] are the distances from x_i actually set
+	std::vector<std::array<size_t, 2> > firstJob(nPars);
+	std::vector<std::array<double, 2> > offsets(nPars);
+	for(int iPar = 0; iPar < nPars; iPar++) {
+		RooRealVar *var = (RooRealVar *) pars.at(iPar);
+		double x = var->getVal();
+		for(unsigned int iSign = 0; iSign < 2; iSign++) {
+			var->setVal(x + (iSign == 0 ? 1 : -1) * steps[iPar]);
+			offsets[iPar][iSign] = fabs(var->getVal() - x);
+			firstJob[iPar][iSign] = jobs.size();
+			for(size_t i = 0; i < dependentCategories[iPar].size(); i++) addJob(dependentCategories[iPar][i]);
+		}
+		var->setVal(x);
+	}
+
+	// (x_i + h_i, x_j + h_j) and (x_i - h_i, x_j - h_j) for the categories shared by i and j
+	class pairJobs_t
+	{
+	public:
+		int iPar, jPar;
+		std::vector<size_t> categories;
+		size_t firstJob[2];
+	};
+	std::vector<pairJobs_t> pairs;
+	for(int iPar = 0; iPar < nPars; iPar++) {
+		for(int jPar = iPar + 1; jPar < nPars; jPar++) {
+			pairJobs_t pair;
+			pair.iPar = iPar;
+			pair.jPar = jPar;
+			std::set_intersection(dependentCategories[iPar].begin(), dependentCategories[iPar].end(),
+			                      dependentCategories[jPar].begin(), dependentCategories[jPar].end(),
+			                      std::back_inserter(pair.categories));
+			if(pair.categories.empty()) continue; // no category depends on both: the term is 0
+
+			RooRealVar *var1 = (RooRealVar *) pars.at(iPar);
+			RooRealVar *var2 = (RooRealVar *) pars.at(jPar);
+			double x1 = var1->getVal(), x2 = var2->getVal();
+			for(unsigned int iSign = 0; iSign < 2; iSign++) {
+				double sign = (iSign == 0) ? 1 : -1;
+				var1->setVal(x1 + sign * steps[iPar]);
+				var2->setVal(x2 + sign * steps[jPar]);
+				pair.firstJob[iSign] = jobs.size();
+				for(size_t i = 0; i < pair.categories.size(); i++) addJob(pair.categories[i]);
+			}
+			var1->setVal(x1);
+			var2->setVal(x2);
+			pairs.push_back(pair);
+		}
+	}
+
+	// one scratch histogram per worker, the histograms of the categories are not modified
+	if(!jobs.empty()) AllocateScratchHistos(jobs[0].cat->smearHist_mc);
+	ParallelForWorkers(_nThreads, jobs.size(), [&](size_t iJob, unsigned int iWorker) {
+		hessianJob_t& job = jobs[iJob];
+		double nllRMS;
+		GetCategoryNLL(*job.cat, job.data, job.values, 1, true, GetScratchHisto(iWorker, job.cat->smearHist_mc), job.nll, nllRMS);
+	});
+
+	// sums in the job order: same result for any number of threads
+	// with u = x_i+ - x_i, d = x_i - x_i-: f'' = 2 (d f(x+) + u f(x-) - (u + d) f(x)) / (u d (u + d)),
+	// the central second difference if u = d; 0 if x_i is at a limit (u or d = 0)
+	hessian.assign(nPars * nPars, 0.);
+	for(int iPar = 0; iPar < nPars; iPar++) {
+		double u = offsets[iPar][0], d = offsets[iPar][1];
+		if(u <= 0 || d <= 0) {
+			std::cerr << "[WARNING] GetNLLHessian: " << pars.at(iPar)->GetName() << " at a limit of its range, second derivative set to 0" << std::endl;
+			continue;
+		}
+		double sum = 0;
+		for(size_t i = 0; i < dependentCategories[iPar].size(); i++) {
+			sum += d * jobs[firstJob[iPar][0] + i].nll + u * jobs[firstJob[iPar][1] + i].nll
+			       - (u + d) * jobs[centralJob[dependentCategories[iPar][i]]].nll;
+		}
+		hessian[iPar * nPars + iPar] = 2 * sum / (u * d * (u + d));
+	}
+	for(std::vector<pairJobs_t>::const_iterator pair_itr = pairs.begin(); pair_itr != pairs.end(); pair_itr++) {
+		int iPar = pair_itr->iPar, jPar = pair_itr->jPar;
+		double sum = 0;
+		for(size_t i = 0; i < pair_itr->categories.size(); i++) {
+			size_t iCat = pair_itr->categories[i];
+			size_t pos1 = position(iPar, iCat), pos2 = position(jPar, iCat);
+			sum += jobs[pair_itr->firstJob[0] + i].nll + jobs[pair_itr->firstJob[1] + i].nll
+			       - jobs[firstJob[iPar][0] + pos1].nll - jobs[firstJob[iPar][1] + pos1].nll
+			       - jobs[firstJob[jPar][0] + pos2].nll - jobs[firstJob[jPar][1] + pos2].nll
+			       + 2 * jobs[centralJob[iCat]].nll;
+		}
+		// the pair points have the same clipped offsets as the single ones: sum = H_ij (u_i u_j + d_i d_j)
+		double norm = offsets[iPar][0] * offsets[jPar][0] + offsets[iPar][1] * offsets[jPar][1];
+		hessian[iPar * nPars + jPar] = hessian[jPar * nPars + iPar] = (norm > 0) ? sum / norm : 0.;
+	}
 	return;
 }
 
@@ -0,0 +1,275 @@
+#include "../interface/SmearerCatClassifier.hh"
+#include <TPRegexp.h>
+#include <TObjArray.h>
+#include <TObjString.h>
+#include <iostream>
+#include <cstdlib>
+#include <math.h>
+#include <memory>
+
+namespace
+{
+enum leaf_t {kEtaEle = 0, kR9Ele, kR9Eleprime, kEnergy, kEtaSCEle, kScaleEle};
+}
+
+SmearerCatClassifier::SmearerCatClassifier(const std::vector<TString>& regions, ElectronCategory_class& cutter, bool isMC, TChain *chain):
+	_chain(chain), _corrEle(cutter._corrEle && !isMC), _energyBranchName(cutter.energyBranchName), _nCompiled(0)
+{
+	_leafNames[kEtaEle] = "etaEle";
+	_leafNames[kR9Ele] = "R9Ele";
+	_leafNames[kR9Eleprime] = "R9Eleprime";
+	_leafNames[kEnergy] = _energyBranchName;
+	_leafNames[kEtaSCEle] = "etaSCEle";
+	_leafNames[kScaleEle] = "scaleEle";
+	for(unsigned int i = 0; i < 6; i++) {
+		_leaves[i] = NULL;
+		_needed[i] = false;
+	}
+
+	for(std::vector<TString>::const_iterator region_itr = regions.begin(); region_itr != regions.end(); region_itr++) {
+		region_t region;
+		region.compiled = Compile(*region_itr, region.cuts);
+		for(unsigned int i = 0; i < 3; i++) region.formulas[i] = NULL;
+		if(region.compiled) {
+			_nCompiled++;
+			for(std::vector<cut_t>::const_iterator cut_itr = region.cuts.begin(); cut_itr != region.cuts.end(); cut_itr++) {
+				switch(cut_itr->quantity) {
+				case kEta:
+				case kAbsEta:
+					_needed[kEtaEle] = true;
+					break;
+				case kR9:
+					_needed[kR9Ele] = true;
+					break;
+				case kR9prime:
+					_needed[kR9Eleprime] = true;
+					break;
+				case kEt:
+					_needed[kEnergy] = _needed[kEtaSCEle] = true;
+					if(_corrEle) _needed[kScaleEle] = true;
+					break;
+				default:
+					break;
+				}
+			}
+		} else {
+			for(int nEle = 0; nEle < 3; nEle++) {
+				region.formulas[nEle] = new TTreeFormula(Form("selector%d-", nEle) + *region_itr, cutter.GetCut(*region_itr, isMC, nEle), chain);
+			}
+		}
+		_regions.push_back(region);
+	}
+
+	// the categories are the ordered pairs i <= j, in the order of the region list
+	int index = 0;
+	_pairIndex.assign(_regions.size(), std::vector<int>(_regions.size(), -1));
+	for(size_t i = 0; i < _regions.size(); i++) {
+		for(size_t j = i; j < _regions.size(); j++) _pairIndex[i][j] = index++;
+	}
+	std::cout << "[INFO] smearerCat: " << _nCompiled << " compiled regions out of " << _regions.size() << std::endl;
+}
+
+SmearerCatClassifier::~SmearerCatClassifier()
+{
+	for(std::vector<region_t>::iterator region_itr = _regions.begin(); region_itr != _regions.end(); region_itr++) {
+		for(unsigned int i = 0; i < 3; i++) delete region_itr->formulas[i];
+	}
+}
+
+bool SmearerCatClassifier::Compile(TString region, std::vector<cut_t>& cuts) const
+{
+	TPRegexp number("^[-+]?([0-9]+\\.?[0-9]*|\\.[0-9]+)([eE][-+]?[0-9]+)?$");
+	cuts.clear();
+
+	// same splitting as ElectronCategory_class::GetCutSet: a token ending with _ is joined to the next one (negative values)
+	std::unique_ptr<TObjArray> splitted(region.Tokenize("-"));
+	for(int i = 0; i < splitted->GetEntries(); i++) {
+		TString string = ((TObjString *) splitted->At(i))->GetString();
+		while(string.EndsWith("_") && i + 1 < splitted->GetEntries()) {
+			string += "-";
+			string += ((TObjString *) splitted->At(++i))->GetString();
+		}
+
+		// the constants of ElectronCategory_class::GetCutSet
+		cut_t cut;
+		if(string == "all") continue;
+		else if(string == "EB") {
+			cut = {kAbsEta, kLT, 1.4442};
+			cuts.push_back(cut);
+		} else if(string == "EBp") {
+			cut = {kEta, kGT, 0};
+			cuts.push_back(cut);
+			cut = {kEta, kLT, 1.4442};
+			cuts.push_back(cut);
+		} else if(string == "EBm") {
+			cut = {kEta, kLT, 0};
+			cuts.push_back(cut);
+			cut = {kEta, kGT, -1.4442};
+			cuts.push_back(cut);
+		} else if(string == "EE") {
+			cut = {kAbsEta, kGT, 1.566};
+			cuts.push_back(cut);
+			cut = {kAbsEta, kLT, 2.5};
+			cuts.push_back(cut);
+		} else if(string == "EEp") {
+			cut = {kEta, kGT, 1.566};
+			cuts.push_back(cut);
+			cut = {kEta, kLT, 2.5};
+			cuts.push_back(cut);
+		} else if(string == "EEm") {
+			cut = {kEta, kLT, -1.566};
+			cuts.push_back(cut);
+			cut = {kEta, kGT, -2.5};
+			cuts.push_back(cut);
+		} else if(string == "gold") {
+			cut = {kR9, kGE, 0.94};
+			cuts.push_back(cut);
+		} else if(string == "bad") {
+			cut = {kR9, kLT, 0.94};
+			cuts.push_back(cut);
+		} else if(string == "highR9") {
+			cut = {kR9prime, kGE, 0.94};
+			cuts.push_back(cut);
+		} else if(string == "lowR9") {
+			cut = {kR9prime, kLT, 0.94};
+			cuts.push_back(cut);
+		} else {
+			// ranges: name_X_Y (or Et_X), X and Y plain numbers as written in the TCut
+			std::unique_ptr<TObjArray> fields(string.Tokenize("_"));
+			int nFields = fields->GetEntries();
+			if(nFields < 2 || nFields > 3) return false;
+			TString name = ((TObjString *) fields->At(0))->GetString();
+			TString min = ((TObjString *) fields->At(1))->GetString();
+			TString max = (nFields == 3) ? ((TObjString *) fields->At(2))->GetString() : TString("");
+			if(!number.MatchB(min) || (nFields == 3 && !number.MatchB(max))) return false;
+
+			quantity_t quantity;
+			if(name == "absEta" && nFields == 3) quantity = kAbsEta;
+			else if(name == "Et") quantity = kEt;
+			else if(name == "R9" && nFields == 3) quantity = kR9;
+			else return false;
+
+			cut = {quantity, kGE, min.Atof()};
+			cuts.push_back(cut);
+			if(nFields == 3) {
+				cut = {quantity, kLT, max.Atof()};
+				cuts.push_back(cut);
+			}
+		}
+	}
+	return true;
+}
+
+void SmearerCatClassifier::UpdateFormulaLeaves()
+{
+	for(std::vector<region_t>::iterator region_itr = _regions.begin(); region_itr != _regions.end(); region_itr++) {
+		for(unsigned int i = 0; i < 3; i++) {
+			if(region_itr->formulas[i] != NULL) region_itr->formulas[i]->UpdateFormulaLeaves();
+		}
+	}
+	for(unsigned int i = 0; i < 6; i++) {
+		if(!_needed[i]) continue;
+		_leaves[i] = _chain->GetLeaf(_leafNames[i]);
+		if(_leaves[i] == NULL) {
+			std::cerr << "[ERROR] Branch " << _leafNames[i] << " not found for smearerCat" << std::endl;
+			exit(1);
+		}
+	}
+}
+
+void SmearerCatClassifier::ReadElectron(unsigned int iEle, double *values) const
+{
+	// TLeaf::GetValue converts to double as the TTreeFormula
+	if(_needed[kEtaEle]) {
+		values[kEta] = _leaves[kEtaEle]->GetValue(iEle);
+		values[kAbsEta] = fabs(values[kEta]);
+	}
+	if(_needed[kR9Ele]) values[kR9] = _leaves[kR9Ele]->GetValue(iEle);
+	if(_needed[kR9Eleprime]) values[kR9prime] = _leaves[kR9Eleprime]->GetValue(iEle);
+	if(_needed[kEnergy]) {
+		// energy/cosh(etaSCEle), energy * scaleEle/cosh(etaSCEle) for the corrected data
+		double energy = _leaves[kEnergy]->GetValue(iEle);
+		if(_corrEle) energy = energy * _leaves[kScaleEle]->GetValue(iEle);
+		values[kEt] = energy / cosh(_leaves[kEtaSCEle]->GetValue(iEle));
+	}
+}
+
+bool SmearerCatClassifier::Pass(const std::vector<cut_t>& cuts, const double *values) const
+{
+	for(std::vector<cut_t>::const_iterator cut_itr = cuts.begin(); cut_itr != cuts.end(); cut_itr++) {
+		double value = values[cut_itr->quantity];
+		switch(cut_itr->op) {
+		case kGT:
+			if(!(value > cut_itr->value)) return false;
+			break;
+		case kGE:
+			if(!(value >= cut_itr->value)) return false;
+			break;
+		case kLT:
+			if(!(value < cut_itr->value)) return false;
+			break;
+		case kLE:
+			if(!(value <= cut_itr->value)) return false;
+			break;
+		}
+	}
+	return true;
+}
+
+int SmearerCatClassifier::GetCategory(bool& swap)
+{
+	double values[2][kNQuantities];
+	ReadElectron(0, values[0]);
+	ReadElectron(1, values[1]);
+
+	// regions of each electron
+	_regions1.clear();
+	_regions2.clear();
+	for(size_t iRegion = 0; iRegion < _regions.size(); iRegion++) {
+		region_t& region = _regions[iRegion];
+		bool pass1, pass2;
+		if(region.compiled) {
+			pass1 = Pass(region.cuts, values[0]);
+			pass2 = Pass(region.cuts, values[1]);
+		} else {
+			pass1 = region.formulas[1]->EvalInstance();
+			pass2 = region.formulas[2]->EvalInstance();
+		}
+		if(pass1) _regions1.push_back(iRegion);
+		if(pass2) _regions2.push_back(iRegion);
+	}
+
+	// first category of the list: the region pairs are tested in order, the not swapped one first
+	int index = -1;
+	swap = false;
+	for(std::vector<size_t>::const_iterator r1 = _regions1.begin(); r1 != _regions1.end(); r1++) {
+		for(std::vector<size_t>::const_iterator r2 = _regions2.begin(); r2 != _regions2.end(); r2++) {
+			int pairIndex;
+			bool pairSwap = *r1 > *r2;
+			if(*r1 == *r2) {
+				// diagonal: compiled cuts are the same on the two electrons, the others below
+				if(!_regions[*r1].compiled) continue;
+				pairIndex = _pairIndex[*r1][*r1];
+			} else pairIndex = pairSwap ? _pairIndex[*r2][*r1] : _pairIndex[*r1][*r2];
+
+			if(index < 0 || pairIndex < index || (pairIndex == index && swap && !pairSwap)) {
+				index = pairIndex;
+				swap = pairSwap;
+			}
+		}
+	}
+
+	// not compiled diagonal cuts: GetCut with nEle=0 is not always the AND of the cuts of the electrons (SingleEle, EB_EE)
+	for(size_t iRegion = 0; iRegion < _regions.size(); iRegion++) {
+		region_t& region = _regions[iRegion];
+		if(region.compiled) continue;
+		int pairIndex = _pairIndex[iRegion][iRegion];
+		if(index >= 0 && pairIndex >= index) break;
+		if(region.formulas[0]->EvalInstance()) {
+			index = pairIndex;
+			swap = false;
+			break;
+		}
+	}
+	return index;
+}
@@ -0,0 +1,125 @@
+#include "../interface/SmearerGradFunction.hh"
+#include <Math/Minimizer.h>
+#include <Math/Factory.h>
+#include <RooRealVar.h>
+#include <TIterator.h>
+#include <TStopwatch.h>
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+
+SmearerGradFunction::SmearerGradFunction(RooSmearer& smearer, RooArgSet args, double relStep):
+	_smearer(smearer),
+	_relStep(relStep)
+{
+	RooArgList argList(args);
+	TIterator *it = argList.createIterator();
+	for(RooRealVar *var = (RooRealVar *) it->Next(); var != NULL; var = (RooRealVar *) it->Next()) {
+		if (var->isConstant() || !var->isLValue()) continue;
+		_pars.add(*var);
+	}
+	delete it;
+	_dependentCategories = _smearer.GetDependentCategories(_pars);
+}
+
+ROOT::Math::IMultiGenFunction *SmearerGradFunction::Clone() const
+{
+	return new SmearerGradFunction(*this);
+}
+
+unsigned int SmearerGradFunction::NDim() const
+{
+	return _pars.getSize();
+}
+
+void SmearerGradFunction::SetParameters(const double *x) const
+{
+	for(int i = 0; i < _pars.getSize(); i++) {
+		((RooRealVar *) _pars.at(i))->setVal(x[i]);
+	}
+	return;
+}
+
+double SmearerGradFunction::DoEval(const double *x) const
+{
+	SetParameters(x);
+	return _smearer.evaluate();
+}
+
+void SmearerGradFunction::Gradient(const double *x, double *grad) const
+{
+	unsigned int nPars = NDim();
+	if(_lastX.size() == nPars && std::equal(x, x + nPars, _lastX.begin())) {
+		std::copy(_lastGrad.begin(), _lastGrad.end(), grad);
+		return;
+	}
+
+	SetParameters(x);
+	std::vector<double> steps(nPars);
+	for(unsigned int i = 0; i < nPars; i++) steps[i] = _relStep * std::max(fabs(x[i]), 1.);
+	_smearer.GetNLLGradient(_pars, steps.data(), _dependentCategories, grad);
+
+	_lastX.assign(x, x + nPars);
+	_lastGrad.assign(grad, grad + nPars);
+	return;
+}
+
+void SmearerGradFunction::FdF(const double *x, double& f, double *df) const
+{
+	Gradient(x, df);
+	f = DoEval(x); // also leaves the smearer at x
+	return;
+}
+
+double SmearerGradFunction::DoDerivative(const double *x, unsigned int icoord) const
+{
+	std::vector<double> grad(NDim());
+	Gradient(x, grad.data());
+	return grad[icoord];
+}
+
+void MinimizationMigrad(RooSmearer& smearer, RooArgSet args)
+{
+	std::cout << "------------------------------------------------------------" << std::endl;
+	std::cout << "[INFO] Minimization: migrad with batched gradient" << std::endl;
+	TStopwatch myClock;
+	myClock.Start();
+
+	SmearerGradFunction nll(smearer, args);
+	const RooArgList& pars = nll.GetParameters();
+
+	ROOT::Math::Minimizer *minimizer = ROOT::Math::Factory::CreateMinimizer("Minuit2", "Migrad");
+	if(minimizer == NULL) {
+		std::cerr << "[ERROR] Minuit2 minimizer not available" << std::endl;
+		exit(1);
+	}
+	minimizer->SetPrintLevel(1);
+	minimizer->SetErrorDef(smearer.defaultErrorLevel()); // as RooMinuit
+	for(int i = 0; i < pars.getSize(); i++) {
+		RooRealVar *var = (RooRealVar *) pars.at(i);
+		double step = (var->getError() > 0) ? var->getError() : 0.01 * std::max(fabs(var->getVal()), 0.1);
+		if(var->hasMin() && var->hasMax()) minimizer->SetLimitedVariable(i, var->GetName(), var->getVal(), step, var->getMin(), var->getMax());
+		else if(var->hasMin()) minimizer->SetLowerLimitedVariable(i, var->GetName(), var->getVal(), step, var->getMin());
+		else if(var->hasMax()) minimizer->SetUpperLimitedVariable(i, var->GetName(), var->getVal(), step, var->getMax());
+		else minimizer->SetVariable(i, var->GetName(), var->getVal(), step);
+	}
+	minimizer->SetFunction(nll);
+	minimizer->Minimize();
+	std::cout << "MINUIT STATUS " << minimizer->Status() << "\tEDM " << minimizer->Edm() << "\tNLL calls " << minimizer->NCalls() << std::endl;
+
+	// the smearer is left at the minimum
+	const double *x = minimizer->X();
+	const double *errors = minimizer->Errors();
+	for(int i = 0; i < pars.getSize(); i++) {
+		RooRealVar *var = (RooRealVar *) pars.at(i);
+		var->setVal(x[i]);
+		if(errors != NULL) var->setError(errors[i]);
+	}
+	smearer.evaluate();
+	delete minimizer;
+
+	myClock.Stop();
+	myClock.Print();
+	return;
+}
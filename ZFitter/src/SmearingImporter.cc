@@ -1,6 +1,7 @@
 #include "../interface/SmearingImporter.hh"
 #include "../interface/BW_CB_pdf_class.hh"
 #include "../interface/ZFit_class.hh"
+#include "../interface/ZeeEventCacheFile.hh"
 #include <TTreeFormula.h>
 #include <TRandom3.h>
 #include <TDirectory.h>
@@ -13,11 +14,16 @@
 #include <TTreeFormula.h>
 #include <TObjArray.h>
 #include <TChainElement.h>
+#include <TSystem.h>
+#include <sstream>
+#include <algorithm>
+#include "../interface/ParallelFor.hh"
+#include "../interface/BranchProducer.hh"
+#include "../interface/CounterRNG.hh"
 //#define DEBUG
 
 
 #define SELECTOR
-#define FIXEDSMEARINGS
 SmearingImporter::SmearingImporter(std::vector<TString> regionList, TString energyBranchName, TString commonCut):
 	//  _chain(chain),
 	_regionList(regionList),
@@ -37,6 +43,8 @@ SmearingImporter::SmearingImporter(std::vector<TString> regionList, TString ener
 	_onlyDiagonal(false),
 	_isSmearingEt(false),
 	_pdfWeightIndex(0),
+	_eventCacheDir(""),
+	_nThreads(1),
 	cutter(false)
 {
 	cutter.energyBranchName = energyBranchName;
@@ -76,6 +84,7 @@ void SmearingImporter::ImportToy(Long64_t nEvents, event_cache_t& eventCache, bo
 		event.weight = 1;
 		event.energy_ele1 = 45;
 		event.energy_ele2 = 45;
+		event.eventKey = CounterRNG::EventKey(isMC, iEvent);
 		event.invMass = gen.BreitWigner(91.188, 2.48);
 		if(isMC == false) event.invMass *= sqrt(gen.Gaus(_scaleToy, _constTermToy) * gen.Gaus(_scaleToy, _constTermToy)); //gen.Gaus(_scaleToy, _constTermToy); //
 		eventCache.push_back(event);
@@ -85,51 +94,93 @@ void SmearingImporter::ImportToy(Long64_t nEvents, event_cache_t& eventCache, bo
 
 
 
-void SmearingImporter::Import(TTree *chain, regions_cache_t& cache, TString oddString, bool isMC, Long64_t nEvents, bool isToy, bool externToy)
+/// buffers of the branches read by the import: one per worker
+class SmearingImporter::importBranches_t
 {
-
-	TRandom3 gen(0);
-	if(!isMC) gen.SetSeed(12345);
-	TRandom3 excludeGen(12345);
-	Long64_t excludedByWeight = 0, includedEvents = 0;
+public:
+	importBranches_t():
+		weight(1.), FSRweight(1.), WEAKweight(1.), mcGenWeight(1), LTweight(-1), pdfWeights(NULL),
+		hasCorrEle(false), hasSmearEle(false), hasPdfWeights(false), hasFSRweight(false), hasWEAKweight(false),
+		hasPUweight(false), hasR9weight(false), hasPtweight(false), hasZPtweight(false), hasMcGenWeight(false),
+		hasLTweight(false), hasSmearerCat(false), hasRunNumber(false) {
+		runNumber = 0;
+		corrEle_[0] = corrEle_[1] = 1;
+		smearEle_[0] = smearEle_[1] = 1;
+		r9weight[0] = r9weight[1] = 1;
+		ptweight[0] = ptweight[1] = 1;
+		zptweight[0] = 1;
+	};
 
 	// for the energy calculation
 	Float_t         energyEle[2];
-	Float_t         corrEle_[2] = {1, 1};
-	Float_t         smearEle_[2] = {1, 1};
-	bool hasSmearEle = false;
+	Float_t         corrEle_[2];
+	Float_t         smearEle_[2];
 
 	// for the angle calculation
 	Float_t         etaEle[2];
 	Float_t         phiEle[2];
 
 	// for the weight calculation
-	Float_t         weight = 1.;
-	Float_t         r9weight[2] = {1, 1};
-	Float_t         ptweight[2] = {1, 1};
-	Float_t         FSRweight = 1.;
-	Float_t         WEAKweight = 1.;
-	Float_t         zptweight[45] = {1};
-	Float_t         mcGenWeight = 1;
-	Float_t         LTweight = -1;
-	std::vector<double> *pdfWeights = NULL;
+	Float_t         weight;
+	Float_t         r9weight[2];
+	Float_t         ptweight[2];
+	Float_t         FSRweight;
+	Float_t         WEAKweight;
+	Float_t         zptweight[45];
+	Float_t         mcGenWeight;
+	Float_t         LTweight;
+	std::vector<double> *pdfWeights;
 
 	Int_t           smearerCat[2];
-	bool hasSmearerCat = false;
 
-	// for toy repartition
+	// for toy repartition and the smearing random numbers
 	ULong64_t eventNumber;
+	Int_t     runNumber;
+
+	// branches found in the chain and its friends
+	bool hasCorrEle, hasSmearEle, hasPdfWeights, hasFSRweight, hasWEAKweight;
+	bool hasPUweight, hasR9weight, hasPtweight, hasZPtweight, hasMcGenWeight, hasLTweight, hasSmearerCat, hasRunNumber;
+
+	/// activate the branches and set the addresses
+	void SetBranchAddresses(TTree *chain, TString energyBranchName, bool isMC) {
+		SetBranch(chain, "eventNumber", &eventNumber);
+		if(hasRunNumber)   SetBranch(chain, "runNumber", &runNumber);
+		SetBranch(chain, "etaEle", etaEle);
+		SetBranch(chain, "phiEle", phiEle);
+		SetBranch(chain, energyBranchName, energyEle);
+		if(hasCorrEle)     SetBranch(chain, "scaleEle", corrEle_);
+		if(hasSmearEle)    SetBranch(chain, isMC ? "smearSigmaEle" : "smearEle", smearEle_);
+		if(hasPdfWeights) {
+			chain->SetBranchStatus("pdfWeights_cteq66", 1);
+			chain->SetBranchAddress("pdfWeights_cteq66", &pdfWeights);
+		}
+		if(hasFSRweight)   SetBranch(chain, "fsrWeight", &FSRweight);
+		if(hasWEAKweight)  SetBranch(chain, "weakWeight", &WEAKweight);
+		if(hasPUweight)    SetBranch(chain, "puWeight", &weight);
+		if(hasR9weight)    SetBranch(chain, "r9Weight", r9weight);
+		if(hasPtweight)    SetBranch(chain, "ptWeight", ptweight);
+		if(hasZPtweight)   SetBranch(chain, "ZPtWeight", zptweight);
+		if(hasMcGenWeight) SetBranch(chain, "mcGenWeight", &mcGenWeight);
+		if(hasLTweight)    SetBranch(chain, "LTweight", &LTweight);
+		if(hasSmearerCat)  SetBranch(chain, "smearerCat", smearerCat);
+	};
+
+private:
+	void SetBranch(TTree *chain, TString branchName, void *address) {
+		chain->SetBranchStatus(branchName, 1);
+		chain->SetBranchAddress(branchName, address);
+	};
+};
 
-	//------------------------------
-	chain->SetBranchAddress("eventNumber", &eventNumber);
-	chain->SetBranchAddress("etaEle", etaEle);
-	chain->SetBranchAddress("phiEle", phiEle);
+void SmearingImporter::Import(TTree *chain, regions_cache_t& cache, TString oddString, bool isMC, Long64_t nEvents, bool isToy, bool externToy)
+{
+	//------------------------------ branches (checked once, the buffers are per worker)
+	importBranches_t branches;
 
-	chain->SetBranchAddress(_energyBranchName, energyEle);
 	if(chain->GetBranch("scaleEle") != NULL) {
 		if(isToy == false || (externToy == true && isToy == true && isMC == false)) {
 			std::cout << "[STATUS] Adding electron energy correction branch from friend" << std::endl;
-			chain->SetBranchAddress("scaleEle", corrEle_);
+			branches.hasCorrEle = true;
 			cutter._corrEle = true;
 		}
 	}
@@ -137,15 +188,13 @@ void SmearingImporter::Import(TTree *chain, regions_cache_t& cache, TString oddS
 	if(chain->GetBranch("smearEle") != NULL) {
 		if(isToy == false || (externToy == true && isToy == true && isMC == false)) {
 			std::cout << "[STATUS] Adding electron energy smearing branch from friend" << std::endl;
-			if(isMC) chain->SetBranchAddress("smearSigmaEle", smearEle_);
-			else chain->SetBranchAddress("smearEle", smearEle_);
-			hasSmearEle = true;
+			branches.hasSmearEle = true;
 		}
 	}
 
 	if(!isMC && chain->GetBranch("pdfWeights_cteq66") != NULL && _pdfWeightIndex > 0) {
 		std::cout << "[STATUS] Adding pdfWeight_ctec66 branch from friend" << std::endl;
-		chain->SetBranchAddress("pdfWeights_cteq66", &pdfWeights);
+		branches.hasPdfWeights = true;
 	}
 
 	// the second term is to ensure that in case of toy study it is applied only to pseudo-data otherwise to MC
@@ -153,50 +202,51 @@ void SmearingImporter::Import(TTree *chain, regions_cache_t& cache, TString oddS
 	// probably it will be needed in the future if the pdfSystematic branches are put in a separate tree
 	if(_useFSRweight &&  isMC == false && (isToy == false || (externToy == true && isToy == true && isMC == false)) && chain->GetBranch("fsrWeight") != NULL) {
 		std::cout << "[STATUS] Getting fsrWeight branch for tree: " << chain->GetTitle() << std::endl;
-		chain->SetBranchAddress("fsrWeight", &FSRweight);
+		branches.hasFSRweight = true;
 	}
 	if(_useWEAKweight  && isMC == false && (isToy == false || (externToy == true && isToy == true && isMC == false)) && chain->GetBranch("weakWeight") != NULL) {
 		std::cout << "[STATUS] Getting weakWeight branch for tree: " << chain->GetTitle() << std::endl;
-		chain->SetBranchAddress("weakWeight", &WEAKweight);
+		branches.hasWEAKweight = true;
 	}
 
 	if(chain->GetBranch("puWeight") != NULL) {
 		std::cout << "[STATUS] Getting puWeight branch for tree: " << chain->GetTitle() << std::endl;
-		chain->SetBranchAddress("puWeight", &weight);
+		branches.hasPUweight = true;
 	}
 
 	if(chain->GetBranch("r9Weight") != NULL) {
 		std::cout << "[STATUS] Getting r9Weight branch for tree: " << chain->GetTitle() << std::endl;
-		chain->SetBranchAddress("r9Weight", r9weight);
+		branches.hasR9weight = true;
 	}
 
 	if(chain->GetBranch("ptWeight") != NULL) {
 		std::cout << "[STATUS] Getting ptWeight branch for tree: " <<  chain->GetTitle() << std::endl;
-		chain->SetBranchAddress("ptWeight", ptweight);
+		branches.hasPtweight = true;
 	}
 
 	if(_useZPtweight && chain->GetBranch("ZPtWeight") != NULL) {
 		std::cout << "[STATUS] Getting ZptWeight branch for tree: " <<  chain->GetTitle() << std::endl;
-		chain->SetBranchAddress("ZPtWeight", zptweight);
+		branches.hasZPtweight = true;
 	}
 
 	if(chain->GetBranch("mcGenWeight") != NULL) {
 		std::cout << "[STATUS] Getting mcGenWeight branch for tree: " <<  chain->GetTitle() << std::endl;
-		chain->SetBranchAddress("mcGenWeight", &mcGenWeight);
+		branches.hasMcGenWeight = true;
 	}
 
 	if(chain->GetBranch("LTweight") != NULL) {
 		std::cout << "[STATUS] Getting LTweight for tree: " <<  chain->GetTitle() << std::endl;
-		chain->SetBranchAddress("LTweight", &LTweight);
+		branches.hasLTweight = true;
 	}
 
 	if(chain->GetBranch("smearerCat") != NULL) {
 		std::cout << "[STATUS] Getting smearerCat branch for tree: " <<  chain->GetTitle() << std::endl;
-		chain->SetBranchAddress("smearerCat", smearerCat);
-		hasSmearerCat = true;
+		branches.hasSmearerCat = true;
 	}
 
-	if(hasSmearerCat == false) {
+	branches.hasRunNumber = chain->GetBranch("runNumber") != NULL;
+
+	if(branches.hasSmearerCat == false) {
 		std::cerr << "[ERROR] Must have smearerCat branch" << std::endl;
 		exit(1);
 	}
@@ -205,51 +255,89 @@ void SmearingImporter::Import(TTree *chain, regions_cache_t& cache, TString oddS
 		std::cout << "[INFO] Importing only " << nEvents << " events" << std::endl;
 		entries = nEvents;
 	}
+
+	//------------------------------ partitioning
+	// the entry list is resolved in the main thread, then it is divided in
+	// blocks of consecutive entries (mostly in the same file). The random
+	// generator is seeded per block: the imported events do not depend on
+	// the number of threads
+	std::vector<Long64_t> entryNumbers(entries);
+	for(Long64_t jentry = 0; jentry < entries; jentry++) entryNumbers[jentry] = chain->GetEntryNumber(jentry);
 	chain->LoadTree(chain->GetEntryNumber(0));
-	Long64_t treenumber = -1;
-
-
-	std::vector< std::pair<TTreeFormula*, TTreeFormula*> > catSelectors;
-	if(hasSmearerCat == false) {
-		for(std::vector<TString>::const_iterator region_ele1_itr = _regionList.begin();
-		        region_ele1_itr != _regionList.end();
-		        region_ele1_itr++) {
-			for(std::vector<TString>::const_iterator region_ele2_itr = region_ele1_itr;
-			        region_ele2_itr != _regionList.end();
-			        region_ele2_itr++) {
-
-				if(region_ele2_itr == region_ele1_itr) {
-					TString region = *region_ele1_itr;
-					region.ReplaceAll(_commonCut, "");
-					TTreeFormula *selector = new TTreeFormula("selector" + (region), cutter.GetCut(region + oddString, isMC), chain);
-					catSelectors.push_back(std::pair<TTreeFormula*, TTreeFormula*>(selector, NULL));
-					//selector->Print();
-				} else if(!_onlyDiagonal) {
-					TString region1 = *region_ele1_itr;
-					TString region2 = *region_ele2_itr;
-					region1.ReplaceAll(_commonCut, "");
-					region2.ReplaceAll(_commonCut, "");
-					TTreeFormula *selector1 = new TTreeFormula("selector1" + region1 + region2,
-					        cutter.GetCut(region1 + oddString, isMC, 1) &&
-					        cutter.GetCut(region2 + oddString, isMC, 2),
-					        chain);
-					TTreeFormula *selector2 = new TTreeFormula("selector2" + region1 + region2,
-					        cutter.GetCut(region1 + oddString, isMC, 2) &&
-					        cutter.GetCut(region2 + oddString, isMC, 1),
-					        chain);
-					catSelectors.push_back(std::pair<TTreeFormula*, TTreeFormula*>(selector1, selector2));
-					//selector1->Print();
-					//selector2->Print();
-
-				} else catSelectors.push_back(std::pair<TTreeFormula*, TTreeFormula*>(NULL, NULL));
 
+	size_t nBlocks = (entries + IMPORT_BLOCKSIZE - 1) / IMPORT_BLOCKSIZE;
+	std::vector<regions_cache_t> blockCaches(nBlocks, cache); // empty caches with the number of fixed smearings
+	std::vector<Long64_t> blockIncludedEvents(nBlocks, 0), blockExcludedByWeight(nBlocks, 0);
+
+	if(_nThreads <= 1) branches.SetBranchAddresses(chain, _energyBranchName, isMC);
+	else std::cout << "[INFO] Importing " << entries << " events in " << nBlocks << " blocks with " << _nThreads << " threads" << std::endl;
+
+	// each worker reads its own copy of the chain, made at its first block and reused for the next ones
+	std::vector<TTree *> workerChains(_nThreads, NULL);
+	std::vector<importBranches_t> workerBranches(_nThreads, branches);
+	ParallelForWorkers(_nThreads, nBlocks, [&](size_t iBlock, unsigned int iWorker) {
+		TTree *blockChain = chain;
+		if(_nThreads > 1) {
+			if(workerChains[iWorker] == NULL) {
+				workerChains[iWorker] = CloneChain(chain);
+				workerBranches[iWorker].SetBranchAddresses(workerChains[iWorker], _energyBranchName, isMC);
 			}
+			blockChain = workerChains[iWorker];
+		}
+		ImportBlock(blockChain, (_nThreads > 1) ? workerBranches[iWorker] : branches, entryNumbers, iBlock * IMPORT_BLOCKSIZE,
+		            std::min((Long64_t)((iBlock + 1) * IMPORT_BLOCKSIZE), entries),
+		            (isMC ? 54321 : 12345) + iBlock,
+		            blockCaches[iBlock], blockIncludedEvents[iBlock], blockExcludedByWeight[iBlock], isMC, isToy);
+	});
+	for(std::vector<TTree *>::iterator chain_itr = workerChains.begin(); chain_itr != workerChains.end(); chain_itr++) {
+		if(*chain_itr == NULL) continue;
+		(*chain_itr)->ResetBranchAddresses();
+		DeleteChain(*chain_itr);
+	}
+
+	// merge in the block order
+	Long64_t includedEvents = 0, excludedByWeight = 0;
+	for(size_t iBlock = 0; iBlock < nBlocks; iBlock++) {
+		for(size_t iCat = 0; iCat < cache.size(); iCat++) {
+			cache[iCat].append(blockCaches[iBlock][iCat]);
+			blockCaches[iBlock][iCat].clear();
+			blockCaches[iBlock][iCat].shrink_to_fit();
 		}
+		includedEvents += blockIncludedEvents[iBlock];
+		excludedByWeight += blockExcludedByWeight[iBlock];
 	}
 
-	for(Long64_t jentry = 0; jentry < entries; jentry++) {
-		Long64_t entryNumber = chain->GetEntryNumber(jentry);
-		chain->GetEntry(entryNumber);
+	std::cout << "[INFO] Importing events: " << includedEvents << "; events excluded by weight: " << excludedByWeight << std::endl;
+	for(regions_cache_t::iterator cache_itr = cache.begin(); cache_itr != cache.end(); cache_itr++) {
+		cache_itr->shrink_to_fit();
+	}
+	chain->ResetBranchAddresses();
+	chain->GetEntry(0);
+	return;
+
+}
+
+void SmearingImporter::ImportBlock(TTree *chain, importBranches_t& branches, const std::vector<Long64_t>& entryNumbers,
+                                   Long64_t firstEntry, Long64_t lastEntry, UInt_t seed,
+                                   regions_cache_t& cache, Long64_t& includedEvents, Long64_t& excludedByWeight, bool isMC, bool isToy)
+{
+	TRandom3 gen(seed);
+
+	Float_t *energyEle = branches.energyEle, *corrEle_ = branches.corrEle_, *smearEle_ = branches.smearEle_;
+	Float_t *etaEle = branches.etaEle, *phiEle = branches.phiEle;
+	Float_t *r9weight = branches.r9weight, *ptweight = branches.ptweight, *zptweight = branches.zptweight;
+	Float_t& weight = branches.weight;
+	Float_t& FSRweight = branches.FSRweight;
+	Float_t& WEAKweight = branches.WEAKweight;
+	Float_t& mcGenWeight = branches.mcGenWeight;
+	Float_t& LTweight = branches.LTweight;
+	std::vector<double> *&pdfWeights = branches.pdfWeights;
+	Int_t *smearerCat = branches.smearerCat;
+	ULong64_t& eventNumber = branches.eventNumber;
+	Int_t& runNumber = branches.runNumber;
+
+	for(Long64_t jentry = firstEntry; jentry < lastEntry; jentry++) {
+		chain->GetEntry(entryNumbers[jentry]);
 		if(isToy) {
 			int modulo = eventNumber % 5;
 			if(jentry < 10) {
@@ -264,41 +352,16 @@ void SmearingImporter::Import(TTree *chain, regions_cache_t& cache, TString oddS
 		}
 
 		// reject events:
-		if(weight > 3) continue;
-
-		if (hasSmearerCat == false && chain->GetTreeNumber() != treenumber) {
-			treenumber = chain->GetTreeNumber();
-			for(std::vector< std::pair<TTreeFormula*, TTreeFormula*> >::const_iterator catSelector_itr = catSelectors.begin();
-			        catSelector_itr != catSelectors.end();
-			        catSelector_itr++) {
-
-				catSelector_itr->first->UpdateFormulaLeaves();
-				if(catSelector_itr->second != NULL)       catSelector_itr->second->UpdateFormulaLeaves();
-			}
+		if(weight > 3) {
+			excludedByWeight++;
+			continue;
 		}
 
 		int evIndex = -1;
 		bool _swap = false;
-		if(!hasSmearerCat) {
-			for(std::vector< std::pair<TTreeFormula*, TTreeFormula*> >::const_iterator catSelector_itr = catSelectors.begin();
-			        catSelector_itr != catSelectors.end();
-			        catSelector_itr++) {
-				_swap = false;
-				TTreeFormula *sel1 = catSelector_itr->first;
-				TTreeFormula *sel2 = catSelector_itr->second;
-				if(sel1 == NULL) continue; // is it possible?
-				if(sel1->EvalInstance() == false) {
-					if(sel2 == NULL || sel2->EvalInstance() == false) continue;
-					else _swap = true;
-				}
-
-				evIndex = catSelector_itr - catSelectors.begin();
-			}
-		} else {
-			evIndex = smearerCat[0];
-			_swap = smearerCat[1];
-			if(jentry < 2) std::cout << evIndex << "\t" << _swap << std::endl;
-		}
+		evIndex = smearerCat[0];
+		_swap = smearerCat[1];
+		if(jentry < 2) std::cout << evIndex << "\t" << _swap << std::endl;
 		if(evIndex < 0) continue; // event in no category
 
 		ZeeEvent event;
@@ -316,7 +379,7 @@ void SmearingImporter::Import(TTree *chain, regions_cache_t& cache, TString oddS
 		float t1q = t1 * t1;
 		float t2q = t2 * t2;
 
-		if(isMC && hasSmearEle) {
+		if(isMC && branches.hasSmearEle) {
 			smearEle_[0] = gen.Gaus(1, smearEle_[0]);
 			smearEle_[1] = gen.Gaus(1, smearEle_[1]);
 		}
@@ -404,34 +467,17 @@ void SmearingImporter::Import(TTree *chain, regions_cache_t& cache, TString oddS
 		//}
 		//if(event.weight<=0 || event.weight!=event.weight || event.weight>10) {continue;}
 		if(event.weight > 10) {
+			excludedByWeight++;
 			continue;   //also negative weights are possible
 		}
 
-#ifdef FIXEDSMEARINGS
-		if(isMC) {
-			event.smearings_ele1 = new float[NSMEARTOYLIM];
-			event.smearings_ele2 = new float[NSMEARTOYLIM];
-			for(int i = 0; i < NSMEARTOYLIM; i++) {
-				event.smearings_ele1[i] = (float) gen.Gaus(0, 1);
-				event.smearings_ele2[i] = (float) gen.Gaus(0, 1);
-			}
-		} else {
-			event.smearings_ele1 = new float[1];
-			event.smearings_ele2 = new float[1];
-			event.smearings_ele1[0] = (float) gen.Gaus(0, 1);
-			event.smearings_ele2[0] = (float) gen.Gaus(0, 1);
-		}
-#endif
+		// the smearings of the likelihood are generated from the event identity
+		event.eventKey = CounterRNG::EventKey(runNumber, eventNumber);
 		includedEvents++;
 		cache.at(evIndex).push_back(event);
 		//(cache[evIndex]).push_back(event);
 	}
-
-	std::cout << "[INFO] Importing events: " << includedEvents << "; events excluded by weight: " << excludedByWeight << std::endl;
-	chain->ResetBranchAddresses();
-	chain->GetEntry(0);
 	return;
-
 }
 
 SmearingImporter::regions_cache_t SmearingImporter::GetCache(TChain *_chain, bool isMC, bool odd, Long64_t nEvents, bool isToy, bool externToy)
@@ -489,6 +535,34 @@ SmearingImporter::regions_cache_t SmearingImporter::GetCache(TChain *_chain, boo
 		}
 	}
 
+	for(std::vector<TString>::const_iterator region_ele1_itr = _regionList.begin();
+	        region_ele1_itr != _regionList.end();
+	        region_ele1_itr++) {
+		for(std::vector<TString>::const_iterator region_ele2_itr = region_ele1_itr;
+		        region_ele2_itr != _regionList.end();
+		        region_ele2_itr++) {
+
+			event_cache_t eventCache;
+			cache.push_back(eventCache);
+		}
+	}
+
+	// events already imported by a previous job with the same inputs
+	std::string cacheDescription;
+	TString cacheFileName;
+	if(_eventCacheDir != "") {
+		cacheDescription = GetCacheDescription(_chain, isMC, odd, nEvents, isToy, externToy);
+		if(cacheDescription.empty()) std::cout << "[INFO] Event cache not used: " << _chain->GetTitle() << " has friend trees in memory" << std::endl;
+	}
+	if(!cacheDescription.empty()) {
+		cacheFileName = ZeeEventCacheFile::GetFileName(_eventCacheDir, cacheDescription);
+		if(ZeeEventCacheFile::Read(cacheFileName, cacheDescription, cache)) {
+			myClock.Stop();
+			myClock.Print();
+			return cache;
+		}
+	}
+
 	TString evListName = "evList_";
 	evListName += _chain->GetTitle();
 	evListName += "_all";
@@ -503,19 +577,9 @@ SmearingImporter::regions_cache_t SmearingImporter::GetCache(TChain *_chain, boo
 		std::cout << "[INFO] Selected events: " <<  chain_ecal->GetEntryList()->GetN() << std::endl;
 		_chain = dynamic_cast<TChain*>(chain_ecal);
 	}
-	for(std::vector<TString>::const_iterator region_ele1_itr = _regionList.begin();
-	        region_ele1_itr != _regionList.end();
-	        region_ele1_itr++) {
-		for(std::vector<TString>::const_iterator region_ele2_itr = region_ele1_itr;
-		        region_ele2_itr != _regionList.end();
-		        region_ele2_itr++) {
-
-			event_cache_t eventCache;
-			cache.push_back(eventCache);
-		}
-	}
 
 	Import(_chain, cache, oddString, isMC, nEvents, isToy, externToy);
+	if(!cacheDescription.empty()) ZeeEventCacheFile::Write(cacheFileName, cacheDescription, cache);
 #ifdef DEBUG
 	int index = 0;
 	for(std::vector<TString>::const_iterator region_ele1_itr = _regionList.begin();
@@ -536,4 +600,52 @@ SmearingImporter::regions_cache_t SmearingImporter::GetCache(TChain *_chain, boo
 	return cache;
 }
 
+std::string SmearingImporter::GetCacheDescription(TChain *chain, bool isMC, bool odd, Long64_t nEvents, bool isToy, bool externToy)
+{
+	std::stringstream description;
+
+	// input files of the chain and of the friends (name, size and modification time)
+	std::vector<TChain *> chains(1, chain);
+	if(chain->GetListOfFriends() != NULL) {
+		TIterator *it = chain->GetListOfFriends()->MakeIterator();
+		bool inMemory = false;
+		for(TFriendElement *friendElement = (TFriendElement *) it->Next(); friendElement != NULL; friendElement = (TFriendElement *) it->Next()) {
+			TChain *friendChain = dynamic_cast<TChain *>(friendElement->GetTree());
+			if(friendChain != NULL) chains.push_back(friendChain);
+			else inMemory = true;
+		}
+		delete it;
+		// friend trees in memory (--memFriends) have no file to identify their content
+		if(inMemory) return "";
+	}
+	for(std::vector<TChain *>::const_iterator chain_itr = chains.begin(); chain_itr != chains.end(); chain_itr++) {
+		description << "chain: " << (*chain_itr)->GetName() << " " << (*chain_itr)->GetTitle() << "\n";
+		TObjArray *fileElements = (*chain_itr)->GetListOfFiles();
+		for(int i = 0; i < fileElements->GetEntries(); i++) {
+			TChainElement *chainElement = (TChainElement *) fileElements->At(i);
+			FileStat_t fileStat;
+			description << "file: " << chainElement->GetTitle();
+			if(gSystem->GetPathInfo(chainElement->GetTitle(), fileStat) == 0) description << " " << fileStat.fSize << " " << fileStat.fMtime;
+			description << "\n";
+		}
+	}
 
+	// categories and selection
+	for(std::vector<TString>::const_iterator region_itr = _regionList.begin(); region_itr != _regionList.end(); region_itr++) {
+		description << "region: " << *region_itr << "\n";
+	}
+	description << "energyBranchName: " << _energyBranchName << "\n"
+	            << "commonCut: " << _commonCut << "\n"
+	            << "eleID: " << _eleID << "\n"
+	            << "selection: " << cutter.GetCut(_commonCut + "-eleID_" + _eleID, isMC).GetTitle() << "\n";
+
+	// options of the import
+	description << "isMC: " << isMC << " odd: " << odd << " nEvents: " << nEvents
+	            << " isToy: " << isToy << " externToy: " << externToy << "\n"
+	            << "weights: PU " << _usePUweight << " MC " << _useMCweight << " R9 " << _useR9weight
+	            << " Pt " << _usePtweight << " ZPt " << _useZPtweight << " FSR " << _useFSRweight
+	            << " WEAK " << _useWEAKweight << " pdfIndex " << _pdfWeightIndex << "\n"
+	            << "excludeByWeight: " << _excludeByWeight << " onlyDiagonal: " << _onlyDiagonal
+	            << " smearingEt: " << _isSmearingEt << "\n";
+	return description.str();
+}
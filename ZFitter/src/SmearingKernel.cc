@@ -0,0 +1,112 @@
+#include "../interface/SmearingKernel.hh"
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+SmearingKernel::SmearingKernel(const TH1F *hist):
+	_nBins(hist->GetNbinsX()),
+	_xMin(hist->GetXaxis()->GetXmin()),
+	_xMax(hist->GetXaxis()->GetXmax()),
+	_sumw(_nBins + 2, 0.),
+	_sumw2(_nBins + 2, 0.)
+{
+	if(hist->GetXaxis()->IsVariableBinSize()) {
+		std::cerr << "[ERROR] SmearingKernel works only with uniform binning: " << hist->GetName() << std::endl;
+		exit(1);
+	}
+	Reset();
+}
+
+void SmearingKernel::Reset(void)
+{
+	std::fill(_sumw.begin(), _sumw.end(), 0.);
+	std::fill(_sumw2.begin(), _sumw2.end(), 0.);
+	_entries = 0;
+	_tsumw = 0;
+	_tsumw2 = 0;
+	_tsumwx = 0;
+	_tsumwx2 = 0;
+}
+
+void SmearingKernel::Fill(float invMass, float weight, const double *smear1, const double *smear2, unsigned int nToy)
+{
+	if(_mass.size() < nToy) {
+		_mass.resize(nToy);
+		_binX.resize(nToy);
+	}
+	double *mass = _mass.data();
+	double *binX = _binX.data();
+
+	const double m = invMass;
+	const double nBins = _nBins;
+	const double width = _xMax - _xMin;
+
+	// smeared mass and position in units of bins: same operations (and rounding) of the scalar code
+	unsigned int i = 0;
+#ifdef __AVX__
+	const __m256d m_4 = _mm256_set1_pd(m);
+	const __m256d xMin_4 = _mm256_set1_pd(_xMin);
+	const __m256d nBins_4 = _mm256_set1_pd(nBins);
+	const __m256d width_4 = _mm256_set1_pd(width);
+	for(; i + 4 <= nToy; i += 4) {
+		__m256d mass_4 = _mm256_mul_pd(m_4, _mm256_sqrt_pd(_mm256_mul_pd(_mm256_loadu_pd(smear1 + i), _mm256_loadu_pd(smear2 + i))));
+		_mm256_storeu_pd(mass + i, mass_4);
+		_mm256_storeu_pd(binX + i, _mm256_div_pd(_mm256_mul_pd(nBins_4, _mm256_sub_pd(mass_4, xMin_4)), width_4));
+	}
+#endif
+#ifdef __SSE2__
+	const __m128d m_2 = _mm_set1_pd(m);
+	const __m128d xMin_2 = _mm_set1_pd(_xMin);
+	const __m128d nBins_2 = _mm_set1_pd(nBins);
+	const __m128d width_2 = _mm_set1_pd(width);
+	for(; i + 2 <= nToy; i += 2) {
+		__m128d mass_2 = _mm_mul_pd(m_2, _mm_sqrt_pd(_mm_mul_pd(_mm_loadu_pd(smear1 + i), _mm_loadu_pd(smear2 + i))));
+		_mm_storeu_pd(mass + i, mass_2);
+		_mm_storeu_pd(binX + i, _mm_div_pd(_mm_mul_pd(nBins_2, _mm_sub_pd(mass_2, xMin_2)), width_2));
+	}
+#endif
+	for(; i < nToy; i++) {
+		mass[i] = m * sqrt(smear1[i] * smear2[i]);
+		binX[i] = nBins * (mass[i] - _xMin) / width;
+	}
+
+	// accumulation: the bins can be the same for different toys, so it is not vectorized
+	const double w = weight;
+	const double w2 = w * w;
+	for(i = 0; i < nToy; i++) {
+		int bin;
+		if(mass[i] < _xMin) bin = 0;
+		else if(!(mass[i] < _xMax)) bin = _nBins + 1; // also NaN, as in TAxis::FindBin
+		else bin = 1 + int(binX[i]);
+
+		_sumw[bin] += w;
+		_sumw2[bin] += w2;
+		if(bin == 0 || bin > _nBins) continue; // under/overflows not in the statistics
+		_tsumw += w;
+		_tsumw2 += w2;
+		_tsumwx += w * mass[i];
+		_tsumwx2 += w * mass[i] * mass[i];
+	}
+	_entries += nToy;
+	return;
+}
+
+void SmearingKernel::CopyTo(TH1F *hist) const
+{
+	for(int bin = 0; bin <= _nBins + 1; bin++) {
+		hist->SetBinContent(bin, _sumw[bin]);
+	}
+	TArrayD *sumw2 = hist->GetSumw2();
+	if(sumw2->fN == _nBins + 2) {
+		for(int bin = 0; bin <= _nBins + 1; bin++) sumw2->fArray[bin] = _sumw2[bin];
+	}
+	// SetBinContent changes entries and statistics
+	hist->SetEntries(_entries);
+	double stats[4] = {_tsumw, _tsumw2, _tsumwx, _tsumwx2};
+	hist->PutStats(stats);
+	return;
+}
@@ -0,0 +1,51 @@
+#include "../interface/WeightTable.hh"
+#include <iostream>
+#include <math.h>
+
+WeightTable::WeightTable():
+	_uniform(false), _invWidth(0)
+{
+}
+
+WeightTable::WeightTable(const weight_map_t& weights):
+	_uniform(false), _invWidth(0)
+{
+	if(weights.empty()) {
+		std::cerr << "[ERROR] WeightTable: no bins" << std::endl;
+		exit(1);
+	}
+	for(weight_map_t::const_iterator itr = weights.begin(); itr != weights.end(); itr++) {
+		_edges.push_back(itr->first);
+		_weights.push_back(itr->second);
+	}
+
+	size_t nBins = _edges.size();
+	if(nBins == 1) return;
+
+	// uniform within the rounding of the edges: FindBin corrects the computed bin
+	double width = (_edges[nBins - 1] - _edges[0]) / (nBins - 1);
+	_uniform = width > 0;
+	for(size_t i = 1; i < nBins && _uniform; i++) {
+		if(fabs(_edges[i] - (_edges[0] + i * width)) > 1e-6 * width) _uniform = false;
+	}
+	if(_uniform) _invWidth = 1. / width;
+}
+
+WeightArray::WeightArray():
+	_minKey(0)
+{
+}
+
+WeightArray::WeightArray(const weight_map_t& weights):
+	_minKey(0)
+{
+	if(weights.empty()) return;
+	_minKey = weights.begin()->first;
+	long long nKeys = (long long) weights.rbegin()->first - _minKey + 1;
+	_weights.assign(nKeys, 0.);
+	_hasWeight.assign(nKeys, false);
+	for(weight_map_t::const_iterator itr = weights.begin(); itr != weights.end(); itr++) {
+		_weights[itr->first - _minKey] = itr->second;
+		_hasWeight[itr->first - _minKey] = true;
+	}
+}
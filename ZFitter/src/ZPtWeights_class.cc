@@ -15,18 +15,44 @@ ZPtWeights_class::ZPtWeights_class(void):
 }
 
 
-double ZPtWeights_class::GetPtWeight(double ZPt_, int pdfWeightIndex)
+void ZPtWeights_class::Compile()
 {
+	ZPttables.clear();
+	for(ZPtweights_map_t::const_iterator itr = ZPtweights.begin(); itr != ZPtweights.end(); itr++) {
+		ZPttables.insert(std::pair<TString, WeightTable>(itr->first, WeightTable(itr->second)));
+	}
 
+	indexTables.assign(PDFWEIGHTINDEXMAX, NULL);
+	for(int pdfWeightIndex = 0; pdfWeightIndex < PDFWEIGHTINDEXMAX; pdfWeightIndex++) {
+		TString indexName;
+		indexName += pdfWeightIndex;
+		std::map<TString, WeightTable>::const_iterator itr = ZPttables.find("ZPtWeight_" + indexName);
+		if(itr != ZPttables.end()) indexTables[pdfWeightIndex] = &(itr->second);
+	}
+}
 
-	TString indexName;
-	indexName += pdfWeightIndex;
-	ZPtweights_map_t::const_iterator ZPtweights_itr =  ZPtweights.find("ZPtWeight_" + indexName);
-	if(ZPtweights_itr == ZPtweights.end()) {
-		std::cerr << "[ERROR] Pt weight histogram " << "ZPtWeight_" + indexName << " not found!" << std::endl;
-		exit(1);
-	} else return (--(ZPtweights_itr->second.upper_bound(ZPt_)))->second;
+double ZPtWeights_class::GetPtWeight(double ZPt_, int pdfWeightIndex) const
+{
+	const WeightTable *table = NULL;
+	if(pdfWeightIndex >= 0 && pdfWeightIndex < (int) indexTables.size()) table = indexTables[pdfWeightIndex];
+	if(table == NULL) {
+		TString indexName;
+		indexName += pdfWeightIndex;
+		std::map<TString, WeightTable>::const_iterator itr = ZPttables.find("ZPtWeight_" + indexName);
+		if(itr == ZPttables.end()) {
+			std::cerr << "[ERROR] Pt weight histogram " << "ZPtWeight_" + indexName << " not found!" << std::endl;
+			exit(1);
+		}
+		table = &(itr->second);
+	}
+	return table->GetWeight(ZPt_);
+}
 
+void ZPtWeights_class::GetPtWeights(double ZPt_, int nIndices, Float_t *weights) const
+{
+	for(int pdfWeightIndex = 1; pdfWeightIndex < nIndices; pdfWeightIndex++) {
+		weights[pdfWeightIndex] = GetPtWeight(ZPt_, pdfWeightIndex);
+	}
 }
 
 
@@ -87,6 +113,7 @@ void ZPtWeights_class::ReadFromFile(std::string filename)
 	}
 
 	f_ZPt->Close();
+	Compile();
 
 	return;
 }
@@ -94,47 +121,53 @@ void ZPtWeights_class::ReadFromFile(std::string filename)
 
 // tree is the input MC tree
 // fastLoop = false if for any reason you don't want to change the branch status of the MC tree
-TTree *ZPtWeights_class::GetTreeWeight(TChain *tree, TString ZPtBranchName, bool fastLoop)
+namespace
 {
-	tree->ResetBranchAddresses();
-
-	Float_t ptWeight[50] = {1.};
-	TTree *newTree = new TTree("ZPtWeight", "");
-	newTree->Branch("ZPtWeight", ptWeight, "ZPtWeight[45]/F");
-	if(fastLoop) {
-		tree->SetBranchStatus("*", 0);
-		tree->SetBranchStatus(ZPtBranchName, 1);
-	}
-
-	Float_t ZPt;
-	if(tree->GetBranch(ZPtBranchName) == NULL) {
-		std::cerr << "[ERROR] Branch " << ZPtBranchName << " not found, impossible to produce ZPt weights " << std::endl;
-		exit(1);
-	}
-	tree->SetBranchAddress(ZPtBranchName, &ZPt);
-	// loop over tree
-	Long64_t nentries = tree->GetEntriesFast();
-#ifdef DEBUG
-	nentries = 10;
-#endif
-
-	std::cout << "[STATUS] Get ZPTWeightTree for tree: " << tree->GetTitle()
-	          << "\t" << "with " << nentries << " entries" << std::endl;
-	std::cerr << "[00%]";
-	for(Long64_t ientry = 0; ientry < nentries; ientry++) {
-		tree->GetEntry(ientry);
-		for(int pdfWeightIndex = 1; pdfWeightIndex < PDFWEIGHTINDEXMAX; pdfWeightIndex++) {
-			ptWeight[pdfWeightIndex] =  GetPtWeight(ZPt, pdfWeightIndex);
+class ZPtWeightFiller: public BranchFiller
+{
+public:
+	ZPtWeightFiller(TString treename, TString ZPtBranchName, const ZPtWeights_class *weights):
+		BranchFiller(treename), _ZPtBranchName(ZPtBranchName), _weights(weights)
+	{
+		for(int i = 0; i < 50; i++) ptWeight[i] = 0.;
+		ptWeight[0] = 1.;
+	};
+
+	bool Init(BranchProducer& producer)
+	{
+		ZPt = producer.Input<Float_t>(_ZPtBranchName);
+		if(ZPt == NULL) {
+			std::cerr << "[ERROR] Branch " << _ZPtBranchName << " not found, impossible to produce ZPt weights " << std::endl;
+			exit(1);
 		}
-		newTree->Fill();
-		if(ientry % (nentries / 100) == 0) std::cerr << "\b\b\b\b" << std::setw(2) << ientry / (nentries / 100) << "%]";
-	}
-	std::cout << std::endl;
+		_tree->Branch("ZPtWeight", ptWeight, "ZPtWeight[45]/F");
+		return true;
+	};
+
+	void Compute(Long64_t ientry)
+	{
+		_weights->GetPtWeights(*ZPt, PDFWEIGHTINDEXMAX, ptWeight);
+	};
+
+private:
+	TString _ZPtBranchName;
+	const ZPtWeights_class *_weights;
+	const Float_t *ZPt;
+	Float_t ptWeight[50];
+};
+}
+
+BranchFiller *ZPtWeights_class::NewFiller(TString treename, TString ZPtBranchName)
+{
+	return new ZPtWeightFiller(treename, ZPtBranchName, this);
+}
 
-	if(fastLoop) tree->SetBranchStatus("*", 1);
-	tree->ResetBranchAddresses();
-	//  std::cout << "[WARNING] nPU > nPU max for " << warningCounter << " times" << std::endl;
-	return newTree;
+/// fastLoop not used: only the input branch is read
+TTree *ZPtWeights_class::GetTreeWeight(TChain *tree, TString ZPtBranchName, bool fastLoop)
+{
+	BranchProducer producer(tree);
+	producer.Add(NewFiller("ZPtWeight", ZPtBranchName));
+	return producer.Run()[0];
 }
 
 
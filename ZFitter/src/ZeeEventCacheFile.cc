@@ -0,0 +1,185 @@
+#include "../interface/ZeeEventCacheFile.hh"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CACHEFILE_MAGIC "ZEECACHE"
+#define CACHEFILE_VERSION 2 // to be increased if the layout of the file or of ZeeEventCache changes
+#define CACHEFILE_ALIGNMENT 64
+
+namespace
+{
+uint64_t Align(uint64_t offset)
+{
+	return (offset + CACHEFILE_ALIGNMENT - 1) / CACHEFILE_ALIGNMENT * CACHEFILE_ALIGNMENT;
+}
+
+/// write size bytes at the given offset of the file, padding with zeros
+bool WriteAt(FILE *f, uint64_t& offset, uint64_t newOffset, const void *data, uint64_t size)
+{
+	static const char zeros[CACHEFILE_ALIGNMENT] = {0};
+	if(newOffset > offset && fwrite(zeros, 1, newOffset - offset, f) != newOffset - offset) return false;
+	if(size > 0 && fwrite(data, 1, size, f) != size) return false;
+	offset = newOffset + size;
+	return true;
+}
+
+class categoryHeader_t
+{
+public:
+	uint64_t nEvents;
+};
+}
+
+unsigned long long ZeeEventCacheFile::Hash(const std::string& description)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for(std::string::const_iterator c = description.begin(); c != description.end(); c++) {
+		hash ^= (unsigned char)(*c);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+TString ZeeEventCacheFile::GetFileName(TString dir, const std::string& description)
+{
+	char hash[17];
+	snprintf(hash, 17, "%016llx", Hash(description));
+	if(!dir.EndsWith("/")) dir += "/";
+	return dir + "eventCache-" + hash + ".bin";
+}
+
+bool ZeeEventCacheFile::Write(TString fileName, const std::string& description, const regions_cache_t& cache)
+{
+	// written in a temporary file and renamed: a crash does not leave a truncated cache.
+	// The temporary file is unique (mkstemp, same directory): concurrent jobs sharing the
+	// cache directory do not write in the same file, the last rename wins with a complete cache
+	std::string tmpFileName = std::string(fileName.Data()) + ".tmp.XXXXXX";
+	int fd = mkstemp(&tmpFileName[0]);
+	FILE *f = (fd < 0) ? NULL : fdopen(fd, "wb");
+	if(f == NULL) {
+		std::cerr << "[WARNING] Event cache file " << tmpFileName << " cannot be opened for writing" << std::endl;
+		if(fd >= 0) {
+			close(fd);
+			remove(tmpFileName.c_str());
+		}
+		return false;
+	}
+	fchmod(fd, 0644); // mkstemp creates the file readable only by the owner
+
+	uint64_t offset = 0;
+	uint32_t version = CACHEFILE_VERSION, reserved = 0;
+	uint64_t hash = Hash(description), descriptionSize = description.size(), nCategories = cache.size();
+	bool ok = WriteAt(f, offset, offset, CACHEFILE_MAGIC, 8);
+	ok = ok && WriteAt(f, offset, offset, &version, sizeof(version));
+	ok = ok && WriteAt(f, offset, offset, &reserved, sizeof(reserved));
+	ok = ok && WriteAt(f, offset, offset, &hash, sizeof(hash));
+	ok = ok && WriteAt(f, offset, offset, &descriptionSize, sizeof(descriptionSize));
+	ok = ok && WriteAt(f, offset, offset, description.data(), descriptionSize);
+	ok = ok && WriteAt(f, offset, (offset + 7) / 8 * 8, &nCategories, sizeof(nCategories));
+	for(regions_cache_t::const_iterator cache_itr = cache.begin(); cache_itr != cache.end(); cache_itr++) {
+		categoryHeader_t header = {cache_itr->size()};
+		ok = ok && WriteAt(f, offset, offset, &header, sizeof(header));
+	}
+	for(regions_cache_t::const_iterator cache_itr = cache.begin(); cache_itr != cache.end(); cache_itr++) {
+		uint64_t n = cache_itr->size();
+		ok = ok && WriteAt(f, offset, Align(offset), cache_itr->energy_ele1.data(), n * sizeof(float));
+		ok = ok && WriteAt(f, offset, Align(offset), cache_itr->energy_ele2.data(), n * sizeof(float));
+		ok = ok && WriteAt(f, offset, Align(offset), cache_itr->invMass.data(), n * sizeof(float));
+		ok = ok && WriteAt(f, offset, Align(offset), cache_itr->weight.data(), n * sizeof(float));
+		ok = ok && WriteAt(f, offset, Align(offset), cache_itr->eventKey.data(), n * sizeof(uint64_t));
+	}
+	ok = (fclose(f) == 0) && ok;
+	if(!ok || rename(tmpFileName.c_str(), fileName) != 0) {
+		std::cerr << "[WARNING] Event cache file " << fileName << " not written" << std::endl;
+		remove(tmpFileName.c_str());
+		return false;
+	}
+	std::cout << "[INFO] Event cache saved in " << fileName << " (" << offset / 1024 / 1024 << " MB)" << std::endl;
+	return true;
+}
+
+bool ZeeEventCacheFile::Read(TString fileName, const std::string& description, regions_cache_t& cache)
+{
+	int fd = open(fileName, O_RDONLY);
+	if(fd < 0) return false;
+	struct stat fileStat;
+	if(fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	uint64_t fileSize = fileStat.st_size;
+	void *map = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		std::cerr << "[WARNING] Event cache file " << fileName << " cannot be mapped" << std::endl;
+		return false;
+	}
+	const char *data = (const char *) map;
+	madvise(map, fileSize, MADV_SEQUENTIAL);
+
+	// header
+	bool ok = fileSize >= 32 && memcmp(data, CACHEFILE_MAGIC, 8) == 0;
+	uint32_t version = 0;
+	uint64_t hash = 0, descriptionSize = 0, nCategories = 0;
+	if(ok) {
+		memcpy(&version, data + 8, sizeof(version));
+		memcpy(&hash, data + 16, sizeof(hash));
+		memcpy(&descriptionSize, data + 24, sizeof(descriptionSize));
+		ok = version == CACHEFILE_VERSION && hash == Hash(description)
+		     && descriptionSize == description.size() && 32 + descriptionSize + 8 <= fileSize
+		     && memcmp(data + 32, description.data(), descriptionSize) == 0;
+	}
+	uint64_t offset = (32 + descriptionSize + 7) / 8 * 8;
+	if(ok) {
+		memcpy(&nCategories, data + offset, sizeof(nCategories));
+		offset += sizeof(nCategories);
+		ok = nCategories == cache.size() && offset + nCategories * sizeof(categoryHeader_t) <= fileSize;
+	}
+	if(!ok) {
+		std::cout << "[INFO] Event cache file " << fileName << " does not match the current inputs" << std::endl;
+		munmap(map, fileSize);
+		return false;
+	}
+
+	std::vector<categoryHeader_t> headers(nCategories);
+	memcpy(headers.data(), data + offset, nCategories * sizeof(categoryHeader_t));
+	offset += nCategories * sizeof(categoryHeader_t);
+
+	// columns: one bulk copy each
+	for(uint64_t iCat = 0; ok && iCat < nCategories; iCat++) {
+		zee_events_t& eventCache = cache[iCat];
+		const categoryHeader_t& header = headers[iCat];
+		eventCache.clear();
+
+		std::vector<float> *columns[4] = {&eventCache.energy_ele1, &eventCache.energy_ele2, &eventCache.invMass, &eventCache.weight};
+		for(unsigned int iColumn = 0; ok && iColumn < 4; iColumn++) {
+			offset = Align(offset);
+			ok = offset + header.nEvents * sizeof(float) <= fileSize;
+			if(!ok) break;
+			const float *begin = (const float *)(data + offset);
+			columns[iColumn]->assign(begin, begin + header.nEvents);
+			offset += header.nEvents * sizeof(float);
+		}
+		offset = Align(offset);
+		ok = ok && offset + header.nEvents * sizeof(uint64_t) <= fileSize;
+		if(!ok) break;
+		const uint64_t *begin = (const uint64_t *)(data + offset);
+		eventCache.eventKey.assign(begin, begin + header.nEvents);
+		offset += header.nEvents * sizeof(uint64_t);
+	}
+	munmap(map, fileSize);
+
+	if(!ok) {
+		std::cerr << "[WARNING] Event cache file " << fileName << " is truncated" << std::endl;
+		for(regions_cache_t::iterator cache_itr = cache.begin(); cache_itr != cache.end(); cache_itr++) cache_itr->clear();
+		return false;
+	}
+	std::cout << "[INFO] Event cache read from " << fileName << std::endl;
+	return true;
+}
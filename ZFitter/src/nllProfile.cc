@@ -25,11 +25,15 @@ TGraph *GetProfile(RooRealVar *var1, RooRealVar *var2, RooSmearer& smearer, bool
 		exit(1);
 	}
 
+	std::vector<std::vector<double> > points;
 	for(Int_t i = 0; i < N; i++) { // reset Y values
-		var1->setVal(X1[i]);
-		var2->setVal(X2[i]);
-		Y[i] = smearer.evaluate();
+		std::vector<double> point(2);
+		point[0] = X1[i];
+		point[1] = X2[i];
+		points.push_back(point);
 	}
+	std::vector<double> nll = smearer.EvaluatePoints(RooArgList(*var1, *var2), points);
+	std::copy(nll.begin(), nll.end(), Y);
 
 	var1->setVal(v1);
 	var2->setVal(v2);
@@ -39,6 +43,42 @@ TGraph *GetProfile(RooRealVar *var1, RooRealVar *var2, RooSmearer& smearer, bool
 	return g3;
 }
 
+TH2F *GetProfile2D(RooRealVar *constVar, RooRealVar *alphaVar, RooSmearer& smearer, double Emean, int nRho, int nPhi)
+{
+	if(Emean <= 0) {
+		std::cerr << "[ERROR] Emean not valid for the 2D profile of " << constVar->GetName() << ": " << Emean << std::endl;
+		exit(1);
+	}
+	Double_t v1 = constVar->getVal();
+	Double_t v2 = alphaVar->getVal();
+	double rhoMax = std::min(constVar->getMax(), alphaVar->getMax() / Emean);
+	std::cout << "[STATUS] Getting 2D profile for " << constVar->GetName() << "\t" << alphaVar->GetName()
+	          << "\trhoMax=" << rhoMax << "\tEmean=" << Emean << std::endl;
+
+	TH2F *hist = new TH2F(TString("profile2D_") + constVar->GetName(), ";#rho;#phi;NLL",
+	                      nRho, 0, rhoMax, nPhi, 0, M_PI_2);
+	hist->SetDirectory(NULL);
+	std::vector<std::vector<double> > points;
+	for(int iRho = 1; iRho <= nRho; iRho++) {
+		double rho = hist->GetXaxis()->GetBinCenter(iRho);
+		for(int iPhi = 1; iPhi <= nPhi; iPhi++) {
+			double phi = hist->GetYaxis()->GetBinCenter(iPhi);
+			std::vector<double> point(2);
+			point[0] = rho * sin(phi);
+			point[1] = rho * Emean * cos(phi);
+			points.push_back(point);
+		}
+	}
+	std::vector<double> nll = smearer.EvaluatePoints(RooArgList(*constVar, *alphaVar), points);
+	for(int iRho = 1; iRho <= nRho; iRho++) {
+		for(int iPhi = 1; iPhi <= nPhi; iPhi++) hist->SetBinContent(iRho, iPhi, nll[(iRho - 1) * nPhi + iPhi - 1]);
+	}
+
+	constVar->setVal(v1);
+	alphaVar->setVal(v2);
+	return hist;
+}
+
 TGraph *GetProfile(RooRealVar *var, RooSmearer& compatibility, int level, bool warningEnable, bool trueEval, float rho, float Emean, float phi)
 {
 	if(var == NULL) trueEval = false;
@@ -203,6 +243,7 @@ TGraph *GetProfile(RooRealVar *var, RooSmearer& compatibility, int level, bool w
 //     }
 	double chi2[PROFILE_NBINS];
 	double xValues[PROFILE_NBINS];
+	std::vector<std::vector<double> > points;
 	if(trueEval) std::cout << "------------------------------" << std::endl;
 	for (int iVal = 0; iVal < nBin; ++iVal) {
 		double value = range_min + bin_width * iVal;
@@ -222,12 +263,15 @@ TGraph *GetProfile(RooRealVar *var, RooSmearer& compatibility, int level, bool w
 #endif
 
 		xValues[iVal] = value;
-		if(trueEval) {
-			var->setVal(value);
-			chi2[iVal] = compatibility.evaluate(); //-minYvalue;
-		} else chi2[iVal] = 0;
+		chi2[iVal] = 0;
+		if(trueEval) points.push_back(std::vector<double>(1, value));
+	}
+	if(trueEval) {
+		// the points are evaluated in parallel by the smearer (if more than one thread)
+		std::vector<double> nll = compatibility.EvaluatePoints(RooArgList(*var), points);
+		std::copy(nll.begin(), nll.end(), chi2); //-minYvalue;
 #ifdef DEBUG
-		if(trueEval) std::cout << "value is " << chi2[iVal] << std::endl;
+		for (int iVal = 0; iVal < nBin; ++iVal) std::cout << "value is " << chi2[iVal] << std::endl;
 #endif
 	}
 	if(trueEval) {
@@ -595,6 +639,54 @@ bool stopFindMin1D(Int_t i, Int_t iLocMin, Double_t chi2, Double_t min, Double_t
 	return false;
 }
 
+ProfileScan1D::ProfileScan1D(Int_t N, Int_t iMinStart, Double_t min, float phiMin, Double_t *Y):
+	_N(N), _iMinStart(iMinStart), _i(iMinStart), _iLocMin(iMinStart), _direction(1),
+	_min(min), _locmin(1e20), _phiMin(phiMin), _Y(Y), _NY(std::max(N, 0), 0),
+	_done(false), _noSensitivity(false)
+{
+	if(_i >= _N) NextSide();
+}
+
+void ProfileScan1D::Set(Double_t chi2)
+{
+	_Y[_i] += chi2;
+	_NY[_i]++;
+
+	if(chi2 <= _locmin) { //local minimum
+		_iLocMin = _i;
+		_locmin = chi2;
+	}
+
+	if(stopFindMin1D(_i, _iLocMin, chi2, _min, _locmin, _phiMin)) {
+		NextSide();
+		return;
+	}
+	if(_direction > 0 && _i == _iLocMin && _i - _iMinStart == 3 && _Y[_iMinStart] == _Y[_iMinStart + 1]
+	        && _Y[_iMinStart] == _Y[_iMinStart + 2] && _Y[_iMinStart] == _Y[_iMinStart + 3]) {
+		_noSensitivity = true;
+		_done = true;
+		return;
+	}
+	_i += _direction;
+	if(_i >= _N || _i < 0) NextSide();
+	return;
+}
+
+void ProfileScan1D::NextSide()
+{
+	if(_direction > 0) { // now versus negative side
+		_direction = -1;
+		_i = std::min(_iMinStart, _N - 1);
+		if(_i >= 0) return;
+	}
+
+	for(Int_t i = 0; i < _N; i++) { //take the mean!
+		if(_NY[i] != 0) _Y[i] /= _NY[i];
+	}
+	_done = true;
+	return;
+}
+
 Int_t FindMin1D(RooRealVar *var, Double_t *X, Int_t N, Int_t iMinStart, Double_t min, RooSmearer& smearer, bool update, Double_t *Y, RooRealVar *var2, Double_t *X2)
 {
 	//Double_t vInit=var->getVal();
@@ -612,134 +704,587 @@ Int_t FindMin1D(RooRealVar *var, Double_t *X, Int_t N, Int_t iMinStart, Double_t
 
 	Double_t chi2, chi2init = smearer.evaluate(); //, chi2old=chi2init;
 
-	Double_t locmin = 1e20;
-	Int_t iLocMin = iMinStart;
-
-	Double_t NY[PROFILE_NBINS] = {0.};
 	int iStep = 1;
-	for(Int_t i = iMinStart; i < N; i += iStep) { //loop versus positive side
+	ProfileScan1D scan(N, iMinStart, min, phiMin, Y);
+	while(!scan.Done()) {
+		Int_t i = scan.Index();
 		var->setVal(X[i]);
 		if(var2 != NULL) var2->setVal(X2[i]);
 		chi2 = smearer.evaluate();
-		Y[i] += chi2;
-		NY[i]++;
 
-		//iStep = chi2-chi2old != 0 ? std::max(1,((int) (fabs(0.1/(chi2-chi2old))))) : 1;
-		iStep = 1;
+		if(scan.Direction() > 0) {
 #ifdef debug_fit
-		if(var2 != NULL) std::cout << "[FindMin1D] "  << std::setprecision(4) <<  "\t" << var->getVal() << "\t" << var2->getVal() << "\t" <<
-			                           chi2 - chi2init << "\t" << locmin - chi2init << "\t" << min - chi2init << std::endl;
-		else std::cout  << std::setprecision(4) << "[DEBUG] " <<  "\t" << iStep << "\t" << var->getVal() << "\t" << chi2 - chi2init << "\t" << locmin - chi2init << "\t" << min - chi2init << "\tchi2= " <<  chi2 << std::endl;
+			if(var2 != NULL) std::cout << "[FindMin1D] "  << std::setprecision(4) <<  "\t" << var->getVal() << "\t" << var2->getVal() << "\t" <<
+				                           chi2 - chi2init << "\t" << scan.GetLocMin() - chi2init << "\t" << min - chi2init << std::endl;
+			else std::cout  << std::setprecision(4) << "[DEBUG] " <<  "\t" << iStep << "\t" << var->getVal() << "\t" << chi2 - chi2init << "\t" << scan.GetLocMin() - chi2init << "\t" << min - chi2init << "\tchi2= " <<  chi2 << std::endl;
 #endif
-		if(chi2 <= locmin) { //local minimum
-			iLocMin = i;
-			locmin = chi2;
+		} else {
+#ifdef DEBUG
+			//if(update==true)
+			std::cout << "[DEBUG] " <<  "\t" << var->getVal() << "\t" << chi2 - chi2init << "\t" << scan.GetLocMin() - chi2init << std::endl;
+#endif
+			if(var2 != NULL) std::cout <<   "[DEBUG] Neg"  << std::setprecision(3) <<  "\t" << var->getVal() << "\t" << var2->getVal() << "\t" <<
+				                           chi2 - chi2init << "\t" << scan.GetLocMin() - chi2init << "\t" << min - chi2init << std::endl;
+			else std::cout << std::setprecision(4) << "[DEBUG] Neg" <<  "\t" <<  iStep << "\t" << var->getVal() << "\t" << chi2 - chi2init << "\t" << scan.GetLocMin() - chi2init << "\t" << min - chi2init << std::endl;
 		}
+		scan.Set(chi2);
+	}
 
-		if(stopFindMin1D(i, iLocMin, chi2, min, locmin, phiMin)) break;
-		//chi2old=chi2;
-		if(i == iLocMin && i - iMinStart == 3 && Y[iMinStart] == Y[iMinStart + 1] && Y[iMinStart] == Y[iMinStart + 2] && Y[iMinStart] == Y[iMinStart + 3]) {
-			std::cerr << "[WARNING] No sensitivity to variable: " << var->GetName() << std::endl;
-			std::cerr << "          Variable changed to constant" << std::endl;
-			std::cout << "[WARNING] No sensitivity to variable: " << var->GetName() << std::endl;
-			std::cout << "          Variable changed to constant" << std::endl;
-			return -1;
+	if(scan.GetMinIndex() < 0) {
+		std::cerr << "[WARNING] No sensitivity to variable: " << var->GetName() << std::endl;
+		std::cerr << "          Variable changed to constant" << std::endl;
+		std::cout << "[WARNING] No sensitivity to variable: " << var->GetName() << std::endl;
+		std::cout << "          Variable changed to constant" << std::endl;
+		return -1;
+	}
+	return scan.GetMinIndex();
+}
+
+BrentScan1D::BrentScan1D(Double_t x0, Double_t step, Double_t xMin, Double_t xMax,
+                         Double_t xTolerance, Double_t nllTolerance):
+	_state(kStart), _x0(x0), _step(step), _xMin(xMin), _xMax(xMax),
+	_xTolerance(xTolerance), _nllTolerance(nllTolerance),
+	_u(x0), _a(x0), _b(x0), _fa(0), _fb(0),
+	_x(x0), _w(x0), _v(x0), _fx(0), _fw(0), _fv(0), _d(0), _e(0),
+	_fUp(0), _fDown(0), _nEvaluations(0), _iter(0), _noSensitivity(false)
+{
+}
+
+Double_t BrentScan1D::Clamp(Double_t x) const
+{
+	return std::max(_xMin, std::min(_xMax, x));
+}
+
+void BrentScan1D::Set(Double_t f)
+{
+	_nEvaluations++;
+	switch(_state) {
+	case kStart:
+		_fx = _fUp = _fDown = f; // x0+-step is x0 at the limits of the range
+		if(Clamp(_x0 + _step) != _x0) {
+			_u = Clamp(_x0 + _step);
+			_state = kUp;
+		} else if(Clamp(_x0 - _step) != _x0) {
+			_u = Clamp(_x0 - _step);
+			_state = kDown;
+		} else _state = kDone;
+		break;
+	case kUp:
+		_fUp = f;
+		if(Clamp(_x0 - _step) != _x0) {
+			_u = Clamp(_x0 - _step);
+			_state = kDown;
+		} else StartBracket();
+		break;
+	case kDown:
+		_fDown = f;
+		StartBracket();
+		break;
+	case kExpand:
+		if(f >= _fx) { // bracketed by _a, _x, _u
+			Double_t a = _a, fa = _fa;
+			if(a < _u) {
+				_b = _u;
+				_fb = f;
+			} else {
+				_a = _u;
+				_fa = f;
+				_b = a;
+				_fb = fa;
+			}
+			StartBrent();
+		} else {
+			_a = _x;
+			_fa = _fx;
+			_x = _u;
+			_fx = f;
+			Expand();
+		}
+		break;
+	case kBrent:
+		if(f <= _fx) {
+			if(_u >= _x) {
+				_a = _x;
+				_fa = _fx;
+			} else {
+				_b = _x;
+				_fb = _fx;
+			}
+			_v = _w;
+			_fv = _fw;
+			_w = _x;
+			_fw = _fx;
+			_x = _u;
+			_fx = f;
+		} else {
+			if(_u < _x) {
+				_a = _u;
+				_fa = f;
+			} else {
+				_b = _u;
+				_fb = f;
+			}
+			if(f <= _fw || _w == _x) {
+				_v = _w;
+				_fv = _fw;
+				_w = _u;
+				_fw = f;
+			} else if(f <= _fv || _v == _x || _v == _w) {
+				_v = _u;
+				_fv = f;
+			}
 		}
+		BrentStep();
+		break;
+	case kDone:
+		break;
 	}
+	return;
+}
 
-	iStep = 1;
-	for(Int_t i = iMinStart; i >= 0; i -= iStep) { //loop versus positive side
-		var->setVal(X[i]);
-		if(var2 != NULL) var2->setVal(X2[i]);
-		chi2 = smearer.evaluate();
-		Y[i] += chi2;
-		NY[i]++;
+void BrentScan1D::StartBracket()
+{
+	Double_t xUp = Clamp(_x0 + _step), xDown = Clamp(_x0 - _step);
+	if(_fUp == _fx && _fDown == _fx) {
+		_noSensitivity = true;
+		_state = kDone;
+		return;
+	}
+	if(_fx <= _fUp && _fx <= _fDown) { // x0 is already bracketed
+		_a = xDown;
+		_fa = _fDown;
+		_b = xUp;
+		_fb = _fUp;
+		StartBrent();
+		return;
+	}
 
-		//iStep = chi2-chi2old != 0 ? std::max(1,((int) (fabs(0.1/(chi2-chi2old))))) : 1;
-		iStep = 1;
-#ifdef DEBUG
-		//if(update==true)
-		std::cout << "[DEBUG] " <<  "\t" << var->getVal() << "\t" << chi2 - chi2init << "\t" << locmin - chi2init << std::endl;
-#endif
-		if(var2 != NULL) std::cout <<   "[DEBUG] Neg"  << std::setprecision(3) <<  "\t" << var->getVal() << "\t" << var2->getVal() << "\t" <<
-			                           chi2 - chi2init << "\t" << locmin - chi2init << "\t" << min - chi2init << std::endl;
-		else std::cout << std::setprecision(4) << "[DEBUG] Neg" <<  "\t" <<  iStep << "\t" << var->getVal() << "\t" << chi2 - chi2init << "\t" << locmin - chi2init << "\t" << min - chi2init << std::endl;
+	_a = _x0; // previous point
+	_fa = _fx;
+	if(_fUp < _fDown) {
+		_x = xUp;
+		_fx = _fUp;
+	} else {
+		_x = xDown;
+		_fx = _fDown;
+	}
+	Expand();
+	return;
+}
 
-		if(chi2 <= locmin) { //local minimum
-			iLocMin = i;
-			locmin = chi2;
+void BrentScan1D::Expand()
+{
+	if(_x == _xMin || _x == _xMax) { // minimum between the previous point and the limit of the range
+		_b = _x;
+		_fb = _fx;
+		if(_a > _b) {
+			std::swap(_a, _b);
+			std::swap(_fa, _fb);
 		}
+		StartBrent();
+		return;
+	}
+	_u = Clamp(_x + 1.618034 * (_x - _a)); // golden ratio
+	_state = kExpand;
+	return;
+}
 
-		if(stopFindMin1D(i, iLocMin, chi2, min, locmin, phiMin)) break;
-		//chi2old=chi2;
+void BrentScan1D::StartBrent()
+{
+	_w = _v = _x;
+	_fw = _fv = _fx;
+	_d = _e = 0;
+	_iter = 0;
+	_state = kBrent;
+	BrentStep();
+	return;
+}
+
+void BrentScan1D::BrentStep()
+{
+	const Double_t cgold = 0.3819660;
+	Double_t xm = 0.5 * (_a + _b);
+	Double_t tol1 = _xTolerance, tol2 = 2 * tol1;
+	if(fabs(_x - xm) <= tol2 - 0.5 * (_b - _a) // bracket narrower than the tolerance
+	        || std::max(_fa, _fb) - _fx < _nllTolerance // NLL flat within the noise in the bracket
+	        || _iter >= BRENT_MAXITER) {
+		_state = kDone;
+		return;
 	}
 
-	if(Y != NULL) { //take the mean!
-		for(Int_t i = 0; i < N; i++) {
-			if(NY[i] != 0) Y[i] /= NY[i];
+	if(fabs(_e) > tol1) { // parabolic step
+		Double_t r = (_x - _w) * (_fx - _fv);
+		Double_t q = (_x - _v) * (_fx - _fw);
+		Double_t p = (_x - _v) * q - (_x - _w) * r;
+		q = 2 * (q - r);
+		if(q > 0) p = -p;
+		q = fabs(q);
+		Double_t etemp = _e;
+		_e = _d;
+		if(fabs(p) >= fabs(0.5 * q * etemp) || p <= q * (_a - _x) || p >= q * (_b - _x)) {
+			_e = (_x >= xm) ? _a - _x : _b - _x;
+			_d = cgold * _e; // golden-section step
+		} else {
+			_d = p / q;
+			Double_t u = _x + _d;
+			if(u - _a < tol2 || _b - u < tol2) _d = (xm >= _x) ? tol1 : -tol1;
 		}
+	} else {
+		_e = (_x >= xm) ? _a - _x : _b - _x;
+		_d = cgold * _e; // golden-section step
 	}
+	_u = (fabs(_d) >= tol1) ? _x + _d : _x + ((_d >= 0) ? tol1 : -tol1);
+	_iter++;
+	return;
+}
 
-	return iLocMin;
+/// bin width of the GetProfile grid at level 5
+Double_t LineSearchBinWidth(const RooRealVar *var)
+{
+	return TString(var->GetName()).Contains("alpha") ? 0.001 : 0.0001;
 }
 
-bool MinProfile(RooRealVar *var, RooSmearer& smearer, int iProfile,
-                Double_t min_old, Double_t& min, double rho, double Emean, bool update, bool dscan)
+BrentScan1D LineSearch(RooRealVar *var, RooSmearer& smearer)
 {
-	bool changed = false;
+	Double_t binWidth = LineSearchBinWidth(var);
+	Double_t nllTolerance = std::max(smearer.GetNllRMS(), (double) BRENT_NLL_TOLERANCE);
+	return BrentScan1D(var->getVal(), 10 * binWidth, var->getMin(), var->getMax(), 0.25 * binWidth, nllTolerance);
+}
 
-	Double_t v1 = var->getVal();
-	//Double_t chi2init=
-	smearer.evaluate();
+SurrogateScan1D::SurrogateScan1D(Double_t x0, Double_t step, Double_t xMin, Double_t xMax,
+                                 Double_t xTolerance, Double_t nllTolerance,
+                                 const std::vector<double>& x, const std::vector<double>& nll):
+	_step(step), _xMin(xMin), _xMax(xMax), _xTolerance(xTolerance), _nllTolerance(nllTolerance),
+	_xc(x0), _fc(1e20), _radius(SURROGATE_RADIUS * step), _u(x0), _predicted(0),
+	_nEvaluations(0), _iter(0), _done(false), _noSensitivity(false), _fallback(false),
+	_brent(x0, step, xMin, xMax, xTolerance, nllTolerance)
+{
+	// points already evaluated near x0, the last one if evaluated more than once
+	for(size_t i = 0; i < x.size(); i++) {
+		if(x[i] < xMin || x[i] > xMax || fabs(x[i] - x0) > SURROGATE_RADIUS * step) continue;
+		int iPoint = Find(x[i]);
+		if(iPoint >= 0) _f[iPoint] = nll[i];
+		else {
+			_x.push_back(x[i]);
+			_f.push_back(nll[i]);
+		}
+	}
+	for(size_t i = 0; i < _x.size(); i++) {
+		if(_f[i] < _fc) {
+			_xc = _x[i];
+			_fc = _f[i];
+		}
+	}
+	Propose();
+}
 
-	std::cout << "[STATUS] Starting MinProfile for " << var->GetName() << "\t" << iProfile << std::endl;
-	TGraph 	*profil = GetProfile(var, smearer, iProfile, false, false, rho, Emean);
-	//TGraphErrors 	 g(profil->GetN(),profil->GetX(), profil->GetY());
+int SurrogateScan1D::Find(Double_t x) const
+{
+	for(size_t i = 0; i < _x.size(); i++) {
+		if(fabs(_x[i] - x) < 0.1 * _xTolerance) return i;
+	}
+	return -1;
+}
+
+bool SurrogateScan1D::Fit(Double_t& a, Double_t& b, Double_t& c) const
+{
+	// normal equations of the least squares, solved by Gauss elimination
+	Double_t m[3][4] = {{0}};
+	int nPoints = 0;
+	for(size_t i = 0; i < _x.size(); i++) {
+		if(fabs(_x[i] - _xc) > _radius + 0.1 * _xTolerance) continue;
+		Double_t t = (_x[i] - _xc) / _step;
+		Double_t row[3] = {1, t, t * t};
+		for(int j = 0; j < 3; j++) {
+			for(int k = 0; k < 3; k++) m[j][k] += row[j] * row[k];
+			m[j][3] += row[j] * _f[i];
+		}
+		nPoints++;
+	}
+	if(nPoints < 3) return false;
+	for(int j = 0; j < 3; j++) {
+		int iPivot = j;
+		for(int k = j + 1; k < 3; k++) if(fabs(m[k][j]) > fabs(m[iPivot][j])) iPivot = k;
+		if(fabs(m[iPivot][j]) < 1e-12) return false;
+		for(int k = 0; k < 4; k++) std::swap(m[j][k], m[iPivot][k]);
+		for(int k = 0; k < 3; k++) {
+			if(k == j) continue;
+			Double_t factor = m[k][j] / m[j][j];
+			for(int l = j; l < 4; l++) m[k][l] -= factor * m[j][l];
+		}
+	}
+	a = m[0][3] / m[0][0];
+	b = m[1][3] / m[1][1];
+	c = m[2][3] / m[2][2];
+	return true;
+}
+
+void SurrogateScan1D::Propose()
+{
+	if(_iter++ >= SURROGATE_MAXITER) {
+		_done = true;
+		return;
+	}
+	_predicted = 0;
+	if(Find(_xc) < 0) { // nothing evaluated yet
+		_u = _xc;
+		return;
+	}
+
+	// points around the best one to start the fit
+	std::vector<int> inside;
+	for(size_t i = 0; i < _x.size(); i++) {
+		if(fabs(_x[i] - _xc) <= _radius + 0.1 * _xTolerance) inside.push_back(i);
+	}
+	if(inside.size() < 3) {
+		Double_t step = std::min(_step, _radius);
+		Double_t candidates[2] = {std::max(_xMin, _xc - step), std::min(_xMax, _xc + step)};
+		for(int i = 0; i < 2; i++) {
+			if(Find(candidates[i]) >= 0) continue;
+			_u = candidates[i];
+			return;
+		}
+		_done = true; // no room at the limits of the range
+		return;
+	}
+
+	// same NLL everywhere: no sensitivity to the parameter
+	bool flat = true;
+	for(size_t i = 1; i < inside.size() && flat; i++) flat = (_f[inside[i]] == _f[inside[0]]);
+	if(flat) {
+		_noSensitivity = true;
+		_done = true;
+		return;
+	}
 
+	Double_t a, b, c;
+	if(!Fit(a, b, c) || c <= 0) {
+		std::cout << "[INFO] Surrogate model not convex: continuing with Brent" << std::endl;
+		_brent = BrentScan1D(_xc, _step, _xMin, _xMax, _xTolerance, _nllTolerance);
+		_fallback = true;
+		return;
+	}
+	Double_t t = -b / (2 * c);
+	t = std::max(-_radius / _step, std::min(_radius / _step, t));
+	Double_t u = std::max(_xMin, std::min(_xMax, _xc + t * _step));
+	t = (u - _xc) / _step;
+	Double_t predicted = -(b * t + c * t * t);
+	if(fabs(u - _xc) < _xTolerance || predicted < _nllTolerance) {
+		_done = true;
+		return;
+	}
+	if(Find(u) >= 0) { // already evaluated and not better than the best point: the model is not reliable so far
+		_radius *= 0.5;
+		Propose();
+		return;
+	}
+	_u = u;
+	_predicted = predicted;
+}
+
+void SurrogateScan1D::Set(Double_t f)
+{
+	_nEvaluations++;
+	if(_fallback) {
+		_brent.Set(f);
+		return;
+	}
+	_x.push_back(_u);
+	_f.push_back(f);
+	if(_predicted > 0) { // trust region update
+		Double_t ratio = (_fc - f) / _predicted;
+		if(ratio > 0.75 && fabs(_u - _xc) > 0.9 * _radius) _radius *= 2;
+		else if(ratio < 0.25) _radius *= 0.5;
+	}
+	if(f < _fc) {
+		_xc = _u;
+		_fc = f;
+	}
+	Propose();
+}
 
-	Double_t 	*X    = profil->GetX();
-	Double_t 	*Y    = profil->GetY();
-	Int_t 	 N    = profil->GetN();
+SurrogateScan1D SurrogateLineSearch(RooRealVar *var, RooSmearer& smearer)
+{
+	Double_t binWidth = LineSearchBinWidth(var);
+	Double_t nllTolerance = std::max(smearer.GetNllRMS(), (double) BRENT_NLL_TOLERANCE);
+	std::vector<double> x, nll;
+	// only the points evaluated with the current MC fraction are comparable
+	size_t nLast = std::min((size_t) SURROGATE_NLAST, smearer._markov.Size() - smearer.GetMCFractionStart());
+	smearer._markov.GetSlice(*var, nLast, x, nll);
+	return SurrogateScan1D(var->getVal(), 10 * binWidth, var->getMin(), var->getMax(), 0.25 * binWidth, nllTolerance, x, nll);
+}
 
-	Double_t chi2 = Y[0];
+/// evaluate the NLL at the trial points of scan until it is done
+template<class scan_t> void RunLineSearch(scan_t& scan, RooRealVar *var, RooSmearer& smearer,
+        Double_t& xMin, Double_t& nllMin, int& nEvaluations, bool& noSensitivity)
+{
+	while(!scan.Done()) {
+		var->setVal(scan.Next());
+		scan.Set(smearer.evaluate());
+	}
+	xMin = scan.GetMinX();
+	nllMin = scan.GetMinNLL();
+	nEvaluations = scan.GetNEvaluations();
+	noSensitivity = scan.NoSensitivity();
+}
 
+bool MinProfile(RooRealVar *var, RooSmearer& smearer, int iProfile,
+                Double_t min_old, Double_t& min, double rho, double Emean, bool update, bool dscan, bool surrogate)
+{
+	bool changed = false;
 
-	Int_t iMin_ = 0; // minimum of the graph
+	Double_t v1 = var->getVal();
+	//Double_t chi2init=
+	smearer.evaluate();
 
-	for(Int_t i2 = 0; i2 < N; i2++) { // reset Y values
-		Y[i2] = 0;
-		if(X[iMin_] < v1) iMin_++;
+	std::cout << "[STATUS] Starting MinProfile for " << var->GetName() << "\t" << iProfile << std::endl;
+	Double_t xMin, chi2;
+	int nEvaluations;
+	bool noSensitivity;
+	if(surrogate) {
+		SurrogateScan1D scan = SurrogateLineSearch(var, smearer);
+		RunLineSearch(scan, var, smearer, xMin, chi2, nEvaluations, noSensitivity);
+	} else {
+		BrentScan1D scan = LineSearch(var, smearer);
+		RunLineSearch(scan, var, smearer, xMin, chi2, nEvaluations, noSensitivity);
 	}
-	iMin_ = FindMin1D(var, X, N, iMin_, min, smearer, true, Y);
-	if(iMin_ < 0) { // in case of no sensitivity to the variable it is put has constant and the minimization is interrupted
+	if(noSensitivity) { // in case of no sensitivity to the variable it is put has constant and the minimization is interrupted
 		std::cerr << "[WARNING] No sensitivity to var: " << var->GetName() << std::endl;
+		std::cout << "[WARNING] No sensitivity to variable: " << var->GetName() << std::endl;
+		std::cout << "          Variable changed to constant" << std::endl;
 		var->setVal(v1);
 		var->setConstant();
 		return false;
 	}
-	chi2 = Y[iMin_];
+	std::cout << "[INFO] Line search for " << var->GetName() << ": " << nEvaluations << " evaluations" << std::endl;
 
 	var->setVal(v1); //reset to initial value
 
 	if(chi2 < min) { // updated absolute minimum
 		min = chi2;
-		if(v1 != X[iMin_]) changed = true; //the value has been updated, need a new iteration
+		if(v1 != xMin) changed = true; //the value has been updated, need a new iteration
 		//else a fluctuation changed the min value
 	}
 
 	if(update && (min < min_old || changed)) { // if a new minimum has been found now, or due to another variable, need to update the scale
-		std::cout << "[INFO] Updating variable:" << var->GetName() << " from " << v1 << " to " << X[iMin_]  << std::endl
-		          << "       min = " << min << "; Y[iMin_]-min =  " << Y[iMin_] - min << std::endl;
-		var->setVal(X[iMin_]);
+		std::cout << "[INFO] Updating variable:" << var->GetName() << " from " << v1 << " to " << xMin  << std::endl
+		          << "       min = " << min << "; chi2-min =  " << chi2 - min << std::endl;
+		var->setVal(xMin);
 		//var->setError(newError);
 	} else {
-		std::cout << "[INFO] Not-Updating variable:" << var->GetName() << "\t" << X[iMin_]
-		          << " " << min << " " << Y[iMin_] - min << std::endl;
+		std::cout << "[INFO] Not-Updating variable:" << var->GetName() << "\t" << xMin
+		          << " " << min << " " << chi2 - min << std::endl;
 	}
 	//  std::cout << "[INFO] Level " << iProfile << " variable:" << var->GetName() << "\t" << var->getVal() << "\t" << min << std::endl;
-	delete profil;
-	//  delete X;
-	//delete Y;
+	return changed;
+}
+
+std::vector<std::vector<RooRealVar *> > GroupIndependentParameters(const std::vector<RooRealVar *>& vars, const RooSmearer& smearer)
+{
+	RooArgList argList;
+	for(size_t iVar = 0; iVar < vars.size(); iVar++) argList.add(*vars[iVar]);
+	std::vector<std::vector<size_t> > dependentCategories = smearer.GetDependentCategories(argList);
+
+	// greedy: each parameter goes in the first group where none of its categories is used
+	std::vector<std::vector<RooRealVar *> > groups;
+	std::vector<std::vector<bool> > usedCategories;
+	for(size_t iVar = 0; iVar < vars.size(); iVar++) {
+		size_t iGroup = 0;
+		for(; iGroup < groups.size(); iGroup++) {
+			bool shared = false;
+			for(size_t i = 0; i < dependentCategories[iVar].size() && !shared; i++) shared = usedCategories[iGroup][dependentCategories[iVar][i]];
+			if(!shared) break;
+		}
+		if(iGroup == groups.size()) {
+			groups.push_back(std::vector<RooRealVar *>());
+			usedCategories.push_back(std::vector<bool>(smearer.ZeeCategories.size(), false));
+		}
+		groups[iGroup].push_back(vars[iVar]);
+		for(size_t i = 0; i < dependentCategories[iVar].size(); i++) usedCategories[iGroup][dependentCategories[iVar][i]] = true;
+	}
+	return groups;
+}
+
+bool MinProfileGroup(const std::vector<RooRealVar *>& vars, RooSmearer& smearer, int iProfile,
+                     Double_t min_old, Double_t& min)
+{
+	if(vars.size() == 1) return MinProfile(vars[0], smearer, iProfile, min_old, min);
+
+	std::cout << "[STATUS] Starting MinProfileGroup for";
+	RooArgList argList;
+	for(size_t iVar = 0; iVar < vars.size(); iVar++) {
+		argList.add(*vars[iVar]);
+		std::cout << " " << vars[iVar]->GetName();
+	}
+	std::cout << "\t" << iProfile << std::endl;
+	std::vector<std::vector<size_t> > dependentCategories = smearer.GetDependentCategories(argList);
+
+	// NLL and nll of the categories at the starting point
+	Double_t nllStart = smearer.evaluate();
+	std::vector<double> categoryNLLStart;
+	for(size_t iCat = 0; iCat < smearer.ZeeCategories.size(); iCat++) categoryNLLStart.push_back(smearer.ZeeCategories[iCat].nll);
+
+	std::vector<Double_t> v1;
+	std::vector<BrentScan1D> scans;
+	for(size_t iVar = 0; iVar < vars.size(); iVar++) {
+		v1.push_back(vars[iVar]->getVal());
+		scans.push_back(LineSearch(vars[iVar], smearer));
+	}
+
+	// all the scans move together: the categories of the different parameters are smeared in the same evaluate()
+	for(;;) {
+		bool running = false;
+		for(size_t iVar = 0; iVar < vars.size(); iVar++) {
+			if(scans[iVar].Done()) continue;
+			vars[iVar]->setVal(scans[iVar].Next());
+			running = true;
+		}
+		if(!running) break;
+		smearer.evaluate();
+
+		for(size_t iVar = 0; iVar < vars.size(); iVar++) {
+			if(scans[iVar].Done()) continue;
+			// NLL with only this parameter moved
+			Double_t chi2 = nllStart;
+			for(size_t i = 0; i < dependentCategories[iVar].size(); i++) {
+				size_t iCat = dependentCategories[iVar][i];
+				chi2 += smearer.ZeeCategories[iCat].nll - categoryNLLStart[iCat];
+			}
+			scans[iVar].Set(chi2);
+			if(scans[iVar].Done()) vars[iVar]->setVal(v1[iVar]);
+		}
+	}
+
+	// update in sequence as MinProfile: the NLL of the next parameters includes the improvement of the previous ones
+	bool changed = false;
+	Double_t offset = 0;
+	for(size_t iVar = 0; iVar < vars.size(); iVar++) {
+		RooRealVar *var = vars[iVar];
+		if(scans[iVar].NoSensitivity()) { // in case of no sensitivity to the variable it is put has constant
+			std::cerr << "[WARNING] No sensitivity to var: " << var->GetName() << std::endl;
+			var->setVal(v1[iVar]);
+			var->setConstant();
+			continue;
+		}
+		Double_t xMin = scans[iVar].GetMinX();
+		Double_t chi2 = scans[iVar].GetMinNLL() + offset;
+		bool varChanged = false;
+		if(chi2 < min) { // updated absolute minimum
+			min = chi2;
+			if(v1[iVar] != xMin) varChanged = true; //the value has been updated, need a new iteration
+		}
+
+		if(min < min_old || varChanged) {
+			std::cout << "[INFO] Updating variable:" << var->GetName() << " from " << v1[iVar] << " to " << xMin  << std::endl
+			          << "       min = " << min << "; chi2-min =  " << chi2 - min << std::endl;
+			var->setVal(xMin);
+			offset += scans[iVar].GetMinNLL() - nllStart;
+		} else {
+			std::cout << "[INFO] Not-Updating variable:" << var->GetName() << "\t" << xMin
+			          << " " << min << " " << chi2 - min << std::endl;
+		}
+		changed = changed || varChanged;
+	}
 	return changed;
 }
 
@@ -783,54 +1328,39 @@ bool MinProfile2D(RooRealVar *var1, RooRealVar *var2, RooSmearer& smearer, int i
 	//sqrt(<E>) = DeltaS/DeltaC
 	Emean = var2->getVal() / rho;
 
-	std::cout << "--------------------------------- GetProfile for " << var1->GetName() << std::endl;
-	TGraph 	*g1 = GetProfile(var1, smearer, iProfile, false, false, rho, Emean); // take only the binning
-	std::cout << "--------------------------------- GetProfile for " << var2->GetName() << std::endl;
-	TGraph 	*g2 = GetProfile(var2, smearer, iProfile, false, false, rho, Emean); // take only the binning
-
-	Double_t 	*X1    = g1->GetX();
-	Double_t 	*X2    = g2->GetX();
-	Int_t 	 N    = g1->GetN();
-
-	if(N != g2->GetN()) {
-		std::cerr << "[ERROR] N1!=N2 for phi minimization: " << N << "\t" << g2->GetN() << std::endl;
-		exit(1);
-	}
-
-
-	Double_t *Y = g1->GetY();
-
-	//Int_t iLocMin1=0, iLocMin2,
-	Int_t iLocMin2Prev = 10;
-	//Double_t      Y2[PROFILE_NBINS];
-	for(Int_t i2 = 0; i2 < N; i2++) { // reset Y values
-		Y[i2] = 0;
-		//    if(X1[iLocMin2Prev]<v1) iLocMin2Prev++;
+	// line search along phi, with the parametrization of GetProfile(var, smearer, level, ..., rho, Emean):
+	// alpha = rho * Emean * cos(phi), constTerm = rho * sin(phi)
+	TString name1(var1->GetName()), name2(var2->GetName());
+	const Double_t phiBinWidth = 0.025; // GetProfile grid
+	std::cout << "[STATUS] Starting MinProfile for " << "phi" << "\t" << iProfile << std::endl;
+	BrentScan1D scan(10 * phiBinWidth, 10 * phiBinWidth, 0, M_PI_2, 0.25 * phiBinWidth,
+	                 std::max(smearer.GetNllRMS(), (double) BRENT_NLL_TOLERANCE));
+	while(!scan.Done()) {
+		Double_t phi = scan.Next();
+		var1->setVal(name1.Contains("alpha") ? rho * Emean * cos(phi) : rho * sin(phi));
+		var2->setVal(name2.Contains("alpha") ? rho * Emean * cos(phi) : rho * sin(phi));
+		scan.Set(smearer.evaluate());
 	}
-
-
-	std::cout << "[STATUS] Starting MinProfile for " << "phi" << "\t" << iProfile << "\t" << iLocMin2Prev << std::endl;
-	Int_t iMin_ = -1; // minimum of the graph
-	locmin = 1e20;
-	//find minimum
-	iMin_ = FindMin1D(var1, X1, N, iLocMin2Prev, locmin, smearer, true, Y, var2, X2);
-	if(iMin_ < 0) { // in case of no sensitivity to the variable it is put has constant and the minimization is interrupted
+	if(scan.NoSensitivity()) { // in case of no sensitivity to the variable it is put has constant and the minimization is interrupted
 		var1->setVal(v1);
 		var1->setConstant();
 		var2->setVal(v2);
 		var2->setConstant();
 		return false;
 	}
+	Double_t x1Min = name1.Contains("alpha") ? rho * Emean * cos(scan.GetMinX()) : rho * sin(scan.GetMinX());
+	Double_t x2Min = name2.Contains("alpha") ? rho * Emean * cos(scan.GetMinX()) : rho * sin(scan.GetMinX());
+	std::cout << "[INFO] Line search for phi: " << scan.GetNEvaluations() << " evaluations" << std::endl;
 
-	chi2 = Y[iMin_];
+	chi2 = scan.GetMinNLL();
 	// reset initial values
 	var1->setVal(v1);
 	var2->setVal(v2);
 
 	if(chi2 < min) { // updated absolute minimum
 		min = chi2;
-		if(var1->getVal() != X1[iMin_]) changed = true; //the value has been updated, need a new iteration
-		if(var2->getVal() != X2[iMin_]) changed = true; //the value has been updated, need a new iteration
+		if(var1->getVal() != x1Min) changed = true; //the value has been updated, need a new iteration
+		if(var2->getVal() != x2Min) changed = true; //the value has been updated, need a new iteration
 	}
 
 	myClock.Stop();
@@ -839,8 +1369,8 @@ bool MinProfile2D(RooRealVar *var1, RooRealVar *var2, RooSmearer& smearer, int i
 	//------------------------------ making the 2D scan around the minimum
 	if(update == false && dscan == true) {
 		myClock.Start();
-		var1->setVal(X1[iMin_]);
-		var2->setVal(X2[iMin_]);
+		var1->setVal(x1Min);
+		var2->setVal(x2Min);
 		TGraph 	*G1 = GetProfile(var1, smearer, -1, false, false); // take only the binning
 		TGraph 	*G2 = GetProfile(var2, smearer, -1, false, false); // take only the binning
 		Double_t *XG1 = G1->GetX();
@@ -848,12 +1378,12 @@ bool MinProfile2D(RooRealVar *var1, RooRealVar *var2, RooSmearer& smearer, int i
 		Int_t iBin1 = 0, iBin2 = 0;
 
 
-		while(XG1[iBin1] < X1[iMin_]) { //nearest bin to the minimum
-			//std::cout << "[DEBUG] Nearest bin to minimum: " << iBin1 << "\t" << XG1[iBin1] << "  " << X1[iMin_] << std::endl;
+		while(XG1[iBin1] < x1Min) { //nearest bin to the minimum
+			//std::cout << "[DEBUG] Nearest bin to minimum: " << iBin1 << "\t" << XG1[iBin1] << "  " << x1Min << std::endl;
 			iBin1++;
 		}
-		while(XG2[iBin2] < X2[iMin_]) { //nearest bin to the minimum
-			//std::cout << "[DEBUG] Nearest bin to minimum: " << iBin2 << "\t" << XG2[iBin2] << "  " << X2[iMin_] << std::endl;
+		while(XG2[iBin2] < x2Min) { //nearest bin to the minimum
+			//std::cout << "[DEBUG] Nearest bin to minimum: " << iBin2 << "\t" << XG2[iBin2] << "  " << x2Min << std::endl;
 			iBin2++;
 		}
 		Int_t iBin1min = std::max(iBin1 - 6, 0);
@@ -897,21 +1427,19 @@ bool MinProfile2D(RooRealVar *var1, RooRealVar *var2, RooSmearer& smearer, int i
 
 	if(update && (min < min_old || changed)) {
 		// if a new minimum has been found now, or due to another variable, need to update the scale
-		std::cout << "[INFO] Updating variable:" << var1->GetName() << "\t" << X1[iMin_]
-		          << "\t" << var2->GetName() << "\t" << X2[iMin_]
-		          << " " << min << " " << Y[iMin_] - min << std::endl;
-		var1->setVal(X1[iMin_]);
-		var2->setVal(X2[iMin_]);
+		std::cout << "[INFO] Updating variable:" << var1->GetName() << "\t" << x1Min
+		          << "\t" << var2->GetName() << "\t" << x2Min
+		          << " " << min << " " << chi2 - min << std::endl;
+		var1->setVal(x1Min);
+		var2->setVal(x2Min);
 	} else {
-		std::cout << "[INFO] Not-Updating variable:" << var1->GetName() << "\t" << X1[iMin_]  << std::endl
-		          << "                             " << var2->GetName() << "\t" << X2[iMin_]  << std::endl
-		          << " " << min << " " << Y[iMin_] - min << std::endl;
+		std::cout << "[INFO] Not-Updating variable:" << var1->GetName() << "\t" << x1Min  << std::endl
+		          << "                             " << var2->GetName() << "\t" << x2Min  << std::endl
+		          << " " << min << " " << chi2 - min << std::endl;
 	}
 	std::cout << "[INFO] Level " << iProfile << " variable:" << var1->GetName() << "\t" << var1->getVal() << "\t" << min << std::endl;
 	std::cout << "[INFO] Level " << iProfile << " variable:" << var2->GetName() << "\t" << var2->getVal() << "\t" << min << std::endl;
 
-	delete g1;
-	delete g2;
 #ifdef MEM_DEBUG
 	gSystem->GetProcInfo(&info);
 	std::cout << "GET MEM INFO JUST BEFORE END MinProfile2D " << info.fMemResident << std::endl;
@@ -924,83 +1452,497 @@ bool MinProfile2D(RooRealVar *var1, RooRealVar *var2, RooSmearer& smearer, int i
 
 
 
-void MinimizationProfile(RooSmearer& smearer, RooArgSet args, long unsigned int nIterMCMC, bool mcmc)
+ProfileCheckpoint::ProfileCheckpoint(TString fileName, double interval):
+	phase(0), nIter(0), min(999999999.), min_old(9999999999.), updateError(false),
+	_fileName(fileName), _interval(interval), _lastSave(time(NULL)), _resumed(false)
+{
+}
+
+void ProfileCheckpoint::Save(RooArgSet args, RooSmearer& smearer, bool force)
+{
+	if(_fileName == "") return;
+	if(!force && difftime(time(NULL), _lastSave) < _interval) return;
+
+	TDirectory *dir = gDirectory;
+	TString tmpFileName = _fileName + ".tmp";
+	TFile f(tmpFileName, "recreate");
+	if(!f.IsOpen() || f.IsZombie()) {
+		std::cerr << "[WARNING] Cannot write the checkpoint file: " << tmpFileName << std::endl;
+		dir->cd();
+		return;
+	}
+	// Write returns the number of bytes written, 0 on failure
+	RooArgSet *params = (RooArgSet *) args.snapshot(kFALSE);
+	bool written = params->Write("params", TObject::kSingleKey) > 0;
+
+	TVectorD state(6);
+	state(0) = phase;
+	state(1) = nIter;
+	state(2) = min;
+	state(3) = min_old;
+	state(4) = updateError;
+	state(5) = smearer.nllMin;
+	written = state.Write("state") > 0 && written;
+
+	TString doneParams;
+	for(std::set<std::string>::const_iterator itr = _doneParams.begin(); itr != _doneParams.end(); itr++) {
+		doneParams += *itr;
+		doneParams += " ";
+	}
+	written = TNamed("doneParams", doneParams.Data()).Write() > 0 && written;
+	written = smearer._markov.Write("markov") > 0 && written;
+	f.Close();
+	delete params;
+	dir->cd();
+
+	// the old checkpoint is replaced only by a complete one
+	if(!written || f.IsZombie()) {
+		std::cerr << "[WARNING] Cannot write the checkpoint file: " << tmpFileName << ", keeping the previous checkpoint" << std::endl;
+		gSystem->Unlink(tmpFileName);
+		return;
+	}
+	if(gSystem->Rename(tmpFileName, _fileName) != 0) {
+		std::cerr << "[WARNING] Cannot rename " << tmpFileName << " to " << _fileName << std::endl;
+		return;
+	}
+	_lastSave = time(NULL);
+	std::cout << "[INFO] Checkpoint saved: " << _fileName << "\tphase=" << phase << "\tnIter=" << nIter << std::endl;
+	return;
+}
+
+bool ProfileCheckpoint::Load(RooArgSet args, RooSmearer& smearer)
+{
+	if(_fileName == "" || gSystem->AccessPathName(_fileName)) {
+		std::cout << "[INFO] No checkpoint to resume: " << _fileName << std::endl;
+		return false;
+	}
+
+	TDirectory *dir = gDirectory;
+	TFile f(_fileName, "read");
+	RooArgSet *params = (RooArgSet *) f.Get("params");
+	TVectorD *state = (TVectorD *) f.Get("state");
+	TNamed *doneParams = (TNamed *) f.Get("doneParams");
+	RooStats::MarkovChain *markov = (RooStats::MarkovChain *) f.Get("markov");
+	if(params == NULL || state == NULL || doneParams == NULL || markov == NULL) {
+		std::cerr << "[ERROR] Checkpoint file not valid: " << _fileName << std::endl;
+		exit(1);
+	}
+
+	RooArgList argList(args);
+	for(int i = 0; i < argList.getSize(); i++) {
+		RooRealVar *var = (RooRealVar *) argList.at(i);
+		RooRealVar *saved = (RooRealVar *) params->find(var->GetName());
+		if(saved == NULL) {
+			std::cerr << "[WARNING] Parameter " << var->GetName() << " not in the checkpoint" << std::endl;
+			continue;
+		}
+		var->setVal(saved->getVal());
+		var->setError(saved->getError());
+		var->setConstant(saved->isConstant());
+	}
+
+	phase = (int)(*state)(0);
+	nIter = (int)(*state)(1);
+	min = (*state)(2);
+	min_old = (*state)(3);
+	updateError = (*state)(4) != 0;
+	smearer.nllMin = (*state)(5);
+
+	_doneParams.clear();
+	TObjArray *names = TString(doneParams->GetTitle()).Tokenize(" ");
+	for(int i = 0; i < names->GetEntries(); i++) _doneParams.insert(((TObjString *) names->At(i))->GetString().Data());
+	delete names;
+
+	for(int i = 0; i < markov->Size(); i++) {
+		smearer._markov.AddFast(*((RooArgSet *) markov->Get(i)), markov->NLL(i), markov->Weight(i));
+	}
+
+	f.Close();
+	delete params;
+	delete state;
+	delete doneParams;
+	delete markov;
+	dir->cd();
+
+	_resumed = true;
+	_lastSave = time(NULL);
+	std::cout << "[INFO] Resuming from checkpoint: " << _fileName << "\tphase=" << phase << "\tnIter=" << nIter << std::endl;
+	return true;
+}
+
+void MinimizationProfile(RooSmearer& smearer, RooArgSet args, long unsigned int nIterMCMC, bool mcmc, ProfileCheckpoint *checkpoint, bool surrogate)
 {
+	ProfileCheckpoint noCheckpoint;
+	ProfileCheckpoint& state = (checkpoint != NULL) ? *checkpoint : noCheckpoint;
+
 	std::cout << "------------------------------------------------------------" << std::endl;
-	std::cout << "[INFO] Minimization: profile" << std::endl;
-	std::cout << "[INFO] Re-initialize nllMin: 1e20"  << std::endl;
-	smearer.nllMin = 1e20;
+	std::cout << "[INFO] Minimization: profile" << (surrogate ? " with surrogate line searches" : "") << std::endl;
+	if(!state.IsResumed()) {
+		std::cout << "[INFO] Re-initialize nllMin: 1e20"  << std::endl;
+		smearer.nllMin = 1e20;
+	}
 
 	std::cout << "[INFO] Setting initial evaluation" << std::endl;
 	smearer.evaluate();
-	Double_t 	min_old	    = 9999999999.;
-	Double_t 	min	    = 999999999.;
-	bool 	updateError = false;
-	int nIter = 0;
+	Double_t& 	min_old	    = state.min_old;
+	Double_t& 	min	    = state.min;
+	bool& 	updateError = state.updateError;
+	int& nIter = state.nIter;
 	TStopwatch myClock;
 	myClock.Start();
 
-	std::cout << "[INFO] Starting scale minimization" << std::endl;
 	RooArgList 	 argList_(args);
 	TIterator 	*it_   = NULL;
-	while((min < min_old || updateError == true) && nIter < 3) {
-		updateError = false;
-		TStopwatch iterClock;
-		iterClock.Start();
-		if(min < min_old) min_old = min;
-		it_ = argList_.createIterator();
-		for(RooRealVar *var = (RooRealVar*)it_->Next(); var != NULL; var = (RooRealVar*)it_->Next()) {
-			if (var->isConstant() || !var->isLValue()) continue;
-			TString  name(var->GetName());
-			if(!name.Contains("scale")) continue; // looping only for the scale
-			updateError += MinProfile(var, smearer, -1, min_old, min);
+	if(state.phase == 0) {
+		std::cout << "[INFO] Starting scale minimization" << std::endl;
+		while(state.InIteration() || ((min < min_old || updateError == true) && nIter < 3)) {
+			if(!state.InIteration()) { // not resuming an interrupted iteration
+				updateError = false;
+				if(min < min_old) min_old = min;
+			}
+			TStopwatch iterClock;
+			iterClock.Start();
+			it_ = argList_.createIterator();
+			std::vector<RooRealVar *> scaleVars;
+			for(RooRealVar *var = (RooRealVar*)it_->Next(); var != NULL; var = (RooRealVar*)it_->Next()) {
+				if (var->isConstant() || !var->isLValue()) continue;
+				TString  name(var->GetName());
+				if(!name.Contains("scale")) continue; // looping only for the scale
+				if(state.IsDone(var)) continue;
+				scaleVars.push_back(var);
+			}
+			delete it_;
+			// scales with no category in common are profiled together,
+			// one at a time with the surrogate: it uses the points with all the other parameters fixed
+			std::vector<std::vector<RooRealVar *> > groups;
+			if(surrogate) {
+				for(size_t iVar = 0; iVar < scaleVars.size(); iVar++) groups.push_back(std::vector<RooRealVar *>(1, scaleVars[iVar]));
+			} else groups = GroupIndependentParameters(scaleVars, smearer);
+			for(size_t iGroup = 0; iGroup < groups.size(); iGroup++) {
+				if(surrogate) updateError += MinProfile(groups[iGroup][0], smearer, -1, min_old, min, 0, 0, true, false, true);
+				else updateError += MinProfileGroup(groups[iGroup], smearer, -1, min_old, min);
+				for(size_t iVar = 0; iVar < groups[iGroup].size(); iVar++) state.SetDone(groups[iGroup][iVar]);
+				state.Save(args, smearer);
+			}
+			iterClock.Stop();
+			std::cout << "[INFO] nIter scale: " << nIter << "\t";
+			iterClock.Print();
+			nIter++;
+			state.ClearDone();
+			state.Save(args, smearer, true);
 		}
-		delete it_;
-		iterClock.Stop();
-		std::cout << "[INFO] nIter scale: " << nIter << "\t";
-		iterClock.Print();
-		nIter++;
+
+		std::cout << "[STATUS] Scale minimization done";
+		std::cout << "------------------------------" << std::endl;
+
+		//minimization of additional smearing
+		updateError = true;
+		min_old = min;
+		nIter = 0;
+		state.phase = 1;
+		state.Save(args, smearer, true);
 	}
 
-	std::cout << "[STATUS] Scale minimization done";
-	std::cout << "------------------------------" << std::endl;
-	std::cout << "[STATUS] Smearing + scale minimization starting" << std::endl;
-
-	//minimization of additional smearing
-	updateError = true;
-	min_old = min;
-	nIter = 0;
-	while((min < min_old && nIter < 5) || (updateError == true && nIter < 2)) {
-		updateError = false;
-		TStopwatch iterClock;
-		iterClock.Start();
-		it_ = argList_.createIterator();
-		if(min < min_old) min_old = min;
-		for(RooRealVar *var = (RooRealVar*)it_->Next(); var != NULL; var = (RooRealVar*)it_->Next()) {
-			if (var->isConstant()) continue;
-			TString  name(var->GetName());
-			// special part for alpha fitting
-			TString  alphaName = name;
-			alphaName.ReplaceAll("constTerm", "alpha");
-			RooRealVar *var2 = name.Contains("constTerm") ? (RooRealVar *)argList_.find(alphaName) : NULL;
-			if(name.Contains("alpha")) continue; //if alpha parameter exists, need a 2D scan
-			//if(var2!=NULL && var2->isConstant()) var2=NULL; // to use MinProfile 1D instead of 2D
-			//taking large profile
-			if(var2 == NULL || var2->isConstant()) MinProfile(var, smearer, -1, min_old, min); //updateError += MinProfile(var, smearer, iProfile, min_old, min);
-			else {
-				//if(mcmc && iProfile>2) updateError += MinMCMC2D(var, var2, smearer, iProfile, min_old, min, nIterMCMC);
-				//  else
-				double rho = 0, Emean = 0;
-				updateError += MinProfile2D(var, var2, smearer, -1, min_old, min, rho, Emean);
+	if(state.phase == 1) {
+		std::cout << "[STATUS] Smearing + scale minimization starting" << std::endl;
+		while(state.InIteration() || (min < min_old && nIter < 5) || (updateError == true && nIter < 2)) {
+			if(!state.InIteration()) { // not resuming an interrupted iteration
+				updateError = false;
+				if(min < min_old) min_old = min;
+			}
+			TStopwatch iterClock;
+			iterClock.Start();
+			it_ = argList_.createIterator();
+			for(RooRealVar *var = (RooRealVar*)it_->Next(); var != NULL; var = (RooRealVar*)it_->Next()) {
+				if (var->isConstant()) continue;
+				if(state.IsDone(var)) continue;
+				TString  name(var->GetName());
+				// special part for alpha fitting
+				TString  alphaName = name;
+				alphaName.ReplaceAll("constTerm", "alpha");
+				RooRealVar *var2 = name.Contains("constTerm") ? (RooRealVar *)argList_.find(alphaName) : NULL;
+				if(name.Contains("alpha")) continue; //if alpha parameter exists, need a 2D scan
+				//if(var2!=NULL && var2->isConstant()) var2=NULL; // to use MinProfile 1D instead of 2D
+				//taking large profile
+				if(var2 == NULL || var2->isConstant()) MinProfile(var, smearer, -1, min_old, min, 0, 0, true, false, surrogate); //updateError += MinProfile(var, smearer, iProfile, min_old, min);
+				else {
+					//if(mcmc && iProfile>2) updateError += MinMCMC2D(var, var2, smearer, iProfile, min_old, min, nIterMCMC);
+					//  else
+					double rho = 0, Emean = 0;
+					updateError += MinProfile2D(var, var2, smearer, -1, min_old, min, rho, Emean);
+				}
+				state.SetDone(var);
+				state.Save(args, smearer);
+			}
+			delete it_;
+			iterClock.Stop();
+			std::cout << "[DEBUG] nIter= " << nIter << "\t";
+			iterClock.Print();
+			nIter++;
+			smearer.GetParams().writeToStream(std::cout, kFALSE);
+			state.ClearDone();
+			state.Save(args, smearer, true);
+		}
+		state.phase = 2;
+		state.Save(args, smearer, true);
+	}
+}
+
+namespace
+{
+/// lower triangular L (row-major) with L*L^T = cov: false if cov is not positive definite
+bool Cholesky(const std::vector<double>& cov, unsigned int d, std::vector<double>& L)
+{
+	L.assign(d * d, 0.);
+	for(unsigned int i = 0; i < d; i++) {
+		for(unsigned int j = 0; j <= i; j++) {
+			double sum = cov[i * d + j];
+			for(unsigned int k = 0; k < j; k++) sum -= L[i * d + k] * L[j * d + k];
+			if(i == j) {
+				if(sum <= 0) return false;
+				L[i * d + i] = sqrt(sum);
+			} else L[i * d + j] = sum / L[j * d + j];
+		}
+	}
+	return true;
+}
+
+bool InRange(const std::vector<RooRealVar *>& vars, const std::vector<double>& x)
+{
+	for(unsigned int i = 0; i < vars.size(); i++) {
+		if(x[i] < vars[i]->getMin() || x[i] > vars[i]->getMax()) return false;
+	}
+	return true;
+}
+
+/// running mean and covariance (Welford)
+class RunningCovariance
+{
+public:
+	RunningCovariance(unsigned int d): n(0), mean(d, 0.), m2(d * d, 0.) {};
+
+	void Add(const std::vector<double>& x) {
+		unsigned int d = mean.size();
+		std::vector<double> delta(d);
+		n++;
+		for(unsigned int i = 0; i < d; i++) {
+			delta[i] = x[i] - mean[i];
+			mean[i] += delta[i] / n;
+		}
+		for(unsigned int i = 0; i < d; i++) {
+			for(unsigned int j = 0; j < d; j++) m2[i * d + j] += delta[i] * (x[j] - mean[j]);
+		}
+	};
+	inline double Cov(unsigned int i, unsigned int j) const {
+		return (n > 1) ? m2[i * mean.size() + j] / (n - 1) : 0;
+	};
+
+	unsigned long n;
+	std::vector<double> mean;
+	std::vector<double> m2;
+};
+}
+
+void SampleEnsembleMCMC(RooSmearer& smearer, RooArgSet args, unsigned int nSteps, unsigned int nWalkers,
+                        unsigned int nBurnIn, NLLRecorder& chain, unsigned int seed)
+{
+	std::vector<RooRealVar *> vars;
+	RooArgList floatList;
+	RooArgList argList(args);
+	for(int i = 0; i < argList.getSize(); i++) {
+		RooRealVar *var = (RooRealVar *) argList.at(i);
+		if(var->isConstant() || !var->isLValue()) continue;
+		vars.push_back(var);
+		floatList.add(*var);
+	}
+	unsigned int d = vars.size();
+	if(d == 0 || nWalkers < 2) {
+		std::cerr << "[ERROR] Ensemble MCMC needs at least one floating parameter and two walkers" << std::endl;
+		exit(1);
+	}
+	if(nWalkers < 2 * d) {
+		std::cerr << "[WARNING] Ensemble MCMC: " << nWalkers << " walkers for " << d << " parameters, at least "
+		          << 2 * d << " are recommended for the stretch move" << std::endl;
+	}
+
+	chain.SetParameters(args);
+
+	TRandom3 gen(seed);
+	// initial spread of the walkers from the errors of the parameters
+	std::vector<double> x0(d), err0(d);
+	for(unsigned int i = 0; i < d; i++) {
+		x0[i] = vars[i]->getVal();
+		err0[i] = vars[i]->getError();
+		if(err0[i] <= 0) err0[i] = 0.01 * (vars[i]->getMax() - vars[i]->getMin());
+	}
+
+	// walkers in a small ball around the current values
+	std::vector<std::vector<double> > walkers(nWalkers, x0);
+	for(unsigned int iWalker = 1; iWalker < nWalkers; iWalker++) {
+		for(unsigned int iTry = 0; iTry < 100; iTry++) {
+			for(unsigned int i = 0; i < d; i++) walkers[iWalker][i] = x0[i] + gen.Gaus(0, 0.1 * err0[i]);
+			if(InRange(vars, walkers[iWalker])) break;
+			walkers[iWalker] = x0;
+		}
+	}
+	std::vector<double> nll = smearer.EvaluatePoints(floatList, walkers);
+
+	// stretch move of Goodman and Weare, z distributed as 1/sqrt(z) in [1/a, a]
+	const double a = 2.;
+	RunningCovariance posterior(d);
+	unsigned long nAccepted = 0, nProposed = 0;
+	TStopwatch clock;
+	clock.Start();
+	for(unsigned int iStep = 0; iStep < nBurnIn + nSteps; iStep++) {
+		bool burnIn = iStep < nBurnIn;
+
+		// the ensemble is split in two halves: the walkers of one half move along the
+		// lines to random walkers of the other half, all the proposals of a half in one batch
+		unsigned int nAcceptedStep = 0;
+		for(unsigned int iHalf = 0; iHalf < 2; iHalf++) {
+			unsigned int first = (iHalf == 0) ? 0 : nWalkers / 2, last = (iHalf == 0) ? nWalkers / 2 : nWalkers;
+			unsigned int otherFirst = (iHalf == 0) ? nWalkers / 2 : 0, nOther = nWalkers - (last - first);
+
+			// proposals out of the range of the parameters are rejected without evaluation
+			std::vector<std::vector<double> > proposals;
+			std::vector<unsigned int> proposalWalker;
+			std::vector<double> proposalZ;
+			for(unsigned int iWalker = first; iWalker < last; iWalker++) {
+				const std::vector<double>& other = walkers[otherFirst + gen.Integer(nOther)];
+				double z = (a - 1) * gen.Uniform() + 1;
+				z = z * z / a;
+				std::vector<double> y(d);
+				for(unsigned int i = 0; i < d; i++) y[i] = other[i] + z * (walkers[iWalker][i] - other[i]);
+				if(!InRange(vars, y)) continue;
+				proposals.push_back(y);
+				proposalWalker.push_back(iWalker);
+				proposalZ.push_back(z);
+			}
+			std::vector<double> nllProposals;
+			if(!proposals.empty()) nllProposals = smearer.EvaluatePoints(floatList, proposals);
+
+			for(unsigned int iProposal = 0; iProposal < proposals.size(); iProposal++) {
+				unsigned int iWalker = proposalWalker[iProposal];
+				if(log(gen.Uniform()) < (d - 1) * log(proposalZ[iProposal]) + nll[iWalker] - nllProposals[iProposal]) {
+					walkers[iWalker] = proposals[iProposal];
+					nll[iWalker] = nllProposals[iProposal];
+					nAcceptedStep++;
+				}
+			}
+		}
+
+		if(!burnIn) {
+			nAccepted += nAcceptedStep;
+			nProposed += nWalkers;
+			for(unsigned int iWalker = 0; iWalker < nWalkers; iWalker++) {
+				for(unsigned int i = 0; i < d; i++) vars[i]->setVal(walkers[iWalker][i]);
+				chain.Add(nll[iWalker], 1);
+				posterior.Add(walkers[iWalker]);
+			}
+		}
+
+		if(iStep % 10 == 0 || iStep + 1 == nBurnIn + nSteps) {
+			std::cout << "[STATUS] Ensemble MCMC step " << iStep << (burnIn ? " (burn-in)" : "")
+			          << "\tacceptance: " << (double)nAcceptedStep / nWalkers
+			          << "\tmin NLL: " << *std::min_element(nll.begin(), nll.end()) << std::endl;
+		}
+	}
+	clock.Stop();
+
+	std::cout << "[INFO] Ensemble MCMC: " << nWalkers << " walkers, " << nSteps << " steps after " << nBurnIn << " burn-in steps"
+	          << "\tacceptance: " << ((nProposed > 0) ? (double)nAccepted / nProposed : 0) << "\t";
+	clock.Print();
+	for(unsigned int i = 0; i < d; i++) {
+		if(posterior.n > 0) {
+			vars[i]->setVal(posterior.mean[i]);
+			vars[i]->setError(sqrt(posterior.Cov(i, i)));
+		} else vars[i]->setVal(x0[i]);
+		std::cout << "[INFO] Posterior " << vars[i]->GetName() << "\t" << vars[i]->getVal() << " +/- " << vars[i]->getError() << std::endl;
+	}
+	smearer.evaluate();
+	return;
+}
+
+void HessianCovariance(RooSmearer& smearer, RooArgSet args, TString fileName)
+{
+	// floating parameters not at a limit: the finite differences need x +/- h inside the range
+	std::vector<RooRealVar *> vars;
+	std::vector<double> steps;
+	RooArgList pars;
+	RooArgList argList(args);
+	for(int i = 0; i < argList.getSize(); i++) {
+		RooRealVar *var = (RooRealVar *) argList.at(i);
+		if(var->isConstant() || !var->isLValue()) continue;
+		double nominal = HESSIAN_STEP * LineSearchBinWidth(var);
+		double step = std::min(nominal, std::min(var->getVal() - var->getMin(), var->getMax() - var->getVal()));
+		if(step < 0.2 * nominal) {
+			std::cout << "[WARNING] " << var->GetName() << " at the limit of its range: not in the covariance matrix" << std::endl;
+			continue;
+		}
+		vars.push_back(var);
+		steps.push_back(step);
+		pars.add(*var);
+	}
+	unsigned int d = vars.size();
+	if(d == 0) {
+		std::cout << "[WARNING] No parameter for the covariance matrix" << std::endl;
+		return;
+	}
+
+	std::cout << "[STATUS] Hessian of the NLL at the minimum" << std::endl;
+	std::vector<double> hessian;
+	smearer.GetNLLHessian(pars, &steps[0], smearer.GetDependentCategories(pars), hessian);
+
+	// the NLL is -log(likelihood): covariance = hessian^-1, inverted from the Cholesky decomposition
+	std::vector<double> L, cov(d * d, 0.);
+	bool posDef = Cholesky(hessian, d, L);
+	if(posDef) {
+		std::vector<double> Linv(d * d, 0.); // lower triangular
+		for(unsigned int i = 0; i < d; i++) {
+			Linv[i * d + i] = 1. / L[i * d + i];
+			for(unsigned int j = 0; j < i; j++) {
+				double sum = 0;
+				for(unsigned int k = j; k < i; k++) sum += L[i * d + k] * Linv[k * d + j];
+				Linv[i * d + j] = -sum / L[i * d + i];
+			}
+		}
+		for(unsigned int i = 0; i < d; i++) {
+			for(unsigned int j = 0; j < d; j++) {
+				for(unsigned int k = std::max(i, j); k < d; k++) cov[i * d + j] += Linv[k * d + i] * Linv[k * d + j];
 			}
 		}
-		delete it_;
-		iterClock.Stop();
-		std::cout << "[DEBUG] nIter= " << nIter << "\t";
-		iterClock.Print();
-		nIter++;
-		smearer.GetParams().writeToStream(std::cout, kFALSE);
+	} else {
+		std::cout << "[WARNING] Hessian not positive definite: only the diagonal covariance terms are given" << std::endl;
+		for(unsigned int i = 0; i < d; i++) {
+			if(hessian[i * d + i] > 0) cov[i * d + i] = 1. / hessian[i * d + i];
+		}
+	}
+
+	std::ofstream f(fileName);
+	// the errors are printed anyway: the writes on a stream not opened do nothing
+	if(!f.good()) std::cerr << "[WARNING] Cannot open the covariance file " << fileName << ": not written" << std::endl;
+	f << "# covariance of the parameters from the hessian of the NLL" << (posDef ? "" : " (not positive definite: diagonal only)") << std::endl;
+	f << "#parameter\tvalue\terror\tstep" << std::endl;
+	for(unsigned int i = 0; i < d; i++) {
+		f << vars[i]->GetName() << "\t" << vars[i]->getVal() << "\t" << sqrt(cov[i * d + i]) << "\t" << steps[i] << std::endl;
+		std::cout << "[INFO] Hessian error " << vars[i]->GetName() << "\t" << vars[i]->getVal() << " +/- " << sqrt(cov[i * d + i]) << std::endl;
 	}
+	for(unsigned int iMatrix = 0; iMatrix < 2; iMatrix++) {
+		f << (iMatrix == 0 ? "#covariance" : "#correlation");
+		for(unsigned int j = 0; j < d; j++) f << "\t" << vars[j]->GetName();
+		f << std::endl;
+		for(unsigned int i = 0; i < d; i++) {
+			f << vars[i]->GetName();
+			for(unsigned int j = 0; j < d; j++) {
+				double norm = sqrt(cov[i * d + i] * cov[j * d + j]);
+				if(iMatrix == 0) f << "\t" << cov[i * d + j];
+				else f << "\t" << (norm > 0 ? cov[i * d + j] / norm : 0.);
+			}
+			f << std::endl;
+		}
+	}
+	f.close();
+	return;
 }
 
 
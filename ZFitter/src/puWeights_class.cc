@@ -10,16 +10,33 @@ puWeights_class::~puWeights_class()
 puWeights_class::puWeights_class(void):
 	warningCounter(0)
 {
-	PUweights_itr = PUWeightsRunDepMap.begin();
+	PUweights_itr = PUWeightsRunDepTable.end();
 }
 
+puWeights_class::puWeights_class(const puWeights_class& weights):
+	PUWeightsRunDepMap(weights.PUWeightsRunDepMap),
+	PUWeightsRunDepTable(weights.PUWeightsRunDepTable),
+	warningCounter(0)
+{
+	PUweights_itr = PUWeightsRunDepTable.end();
+}
+
+void puWeights_class::Compile()
+{
+	PUWeightsRunDepTable.clear();
+	for(PUWeightsRunDepMap_t::const_iterator itr = PUWeightsRunDepMap.begin(); itr != PUWeightsRunDepMap.end(); itr++) {
+		if(itr->second.empty()) continue;
+		PUWeightsRunDepTable.insert(std::pair<int, WeightArray>(itr->first, WeightArray(itr->second)));
+	}
+	PUweights_itr = PUWeightsRunDepTable.end();
+}
 
 
 double puWeights_class::GetWeight(int nPU, int runNumber)
 {
-	if(PUweights_itr->first != runNumber) {
-		PUweights_itr = PUWeightsRunDepMap.find(runNumber);
-		if(PUweights_itr == PUWeightsRunDepMap.end() || PUweights_itr->second.empty()) {
+	if(PUweights_itr == PUWeightsRunDepTable.end() || PUweights_itr->first != runNumber) {
+		PUweights_itr = PUWeightsRunDepTable.find(runNumber);
+		if(PUweights_itr == PUWeightsRunDepTable.end()) {
 			warningCounter++;
 			if(warningCounter <= 10) {
 				std::cerr << "[WARNING] runNumber " << runNumber << " not found in PUWeightsRunDepMap" << std::endl;
@@ -28,19 +45,19 @@ double puWeights_class::GetWeight(int nPU, int runNumber)
 		}
 	}
 
-	PUweights_t::const_iterator weight_itr = PUweights_itr->second.find(nPU);
-	if(weight_itr == PUweights_itr->second.end()) {
+	double weight;
+	if(!PUweights_itr->second.Find(nPU, weight)) {
 		warningCounter++;
 		if(warningCounter <= 10) {
 			std::cerr << "[WARNING] in-time nPU " << nPU << " not found in weight files" << std::endl;
 			std::cerr << "          Events dropped with applying weight=0" << std::endl;
-			std::cerr << (PUweights_itr->second.begin()->first) << std::endl;
+			std::cerr << PUweights_itr->second.GetMinKey() << std::endl;
 		}
 		return 0;
 	}
 
 
-	return weight_itr->second;
+	return weight;
 }
 
 
@@ -99,6 +116,7 @@ void puWeights_class::ReadFromFile(std::string filename)
 	//     PUfile.Close();
 
 	f_pu.Close();
+	Compile();
 
 	return;
 }
@@ -198,42 +216,65 @@ void puWeights_class::ReadFromFiles(std::string mcPUFile, std::string dataPUFile
 		weights_itr->second[i] /= puMCweight_int;
 	}
 
-	PUweights_itr = PUWeightsRunDepMap.begin();
+	Compile();
 	if(TString(puMC_hist->GetName()).Contains("Hist")) delete puMC_hist;
 	return;
 }
 
-// tree is the input MC tree
-// fastLoop = false if for any reason you don't want to change the branch status of the MC tree
-TTree *puWeights_class::GetTreeWeight(TChain *tree,  bool fastLoop, TString nPUbranchName)
+namespace
+{
+class puWeightFiller: public BranchFiller
 {
-	TString runNumberBranchName = "runNumber";
-	Float_t weight = 0;
-	TTree *newTree = new TTree("pileup", nPUbranchName);
-	newTree->Branch("puWeight", &weight, "puWeight/F");
+public:
+	puWeightFiller(TString treename, TString nPUbranchName, const puWeights_class& weights):
+		BranchFiller(treename), _nPUbranchName(nPUbranchName), _weights(weights), weight(0)
+	{
+		_tree->SetTitle(nPUbranchName);
+	};
+
+	~puWeightFiller()
+	{
+		std::cout << "[WARNING] nPU > nPU max for " << _weights.GetWarningCounter() << " times" << std::endl;
+	};
+
+	bool Init(BranchProducer& producer)
+	{
+		nPU = producer.Input<UChar_t>(_nPUbranchName);
+		runNumber = producer.Input<Int_t>("runNumber");
+		if(nPU == NULL || runNumber == NULL) return false;
+		_tree->Branch("puWeight", &weight, "puWeight/F");
+		return true;
+	};
+
+	void Compute(Long64_t ientry)
+	{
+		weight = _weights.GetWeight((int) * nPU, *runNumber); //only intime pu
+	};
+
+private:
+	TString _nPUbranchName;
+	puWeights_class _weights;
+	const UChar_t *nPU;
+	const Int_t *runNumber;
+	Float_t weight;
+};
+}
 
-	if(fastLoop) {
-		tree->SetBranchStatus("*", 0);
-		tree->SetBranchStatus(nPUbranchName, 1);
-		tree->SetBranchStatus(runNumberBranchName, 1);
-	}
+BranchFiller *puWeights_class::NewFiller(TString treename, TString nPUbranchName)
+{
+	return new puWeightFiller(treename, nPUbranchName, *this);
+}
 
-	UChar_t nPU;
-	Int_t runNumber;
-	tree->SetBranchAddress(nPUbranchName, &nPU);
-	tree->SetBranchAddress(runNumberBranchName, &runNumber);
-	// loop over tree
-	for(Long64_t ientry = 0; ientry < tree->GetEntriesFast(); ientry++) {
-		tree->GetEntry(ientry);
-		weight = GetWeight((int)nPU, runNumber); //only intime pu
-		newTree->Fill();
+// tree is the input MC tree
+// fastLoop not used: only the input branches are read
+TTree *puWeights_class::GetTreeWeight(TChain *tree,  bool fastLoop, TString nPUbranchName)
+{
+	BranchProducer producer(tree);
+	if(!producer.Add(NewFiller("pileup", nPUbranchName))) {
+		std::cerr << "[ERROR] Branches " << nPUbranchName << " and runNumber not found, impossible to produce PU weights" << std::endl;
+		exit(1);
 	}
-
-
-	if(fastLoop) tree->SetBranchStatus("*", 1);
-	tree->ResetBranchAddresses();
-	std::cout << "[WARNING] nPU > nPU max for " << warningCounter << " times" << std::endl;
-	return newTree;
+	return producer.Run()[0];
 }
 
 
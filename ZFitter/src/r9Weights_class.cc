@@ -5,95 +5,111 @@ r9Weights_class::~r9Weights_class()
 
 }
 
+namespace
+{
+// names of the categories of GetWeight: |eta| ranges and R9 >= 0.94 (Gold) or not (Bad)
+const char *etaCategoryNames[4] = {"EBlowEta", "EBhighEta", "EElowEta", "EEhighEta"};
+const char *R9CategoryNames[2] = {"Gold", "Bad"};
+}
+
 r9Weights_class::r9Weights_class(void):
-	warningCounter(0)
+	ptTable(NULL), warningCounter(0)
+{
+	for(int i = 0; i < 4; i++) {
+		etaTables[i][0] = etaTables[i][1] = NULL;
+		R9Tables[i][0] = R9Tables[i][1] = NULL;
+	}
+}
+
+void r9Weights_class::Compile()
 {
+	r9tables.clear();
+	for(r9weights_map_t::const_iterator itr = r9weights.begin(); itr != r9weights.end(); itr++) {
+		r9tables.insert(std::pair<TString, WeightTable>(itr->first, WeightTable(itr->second)));
+	}
 
+	for(int iEta = 0; iEta < 4; iEta++) {
+		for(int iR9 = 0; iR9 < 2; iR9++) {
+			TString categoryName = TString(etaCategoryNames[iEta]) + R9CategoryNames[iR9];
+			std::map<TString, WeightTable>::const_iterator itr = r9tables.find("R9EtaWeight" + categoryName);
+			etaTables[iEta][iR9] = (itr == r9tables.end()) ? NULL : &(itr->second);
+			itr = r9tables.find("R9Weight" + categoryName);
+			R9Tables[iEta][iR9] = (itr == r9tables.end()) ? NULL : &(itr->second);
+		}
+	}
+	std::map<TString, WeightTable>::const_iterator itr = r9tables.find("R9PtWeightAllAll");
+	ptTable = (itr == r9tables.end()) ? NULL : &(itr->second);
 }
 
 
-double r9Weights_class::GetPtWeight(double PtEle_)
+double r9Weights_class::GetPtWeight(double PtEle_) const
 {
-	r9weights_map_t::const_iterator r9weights_itr =  r9weights.find("R9PtWeightAllAll");
-	if(r9weights_itr == r9weights.end()) {
+	if(ptTable == NULL) {
 		std::cerr << "[ERROR] Pt weight histogram not found!" << std::endl;
 		return -1;
-	} else return (--(r9weights_itr->second.upper_bound(PtEle_)))->second;
+	} else return ptTable->GetWeight(PtEle_);
 
 }
 
-double r9Weights_class::GetWeight(double etaEle_, double R9Ele_)
+double r9Weights_class::GetWeight(double etaEle_, double R9Ele_) const
 {
 #ifdef DEBUG
 	std::cout << "[DEBUG] GetWeight: " << etaEle_ << "\t" << R9Ele_ << std::endl;
 #endif
 
 	double r9Weight = 1.;
-	TString categoryName;
+	int iEta;
+	double absEta = fabs(etaEle_);
 
-	if(fabs(etaEle_) < 1.) categoryName = "EBlowEta";
-	else if(fabs(etaEle_) >= 1. && fabs(etaEle_) <= 1.479) categoryName = "EBhighEta";
-	else if(fabs(etaEle_) > 1.479 && fabs(etaEle_) < 2) categoryName = "EElowEta";
-	else if(fabs(etaEle_) >= 2) categoryName = "EEhighEta";
+	if(absEta < 1.) iEta = 0;
+	else if(absEta >= 1. && absEta <= 1.479) iEta = 1;
+	else if(absEta > 1.479 && absEta < 2) iEta = 2;
+	else if(absEta >= 2) iEta = 3;
 	else {
 		std::cerr << "Category not found: "
 		          << "etaEle = " << etaEle_ << "\t"
 		          << "R9Ele = " << R9Ele_ << std::endl;
 		return 0;
 	}
-	if (R9Ele_ >= 0.94) categoryName += "Gold";
-	else //if (R9Ele_<0.94 )
-		categoryName += "Bad";
-
-	if(categoryName.Sizeof() > 1) { // altrimenti non e' delle categorie definite sopra
-		std::vector<TString> WeightCat_vec;
-		WeightCat_vec.push_back("R9EtaWeight"); // weights of the eta distribution
-		WeightCat_vec.push_back("R9Weight");    // weights of the r9 distribution
-
-		r9weights_map_t::const_iterator r9weights_itr; // iterator pointing to one histogram
-		for(std::vector<TString>::const_iterator itrV = WeightCat_vec.begin();
-		        itrV != WeightCat_vec.end();
-		        itrV++) {
-			TString hist_prefix = *itrV;
-			if(r9weights.count(hist_prefix + categoryName) == 0) {
-				std::cerr << "[ERROR]: " << hist_prefix + categoryName << " not found in file " << std::endl;
-				std::cerr << etaEle_ << "\t" << R9Ele_ << std::endl;
-
-				exit(1);
-				continue;
-			}
-
-			r9weights_itr = r9weights.find(hist_prefix + categoryName);
-#ifdef DEBUG
-			std::cout << hist_prefix << "\t" << categoryName << "\t";
-#endif
-
-			r9weight_map_t::const_iterator itr; // first element less than x
-			if(hist_prefix.Contains("Eta")) {
-				itr = --(r9weights_itr->second.upper_bound(fabs(etaEle_))); // first element less than x
-			} else {
-				itr = --(r9weights_itr->second.upper_bound(fabs(R9Ele_))); // first element less than x
-			}
-			float r9Weight_0 = itr->second;
-#ifdef DEBUG
-			std::cout << etaEle_ << "\t" << R9Ele_ << "\t" << r9Weight_0 << std::endl;
-#endif
-			if (r9Weight_0 < 0) {
-				std::cerr << "[ERROR] weight < 0" << std::endl;
-				exit(1);
-			}
-			r9Weight *= r9Weight_0; // mi assicuro che il peso non sia nullo
-
+	int iR9 = (R9Ele_ >= 0.94) ? 0 : 1;
+
+	// weights of the eta distribution, then of the r9 distribution
+	const WeightTable *tables[2] = {etaTables[iEta][iR9], R9Tables[iEta][iR9]};
+	const char *hist_prefix[2] = {"R9EtaWeight", "R9Weight"};
+	double values[2] = {absEta, fabs(R9Ele_)};
+	for(int i = 0; i < 2; i++) {
+		if(tables[i] == NULL) {
+			std::cerr << "[ERROR]: " << hist_prefix[i] << etaCategoryNames[iEta] << R9CategoryNames[iR9] << " not found in file " << std::endl;
+			std::cerr << etaEle_ << "\t" << R9Ele_ << std::endl;
+			exit(1);
+		}
 
-		} // altrimenti lascio invariato r9Weight
+		float r9Weight_0 = tables[i]->GetWeight(values[i]);
 #ifdef DEBUG
-		std::cout << std::endl;
+		std::cout << hist_prefix[i] << "\t" << etaEle_ << "\t" << R9Ele_ << "\t" << r9Weight_0 << std::endl;
 #endif
+		if (r9Weight_0 < 0) {
+			std::cerr << "[ERROR] weight < 0" << std::endl;
+			exit(1);
+		}
+		r9Weight *= r9Weight_0; // mi assicuro che il peso non sia nullo
 	}
 
 	return r9Weight;
 }
 
+void r9Weights_class::GetWeights(size_t n, const Float_t *etaEle, const Float_t *R9Ele, Float_t *weights) const
+{
+	for(size_t i = 0; i < n; i++) weights[i] = GetWeight(etaEle[i], R9Ele[i]);
+}
+
+void r9Weights_class::GetPtWeights(size_t n, const Float_t *PtEle, Float_t *weights) const
+{
+	if(ptTable == NULL) {
+		for(size_t i = 0; i < n; i++) weights[i] = GetPtWeight(PtEle[i]);
+	} else ptTable->GetWeights(n, PtEle, weights);
+}
+
 
 
 void r9Weights_class::ReadFromFile(std::string filename)
@@ -147,6 +163,7 @@ void r9Weights_class::ReadFromFile(std::string filename)
 	}
 
 	f_r9->Close();
+	Compile();
 
 	return;
 }
@@ -154,53 +171,61 @@ void r9Weights_class::ReadFromFile(std::string filename)
 
 // tree is the input MC tree
 // fastLoop = false if for any reason you don't want to change the branch status of the MC tree
-TTree *r9Weights_class::GetTreeWeight(TChain *tree,  bool fastLoop, TString etaElebranchName, TString R9ElebranchName, TString ptElebranchName)
+namespace
 {
-	tree->ResetBranchAddresses();
-
-	Float_t weight[2] = {0.};
-	Float_t ptWeight[2] = {0.};
-	TTree *newTree = new TTree("r9Weight", "");
-	newTree->Branch("r9Weight", weight, "r9Weight[2]/F");
-	newTree->Branch("ptWeight", ptWeight, "ptWeight[2]/F");
-	if(fastLoop) {
-		tree->SetBranchStatus("*", 0);
-		tree->SetBranchStatus(etaElebranchName, 1);
-		tree->SetBranchStatus(R9ElebranchName, 1);
-		tree->SetBranchStatus(ptElebranchName, 1);
-	}
-
-	Float_t etaEle[2];
-	Float_t R9Ele[2];
-	Float_t PtEle[2];
-	tree->SetBranchAddress(etaElebranchName, etaEle);
-	tree->SetBranchAddress(R9ElebranchName, R9Ele);
-	tree->SetBranchAddress(ptElebranchName, PtEle);
+class r9WeightFiller: public BranchFiller
+{
+public:
+	r9WeightFiller(TString treename, TString etaElebranchName, TString R9ElebranchName, TString ptElebranchName, const r9Weights_class *weights):
+		BranchFiller(treename), _etaElebranchName(etaElebranchName), _R9ElebranchName(R9ElebranchName), _ptElebranchName(ptElebranchName),
+		_weights(weights)
+	{
+		weight[0] = weight[1] = 0.;
+		ptWeight[0] = ptWeight[1] = 0.;
+	};
+
+	bool Init(BranchProducer& producer)
+	{
+		etaEle = producer.Input<Float_t>(_etaElebranchName);
+		R9Ele = producer.Input<Float_t>(_R9ElebranchName);
+		PtEle = producer.Input<Float_t>(_ptElebranchName);
+		if(etaEle == NULL || R9Ele == NULL || PtEle == NULL) return false;
+
+		_tree->Branch("r9Weight", weight, "r9Weight[2]/F");
+		_tree->Branch("ptWeight", ptWeight, "ptWeight[2]/F");
+		return true;
+	};
+
+	void Compute(Long64_t ientry)
+	{
+		_weights->GetWeights(2, etaEle, R9Ele, weight);
+		_weights->GetPtWeights(2, PtEle, ptWeight);
+	};
+
+private:
+	TString _etaElebranchName, _R9ElebranchName, _ptElebranchName;
+	const r9Weights_class *_weights;
+	const Float_t *etaEle, *R9Ele, *PtEle;
+	Float_t weight[2];
+	Float_t ptWeight[2];
+};
+}
 
-	// loop over tree
-	Long64_t nentries = tree->GetEntriesFast();
-#ifdef DEBUG
-	nentries = 10;
-#endif
+BranchFiller *r9Weights_class::NewFiller(TString treename, TString etaElebranchName, TString R9ElebranchName, TString ptElebranchName)
+{
+	return new r9WeightFiller(treename, etaElebranchName, R9ElebranchName, ptElebranchName, this);
+}
 
-	std::cout << "[STATUS] Get R9WeightTree for tree: " << tree->GetTitle()
-	          << "\t" << "with " << nentries << " entries" << std::endl;
-	std::cerr << "[00%]";
-	for(Long64_t ientry = 0; ientry < nentries; ientry++) {
-		tree->GetEntry(ientry);
-		weight[0] = GetWeight(etaEle[0], R9Ele[0]);
-		weight[1] = GetWeight(etaEle[1], R9Ele[1]);
-		ptWeight[0] = GetPtWeight(PtEle[0]);
-		ptWeight[1] = GetPtWeight(PtEle[1]);
-		newTree->Fill();
-		if(ientry % (nentries / 100) == 0) std::cerr << "\b\b\b\b" << std::setw(2) << ientry / (nentries / 100) << "%]";
+/// fastLoop not used: only the input branches are read
+TTree *r9Weights_class::GetTreeWeight(TChain *tree,  bool fastLoop, TString etaElebranchName, TString R9ElebranchName, TString ptElebranchName)
+{
+	BranchProducer producer(tree);
+	if(!producer.Add(NewFiller("r9Weight", etaElebranchName, R9ElebranchName, ptElebranchName))) {
+		std::cerr << "[ERROR] Branches " << etaElebranchName << ", " << R9ElebranchName << ", " << ptElebranchName
+		          << " not found, impossible to produce r9 weights" << std::endl;
+		exit(1);
 	}
-	std::cout << std::endl;
-
-	if(fastLoop) tree->SetBranchStatus("*", 1);
-	tree->ResetBranchAddresses();
-	//  std::cout << "[WARNING] nPU > nPU max for " << warningCounter << " times" << std::endl;
-	return newTree;
+	return producer.Run()[0];
 }
 
 